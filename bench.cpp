@@ -0,0 +1,474 @@
+/*
+*   bench.cpp
+*   part of image blur software using CUDA
+*   for CSC 630 with Dr. Zhang
+*
+*   This program benchmarks the blur engines on synthetic images and writes the results as JSON,
+*   so performance can be compared between releases and hosts.  Built with `make bench`.
+*   Every combination of size x channels x radius x engine is planned once, warmed up, and then
+*   timed over a number of repetitions; only execute() is inside the clock.
+*
+*   Command-line arguments:
+*         option            input           description
+*       --sizes             edge list       square image edges in pixels, e.g. 256,1024,4096
+*       --channels          count list      channels per image, e.g. 1,3
+*       --radii             radius list     filter sizes (radius), e.g. 1,3,5
+*       --engines           engine list     engine names, or all for every engine in this build
+*       --sigma             std deviation   gaussian standard deviation in pixels
+*       --threads, -t       thread count    threads of the tiled engine
+*       --warmup            count           untimed runs before the repetitions
+*       --repetitions, -r   count           timed runs per case
+*       --perf-counters     none            hardware counters per case: IPC, cycles per pixel, cache and branch misses
+*       --roofline          none            measure host bandwidth and peak flops, and place every case against them
+*       --output, -o        path            JSON results, - for stdout
+*       --help, -h          none            display help for this program
+*
+*   Running the program:
+*       ./bench.exe --sizes 512,2048 --channels 3 --radii 1,3 --engines all -o bench.json
+*/
+
+#include "boost/program_options.hpp"
+#include "blur_engines.h"
+#include "blur_plan.h"
+#include "blur_tune.h"
+#include "buffer_pool.h"
+#include "json_writer.h"
+#include "perf_counters.h"
+#include "roofline.h"
+#include "utils.h"
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <ctime>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <memory>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+namespace
+{
+    const size_t ERROR_IN_COMMAND_LINE = 1;
+    const size_t SUCCESS = 0;
+    const size_t ERROR_UNHANDLED_EXCEPTION = 2;
+} // namespace
+
+struct BenchCase
+{
+    int64_t width, height;
+    int channels;
+    int radius;
+    BlurEngine engine;
+};
+
+struct BenchResult
+{
+    BenchCase config;
+    std::vector<double> milliseconds;   // one per repetition, sorted
+    double median = 0.0, p95 = 0.0, mean = 0.0;
+    double megapixelsPerSecond = 0.0;
+    double bytesPerSecond = 0.0;        // source read plus destination written, at the median
+    std::string error;                  // why the case couldn't run, e.g. no GPU
+    PerfReading perf;                   // summed over the repetitions, with --perf-counters
+    std::string perfError;              // why there are no counters
+    const MachineRoof *roof = nullptr;  // the roof the case ran under, with --roofline
+    RooflinePoint roofline;
+};
+
+//  Nearest-rank percentile of sorted samples
+static double percentile(const std::vector<double>& sorted, double p)
+{
+    size_t rank = (size_t)std::ceil(p * sorted.size());
+    return sorted[std::min(sorted.size(), std::max<size_t>(rank, 1)) - 1];
+}
+
+//  Comma-separated integers; false if any isn't a positive number
+static bool parseList(const std::string& text, std::vector<int>& numbers)
+{
+    numbers.clear();
+    for (const std::string& token : split(text, ','))
+    {
+        int number = std::atoi(token.c_str());
+        if ( number <= 0 )
+        {
+            return false;
+        }
+        numbers.push_back(number);
+    }
+    return !numbers.empty();
+}
+
+static BenchResult runCase(const BenchCase& config, double sigma, int threads, int warmup, int repetitions,
+                           PerfCounters *counters)
+{
+    BenchResult result;
+    result.config = config;
+    try
+    {
+        const size_t bytes = (size_t)config.width * config.height * config.channels;
+        PooledBuffer input = bufferPool().acquire(bytes), output = bufferPool().acquire(bytes);
+        const ImageView src = packedImageView(input.data(), config.width, config.height, config.channels);
+        const ImageView dst = packedImageView(output.data(), config.width, config.height, config.channels);
+
+        //  Noise, so no engine gets to skip work on flat regions
+        uint32_t noise = 12345;
+        for (size_t i = 0; i < bytes; i++)
+        {
+            noise = noise * 1103515245u + 12345u;
+            input.data()[i] = (unsigned char)(noise >> 24);
+        }
+
+        BlurPlanOptions options;
+        options.filterSize = config.radius;
+        options.cuda = config.engine == BlurEngine::Cuda;
+        options.tiled = config.engine == BlurEngine::Tiled;
+        if ( options.tiled )
+        {
+            options.tiling.threads = threads;
+        }
+        BlurPlan plan = make_blur_plan(config.width, config.height, config.channels, PixelType::UInt8, sigma,
+                                       BorderMode::Keep, options);
+
+        //  The counters are enabled outside the clock, so the times are the same with or without them
+        const bool counting = counters && counters->available();
+        for (int i = 0; i < PERF_EVENT_COUNT; i++)
+        {
+            result.perf.valid[i] = counting;
+        }
+        for (int run = 0; run < warmup + repetitions; run++)
+        {
+            if ( counting && run >= warmup )
+            {
+                counters->start();
+            }
+            std::chrono::steady_clock::time_point begin = std::chrono::steady_clock::now();
+            execute(plan, src, dst);
+            std::chrono::steady_clock::time_point end = std::chrono::steady_clock::now();
+            if ( run >= warmup )
+            {
+                result.milliseconds.push_back(std::chrono::duration<double, std::milli>(end - begin).count());
+                if ( counting )
+                {
+                    result.perf += counters->stop();
+                }
+            }
+        }
+        if ( counters && !counting )
+        {
+            result.perfError = counters->unavailableReason();
+        }
+
+        std::sort(result.milliseconds.begin(), result.milliseconds.end());
+        result.median = percentile(result.milliseconds, 0.5);
+        result.p95 = percentile(result.milliseconds, 0.95);
+        for (double ms : result.milliseconds)
+        {
+            result.mean += ms / result.milliseconds.size();
+        }
+        result.megapixelsPerSecond = config.width * config.height / 1e6 / (result.median / 1e3);
+        result.bytesPerSecond = 2.0 * bytes / (result.median / 1e3);
+    }
+    catch (std::exception& e)
+    {
+        result.error = e.what();
+    }
+    return result;
+}
+
+//  Counters per repetition; the engine's CPU side only, so a GPU kernel's work isn't in them
+static void writePerf(JsonWriter& json, const BenchResult& result, int repetitions)
+{
+    json.key("perf").beginObject();
+    if ( !result.perfError.empty() )
+    {
+        json.field("error", result.perfError).endObject();
+        return;
+    }
+    for (int i = 0; i < PERF_EVENT_COUNT; i++)
+    {
+        json.key(perfEventName((PerfEvent)i));
+        if ( result.perf.valid[i] )
+        {
+            json.value(result.perf.value[i] / repetitions);
+        }
+        else
+        {
+            json.null();
+        }
+    }
+    json.field("ipc", result.perf.ipc())
+        .field("cycles_per_pixel", result.perf.cyclesPer((double)result.config.width * result.config.height * repetitions))
+        .endObject();
+}
+
+//  Where the case lands against the roof of the threads it ran on; GPU cases have no host roof
+static void writeRoofline(JsonWriter& json, const BenchResult& result)
+{
+    json.key("roofline").beginObject();
+    if ( !result.roof )
+    {
+        json.field("error", "runs on the GPU; the roof is the host's").endObject();
+        return;
+    }
+    const RooflinePoint& point = result.roofline;
+    json.field("roof_threads", result.roof->threads)
+        .field("intensity_flops_per_byte", point.intensity)
+        .field("flops_per_second", point.flopsPerSecond)
+        .field("bytes_per_second", point.bytesPerSecond)
+        .field("attainable_flops_per_second", point.attainable)
+        .field("fraction_of_roof", point.fraction())
+        .field("bound", point.memoryBound ? "memory" : "compute")
+        .endObject();
+}
+
+static void writeResults(std::ostream& out, const std::vector<BenchResult>& results, double sigma, int threads,
+                         int warmup, int repetitions, bool perfFlag, const std::vector<MachineRoof>& roofs)
+{
+    char timestamp[32];
+    std::time_t now = std::time(nullptr);
+    std::strftime(timestamp, sizeof(timestamp), "%Y-%m-%dT%H:%M:%SZ", std::gmtime(&now));
+
+    JsonWriter json(out);
+    json.beginObject()
+        .field("schema", "cuda-blur-bench/1")
+        .field("timestamp", timestamp)
+        .field("host", hostKey())
+        .key("build").beginObject()
+            .field("cuda", findEngine(BlurEngine::Cuda) != nullptr)
+            .field("compiler", __VERSION__)
+        .endObject()
+        .key("settings").beginObject()
+            .field("sigma", sigma)
+            .field("threads", threads)
+            .field("warmup", warmup)
+            .field("repetitions", repetitions)
+            .field("perf_counters", perfFlag)
+            .field("roofline", !roofs.empty())
+            .field("border", "keep")
+            .field("layout", "packed planar, 8-bit")
+        .endObject();
+    if ( !roofs.empty() )
+    {
+        json.key("roofs").beginArray();
+        for (const MachineRoof& roof : roofs)
+        {
+            json.beginObject()
+                .field("threads", roof.threads)
+                .field("stream_triad_bytes_per_second", roof.bytesPerSecond)
+                .field("peak_flops_per_second", roof.flopsPerSecond)
+                .field("ridge_flops_per_byte", roof.ridge())
+                .endObject();
+        }
+        json.endArray();
+    }
+    json.key("results").beginArray();
+    for (const BenchResult& result : results)
+    {
+        const BenchCase& config = result.config;
+        json.beginObject()
+            .field("width", config.width)
+            .field("height", config.height)
+            .field("channels", config.channels)
+            .field("radius", config.radius)
+            .field("engine", engineName(config.engine));
+        if ( !result.error.empty() )
+        {
+            json.field("error", result.error).endObject();
+            continue;
+        }
+        json.field("median_ms", result.median)
+            .field("p95_ms", result.p95)
+            .field("mean_ms", result.mean)
+            .field("min_ms", result.milliseconds.front())
+            .field("max_ms", result.milliseconds.back())
+            .field("megapixels_per_second", result.megapixelsPerSecond)
+            .field("bytes_per_second", result.bytesPerSecond)
+            .key("samples_ms").beginArray();
+        for (double ms : result.milliseconds)
+        {
+            json.value(ms);
+        }
+        json.endArray();
+        if ( perfFlag )
+        {
+            writePerf(json, result, repetitions);
+        }
+        if ( !roofs.empty() )
+        {
+            writeRoofline(json, result);
+        }
+        json.endObject();
+    }
+    json.endArray().endObject();
+}
+
+int main(int argc, char** argv)
+{
+    try
+    {
+        std::string sizesText, channelsText, radiiText, enginesText, outputPath;
+        double sigma;
+        int threads, warmup, repetitions;
+        bool perfFlag = false;
+        bool rooflineFlag = false;
+        namespace po = boost::program_options;
+        po::options_description desc("Options");
+        desc.add_options()
+            ("help,h", "Print help messages")
+            ("sizes", po::value(&sizesText) -> default_value("256,512,1024"), "Square image edges in pixels, comma separated.")
+            ("channels", po::value(&channelsText) -> default_value("1,3"), "Channels per image, comma separated.")
+            ("radii", po::value(&radiiText) -> default_value("1,3"), "Filter sizes (radius), comma separated. 1 => 3x3, 3 => 7x7.")
+            ("engines", po::value(&enginesText) -> default_value("all"), "Engines, comma separated: sequential, tiled, cuda, or all in this build.")
+            ("sigma", po::value(&sigma) -> default_value(1.0), "Standard deviation of the gaussian, in pixels.")
+            ("threads,t", po::value(&threads) -> default_value(hardwareThreads()), "Threads of the tiled engine.")
+            ("warmup", po::value(&warmup) -> default_value(1), "Untimed runs before the repetitions of each case.")
+            ("repetitions,r", po::value(&repetitions) -> default_value(5), "Timed runs of each case.")
+            ("perf-counters", po::bool_switch(&perfFlag), "Hardware counters per case (perf_event_open): cycles, instructions, IPC, cycles per pixel, L1d/LLC and branch misses.")
+            ("roofline", po::bool_switch(&rooflineFlag), "Measure the host's STREAM triad bandwidth and multiply-add peak at 1 and --threads threads, and report each case's arithmetic intensity, achieved GFLOP/s and GB/s and where it lands against that roofline.")
+            ("output,o", po::value(&outputPath) -> default_value("bench.json"), "JSON results. Use - for stdout.");
+
+        po::variables_map vm;
+        try
+        {
+            po::store(po::parse_command_line(argc, argv, desc), vm);
+            if ( vm.count("help") )
+            {
+                std::cout << "Benchmark the blur engines on synthetic images." << std::endl << desc << std::endl;
+                return SUCCESS;
+            }
+            po::notify(vm);
+        }
+        catch(po::error& e)
+        {
+            std::cerr << "ERROR: " << e.what() << std::endl << std::endl << desc << std::endl;
+            return ERROR_IN_COMMAND_LINE;
+        }
+
+        std::vector<int> sizes, channels, radii;
+        if ( !parseList(sizesText, sizes) || !parseList(channelsText, channels) || !parseList(radiiText, radii) ||
+             sigma <= 0.0 || warmup < 0 || repetitions < 1 )
+        {
+            std::cerr << "ERROR: Bad --sizes, --channels, --radii, --sigma, --warmup or --repetitions. Exit with code " << ERROR_IN_COMMAND_LINE << "." << std::endl;
+            return ERROR_IN_COMMAND_LINE;
+        }
+        std::vector<BlurEngine> engines;
+        for (const std::string& name : split(enginesText, ','))
+        {
+            BlurEngine engine;
+            if ( name == "all" )
+            {
+                for (const EngineEntry& entry : blurEngines())
+                {
+                    engines.push_back(entry.engine);
+                }
+            }
+            else if ( engineFromName(name, engine) )
+            {
+                engines.push_back(engine);
+            }
+            else
+            {
+                std::cerr << "ERROR: Unknown engine " << name << ". Exit with code " << ERROR_IN_COMMAND_LINE << "." << std::endl;
+                return ERROR_IN_COMMAND_LINE;
+            }
+        }
+        threads = std::max(1, threads);
+
+        //  Progress goes to stderr when the JSON goes to stdout
+        std::ostream& log = outputPath == "-" ? std::cerr : std::cout;
+        std::unique_ptr<PerfCounters> counters;
+        if ( perfFlag )
+        {
+            counters.reset(new PerfCounters());
+            if ( !counters->available() )
+            {
+                log << "Perf counters unavailable: " << counters->unavailableReason() << std::endl;
+            }
+        }
+
+        //  Ceilings at 1 thread for the sequential engine and at --threads for the tiled one
+        std::vector<MachineRoof> roofs;
+        if ( rooflineFlag )
+        {
+            for (int roofThreads : { 1, threads })
+            {
+                if ( roofs.empty() || roofs.back().threads != roofThreads )
+                {
+                    roofs.push_back(measureMachineRoof(roofThreads));
+                    const MachineRoof& roof = roofs.back();
+                    log << "Roof at " << roofThreads << " thread(s): " << std::fixed << std::setprecision(2)
+                        << roof.bytesPerSecond / 1e9 << " GB/s triad, " << roof.flopsPerSecond / 1e9 << " GFLOP/s peak, ridge "
+                        << roof.ridge() << " flop/B" << std::endl;
+                }
+            }
+        }
+
+        std::vector<BenchResult> results;
+        for (int size : sizes)
+        {
+            for (int channelCount : channels)
+            {
+                for (int radius : radii)
+                {
+                    for (BlurEngine engine : engines)
+                    {
+                        BenchCase config = { size, size, channelCount, radius, engine };
+                        results.push_back(runCase(config, sigma, threads, warmup, repetitions, counters.get()));
+                        BenchResult& result = results.back();
+                        if ( !roofs.empty() && result.error.empty() && engine != BlurEngine::Cuda )
+                        {
+                            result.roof = engine == BlurEngine::Tiled ? &roofs.back() : &roofs.front();
+                            result.roofline = blurRooflinePoint(size, size, channelCount, radius, result.median / 1e3, *result.roof);
+                        }
+                        log << std::setw(5) << size << "x" << size << "x" << channelCount << " r" << radius << " "
+                            << std::setw(10) << engineName(engine) << ": ";
+                        if ( result.error.empty() )
+                        {
+                            log << std::fixed << std::setprecision(2) << "median " << result.median << " ms, p95 " << result.p95
+                                << " ms, " << result.megapixelsPerSecond << " MP/s, " << result.bytesPerSecond / 1e6 << " MB/s";
+                            if ( result.perf.any() )
+                            {
+                                log << ", IPC " << result.perf.ipc() << ", "
+                                    << result.perf.cyclesPer((double)size * size * repetitions) << " cycles/pixel";
+                            }
+                            if ( result.roof )
+                            {
+                                const RooflinePoint& point = result.roofline;
+                                log << ", " << point.intensity << " flop/B, " << point.flopsPerSecond / 1e9 << " GFLOP/s, "
+                                    << 100.0 * point.fraction() << "% of the " << ( point.memoryBound ? "memory" : "compute" ) << " roof";
+                            }
+                            log << std::endl;
+                        }
+                        else
+                        {
+                            log << result.error << std::endl;
+                        }
+                    }
+                }
+            }
+        }
+
+        if ( outputPath == "-" )
+        {
+            writeResults(std::cout, results, sigma, threads, warmup, repetitions, perfFlag, roofs);
+        }
+        else
+        {
+            std::ofstream out(outputPath);
+            writeResults(out, results, sigma, threads, warmup, repetitions, perfFlag, roofs);
+            if ( !out )
+            {
+                throw std::runtime_error("can't write " + outputPath);
+            }
+            log << "Results written to " << outputPath << std::endl;
+        }
+        return SUCCESS;
+    }
+    catch(std::exception& e)
+    {
+        std::cerr << "Unhandled Exception reached the top of main: " << e.what() << ", application will now exit" << std::endl;
+        return ERROR_UNHANDLED_EXCEPTION;
+    }
+}
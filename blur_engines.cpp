@@ -0,0 +1,97 @@
+/*
+*   blur_engines.cpp
+*   part of image blur software using CUDA
+*   for CSC 630 with Dr. Zhang
+*
+*   This program implements the blur engine registry.
+*/
+
+#include "blur_engines.h"
+#include "stage_timings.h"
+#include <cstring>
+
+static void runSequential(BlurPlan& plan, const ConstImageView& src, const ImageView& dst)
+{
+    for (int c = 0; c < src.channels; c++)
+    {
+        //  The border is left as it was, so start from a copy of the source
+        {
+            StageTimer timer("copy", c);
+            for (int64_t row = 0; row < src.height; row++)
+            {
+                std::memcpy(dst.row(c, row), src.row(c, row), src.width);
+            }
+        }
+        StageTimer timer("convolution", c);
+        blur_plane(src.row(c, 0), src.rowStride, dst.row(c, 0), dst.rowStride, src.width, src.height, plan.filter(), plan.filterSize);
+    }
+}
+
+static void runTiled(BlurPlan& plan, const ConstImageView& src, const ImageView& dst)
+{
+    //  Tiles of every channel share the workers, so the convolution is one stage
+    StageTimer timer("convolution");
+    blur_tiled(dst, src, plan.filter(), plan.filterSize, plan.tiles, plan.scratch.data(), plan.workers.get());
+}
+
+#ifdef BLUR_USE_CUDA
+static void runCuda(BlurPlan& plan, const ConstImageView& src, const ImageView& dst)
+{
+    blur_cuda_into(dst, src, plan.filterSize, *plan.device);
+}
+#else
+//  Without CUDA the engine isn't registered; direct callers get the same answer as plans
+void blur_cuda_into( const ImageView& dst , const ConstImageView& src , int filterSize , double sigma )
+{
+    throw UnsupportedError("this build has no CUDA engine (build with make USE_CUDA=1)");
+}
+
+CudaBuffersPtr make_cuda_buffers( int64_t width , int64_t height , const float *filter , int filterSize )
+{
+    throw UnsupportedError("this build has no CUDA engine (build with make USE_CUDA=1)");
+}
+
+//  No buffers are ever made, so there is nothing to free
+void CudaBuffersDeleter::operator()( CudaBuffers *buffers ) const
+{
+}
+#endif
+
+const std::vector<EngineEntry>& blurEngines()
+{
+    static const std::vector<EngineEntry> engines =
+    {
+        { BlurEngine::Sequential, "sequential", false, runSequential },
+        { BlurEngine::Tiled,      "tiled",      false, runTiled },
+#ifdef BLUR_USE_CUDA
+        { BlurEngine::Cuda,       "cuda",       true,  runCuda },
+#endif
+    };
+    return engines;
+}
+
+const EngineEntry *findEngine(BlurEngine engine)
+{
+    for (const EngineEntry& entry : blurEngines())
+    {
+        if ( entry.engine == engine )
+        {
+            return &entry;
+        }
+    }
+    return nullptr;
+}
+
+bool engineFromName(const std::string& name, BlurEngine& engine)
+{
+    const BlurEngine all[] = { BlurEngine::Sequential, BlurEngine::Tiled, BlurEngine::Cuda };
+    for (BlurEngine candidate : all)
+    {
+        if ( engineName(candidate) == name )
+        {
+            engine = candidate;
+            return true;
+        }
+    }
+    return false;
+}
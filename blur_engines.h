@@ -0,0 +1,44 @@
+/*
+*   blur_engines.h
+*   part of image blur software using CUDA
+*   for CSC 630 with Dr. Zhang
+*
+*   This header file contains the definitions for the blur engine registry.
+*   Each engine a plan can run on is one entry: its name and how it blurs a plan's images.
+*   The CPU engines are always built; the CUDA engine is only registered when the library is
+*   built with CUDA (BLUR_USE_CUDA, see Makefile), so CPU-only hosts need neither nvcc nor cudart.
+*/
+
+#ifndef BLUR_ENGINES_H
+#define BLUR_ENGINES_H
+
+#include "blur_plan.h"
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+//  Asked for something this build doesn't have, e.g. the CUDA engine without CUDA
+struct UnsupportedError : std::runtime_error
+{
+    explicit UnsupportedError(const std::string& what) : std::runtime_error(what) {}
+};
+
+struct EngineEntry
+{
+    BlurEngine engine;
+    const char *name;
+    bool gpu;                   // runs on a device that may be missing at run time
+    //  Blur the interior of every channel; the border is left to execute()
+    void (*run)(BlurPlan& plan, const ConstImageView& src, const ImageView& dst);
+};
+
+//  Engines in this build, CPU engines first
+const std::vector<EngineEntry>& blurEngines();
+
+//  Entry of an engine; nullptr if it isn't built in
+const EngineEntry *findEngine(BlurEngine engine);
+
+//  Engine by name ("sequential", "tiled", "cuda"); false if no engine has that name
+bool engineFromName(const std::string& name, BlurEngine& engine);
+
+#endif
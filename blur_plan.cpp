@@ -0,0 +1,130 @@
+/*
+*   blur_plan.cpp
+*   part of image blur software using CUDA
+*   for CSC 630 with Dr. Zhang
+*
+*   This program implements blur plans for repeated blurs of same-shaped images.
+*/
+
+#include "blur_plan.h"
+#include "blur_engines.h"
+#include "stage_timings.h"
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <stdexcept>
+#include <string>
+
+std::string engineName(BlurEngine engine)
+{
+    switch (engine)
+    {
+        case BlurEngine::Sequential: return "sequential";
+        case BlurEngine::Tiled:      return "tiled";
+        case BlurEngine::Cuda:       return "cuda";
+    }
+    return "unknown";
+}
+
+//  Filter radius the options ask for, or the one sigma needs
+static int planFilterSize(const BlurPlanOptions& options, double sigma)
+{
+    return options.filterSize > 0 ? options.filterSize : std::max(1, (int)std::ceil(3.0 * sigma));
+}
+
+//  The CPU engines go tiled on any tiling option
+static bool planUsesTiles(const BlurPlanOptions& options)
+{
+    const TileOptions& tiling = options.tiling;
+    return !options.cuda && ( options.tiled || tiling.threads > 1 || tiling.tileSize > 0 || tiling.maxMemory > 0 );
+}
+
+size_t planMemory( int64_t width , int64_t height , double sigma , const BlurPlanOptions& options )
+{
+    const int filterSize = planFilterSize(options, sigma);
+    const size_t filterWidth = 2*filterSize + 1;
+    size_t bytes = BufferPool::classSize(sizeof(float) * filterWidth * filterWidth);
+    if ( planUsesTiles(options) )
+    {
+        const TilePlan tiles = planTiles(width, height, filterSize, options.tiling);
+        bytes += BufferPool::classSize(tiles.scratchStride * tiles.tilesInFlight);
+    }
+    return bytes;
+}
+
+BlurPlan make_blur_plan( int64_t width , int64_t height , int channels , PixelType type , double sigma ,
+                         BorderMode border , const BlurPlanOptions& options )
+{
+    if ( type != PixelType::UInt8 )
+    {
+        throw std::invalid_argument("make_blur_plan(): only 8-bit pixels can be blurred");
+    }
+    if ( width < 1 || height < 1 || channels < 1 || sigma <= 0.0 || options.filterSize < 0 )
+    {
+        throw std::invalid_argument("make_blur_plan(): bad image shape, sigma or filter size");
+    }
+
+    BlurPlan plan;
+    plan.width = width;
+    plan.height = height;
+    plan.channels = channels;
+    plan.type = type;
+    plan.sigma = sigma;
+    plan.filterSize = planFilterSize(options, sigma);
+    plan.border = border;
+
+    {
+        StageTimer timer("kernel");
+        const size_t filterWidth = 2*plan.filterSize + 1;
+        plan.kernel = bufferPool().acquire(sizeof(float) * filterWidth * filterWidth);
+        getFilter(plan.filterSize, sigma, reinterpret_cast<float*>(plan.kernel.data()));
+    }
+
+    //  Engine, then the tiling and scratch it needs
+    const TileOptions& tiling = options.tiling;
+    if ( options.cuda )
+    {
+        plan.engine = BlurEngine::Cuda;
+        if ( !findEngine(BlurEngine::Cuda) )
+        {
+            throw UnsupportedError("make_blur_plan(): this build has no CUDA engine (build with make USE_CUDA=1)");
+        }
+        plan.device = make_cuda_buffers(width, height, plan.filter(), plan.filterSize);
+    }
+    else if ( planUsesTiles(options) )
+    {
+        plan.engine = BlurEngine::Tiled;
+        plan.tiles = planTiles(width, height, plan.filterSize, tiling);
+        plan.scratch = bufferPool().acquire(plan.tiles.scratchStride * plan.tiles.tilesInFlight);
+        plan.workers.reset(new WorkerPool(plan.tiles.tilesInFlight));
+    }
+    else
+    {
+        plan.engine = BlurEngine::Sequential;
+    }
+    return plan;
+}
+
+void execute( BlurPlan& plan , const ConstImageView& src , const ImageView& dst )
+{
+    if ( src.width != plan.width || src.height != plan.height || src.channels != plan.channels ||
+         dst.width != plan.width || dst.height != plan.height || dst.channels != plan.channels )
+    {
+        throw std::invalid_argument("execute(): image shape differs from the plan");
+    }
+
+    const EngineEntry *entry = findEngine(plan.engine);
+    if ( !entry )
+    {
+        throw UnsupportedError("execute(): engine " + engineName(plan.engine) + " isn't built in");
+    }
+    entry->run(plan, src, dst);
+
+    //  Every engine leaves the border as it was; other border modes blur it here
+    for (int c = 0; c < src.channels && plan.border != BorderMode::Keep; c++)
+    {
+        StageTimer timer("border", c);
+        blur_border(src.row(c, 0), src.rowStride, dst.row(c, 0), dst.rowStride, src.width, src.height,
+                    plan.filter(), plan.filterSize, plan.border);
+    }
+}
@@ -0,0 +1,79 @@
+/*
+*   blur_plan.h
+*   part of image blur software using CUDA
+*   for CSC 630 with Dr. Zhang
+*
+*   This header file contains the definitions for blur plans.
+*   As with FFT libraries, everything that only depends on the shape of the job is worked out once
+*   by make_blur_plan(): the filter, the engine, the tiling, the scratch buffers and worker threads,
+*   or for CUDA the device planes and the uploaded filter.  execute() then blurs any number of
+*   same-shaped images with no further setup, buffer allocation or thread start.
+*   The plan's buffers come from the buffer pool, so planning the same shape again reuses them.
+*/
+
+#ifndef BLUR_PLAN_H
+#define BLUR_PLAN_H
+
+#include "blur_tiled.h"
+#include "buffer_pool.h"
+#include "cimg_utils.h"
+#include "image_view.h"
+#include "utils.h"
+#include <cstdint>
+#include <vector>
+
+//  Where the blur runs
+enum class BlurEngine { Sequential, Tiled, Cuda };
+
+//  Printable engine name
+std::string engineName(BlurEngine engine);
+
+struct BlurPlanOptions
+{
+    int filterSize = 0;         // filter radius; 0 picks ceil(3 * sigma)
+    bool cuda = false;          // run on the GPU
+    bool tiled = false;         // run in tiles; so does more than one thread, a tile size or a memory budget
+    TileOptions tiling;
+};
+
+/*
+*   A plan owns its buffers, so it can be moved but not copied.
+*   One plan must not be executed from two threads at once; make one plan per thread instead.
+*/
+struct BlurPlan
+{
+    int64_t width = 0, height = 0;
+    int channels = 0;
+    PixelType type = PixelType::UInt8;
+    double sigma = 1.0;
+    int filterSize = 0;
+    BorderMode border = BorderMode::Keep;
+    BlurEngine engine = BlurEngine::Sequential;
+    TilePlan tiles = TilePlan();                // Tiled engine only
+
+    PooledBuffer kernel;                        // (2*filterSize+1)^2 float weights, row after row
+    PooledBuffer scratch;                       // tiles.scratchStride bytes per worker (Tiled engine)
+    CudaBuffersPtr device;                      // device planes and filter (Cuda engine)
+    std::unique_ptr<WorkerPool> workers;        // tiles.tilesInFlight threads, kept between executes (Tiled engine)
+
+    const float *filter() const { return reinterpret_cast<const float*>(kernel.data()); }
+
+    BlurPlan() {}
+    BlurPlan(BlurPlan&&) = default;
+    BlurPlan& operator=(BlurPlan&&) = default;
+    BlurPlan(const BlurPlan&) = delete;
+    BlurPlan& operator=(const BlurPlan&) = delete;
+};
+
+//  Host bytes a plan for width x height images holds (filter and tile scratch, in pool size classes),
+//  without allocating them; the images themselves belong to the caller
+size_t planMemory( int64_t width , int64_t height , double sigma , const BlurPlanOptions& options );
+
+//  Plan blurs of width x height x channels images; only UInt8 pixels are supported so far
+BlurPlan make_blur_plan( int64_t width , int64_t height , int channels , PixelType type , double sigma ,
+                         BorderMode border , const BlurPlanOptions& options = BlurPlanOptions() );
+
+//  Blur src into dst, both shaped as planned and not overlapping
+void execute( BlurPlan& plan , const ConstImageView& src , const ImageView& dst );
+
+#endif
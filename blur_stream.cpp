@@ -0,0 +1,125 @@
+/*
+*   blur_stream.cpp
+*   part of image blur software using CUDA
+*   for CSC 630 with Dr. Zhang
+*
+*   This program implements the streaming blur for images larger than memory.
+*   The result is identical to blur_sequential: the same filter, the same summation order,
+*   and the filterSize-wide border left as it was.
+*/
+
+#include "blur_stream.h"
+#include "cimg_utils.h"
+#include "image_io.h"
+#include <stdexcept>
+#include <vector>
+
+/*
+*   Ring buffer of the last 2*filterSize+1 rows, one plane per channel.
+*   Image row y lives in slot y % (2*filterSize+1).
+*/
+struct RowRing
+{
+    int width, channels, slots;
+    std::vector<unsigned char> planes;
+
+    RowRing(int width, int channels, int slots) : width(width), channels(channels), slots(slots),
+        planes((size_t)width * channels * slots) {}
+
+    unsigned char *row(int c, long y)
+    {
+        return planes.data() + ((size_t)c * slots + (size_t)(y % slots)) * width;
+    }
+};
+
+//  Read one interleaved row and split it into the ring
+static void readRow(std::FILE *input, RowRing& ring, long y, std::vector<unsigned char>& interleaved)
+{
+    if ( std::fread(interleaved.data(), 1, interleaved.size(), input) != interleaved.size() )
+    {
+        throw std::runtime_error("blur_stream(): input ended early");
+    }
+    for (int c = 0; c < ring.channels; c++)
+    {
+        unsigned char *plane = ring.row(c, y);
+        for (int x = 0; x < ring.width; x++)
+        {
+            plane[x] = interleaved[(size_t)x*ring.channels + c];
+        }
+    }
+}
+
+//  Write one row, blurred or (border rows) as read
+static void writeRow(std::FILE *output, RowRing& ring, long y, bool blurRow, const float *filter, int filterSize,
+                     std::vector<unsigned char>& interleaved)
+{
+    for (int c = 0; c < ring.channels; c++)
+    {
+        const unsigned char *plane = ring.row(c, y);
+        for (int x = 0; x < ring.width; x++)
+        {
+            interleaved[(size_t)x*ring.channels + c] = plane[x];
+        }
+        if ( !blurRow )
+        {
+            continue;
+        }
+
+        for (int col = filterSize; col < ring.width - filterSize; col++)
+        {
+            float pixelValue=0.0;
+            for (int vrow = 0; vrow <= 2*filterSize; vrow++)
+            {
+                const unsigned char *source = ring.row(c, y - filterSize + vrow);
+                for (int vcol = 0; vcol <= 2*filterSize; vcol++)
+                {
+                    pixelValue += ( source[col - filterSize + vcol] * filter[vrow*(2*filterSize + 1) + vcol] );
+                }
+            }
+            interleaved[(size_t)col*ring.channels + c] = (unsigned char)pixelValue;
+        }
+    }
+    if ( std::fwrite(interleaved.data(), 1, interleaved.size(), output) != interleaved.size() )
+    {
+        throw std::runtime_error("blur_stream(): write error");
+    }
+}
+
+/*
+*   Rows 0 .. filterSize-1 are border rows and go straight out.  Once row y+filterSize has been read,
+*   row y has its whole neighbourhood in the ring and is blurred and written.  The last filterSize
+*   rows are border rows again and are flushed from the ring at the end.
+*/
+long blur_stream( std::FILE *input , std::FILE *output , int filterSize , double sigma )
+{
+    ImageInfo info = readPnmHeader(input);
+    writePnmHeader(output, info);
+
+    const std::vector<float> filter = getFilter(filterSize, sigma);
+
+    const long height = info.height;
+    const bool blurColumns = info.width > 2*filterSize;
+    RowRing ring(info.width, info.channels, 2*filterSize + 1);
+    std::vector<unsigned char> interleaved((size_t)info.width * info.channels);
+    long written = 0;
+
+    for (long y = 0; y < height; y++)
+    {
+        readRow(input, ring, y, interleaved);
+        if ( y < filterSize )
+        {
+            writeRow(output, ring, written++, false, filter.data(), filterSize, interleaved);
+        }
+        else if ( y >= 2*filterSize )
+        {
+            writeRow(output, ring, written++, blurColumns, filter.data(), filterSize, interleaved);
+        }
+    }
+    while ( written < height )
+    {
+        writeRow(output, ring, written++, false, filter.data(), filterSize, interleaved);
+    }
+    std::fflush(output);
+
+    return written;
+}
@@ -0,0 +1,19 @@
+/*
+*   blur_stream.h
+*   part of image blur software using CUDA
+*   for CSC 630 with Dr. Zhang
+*
+*   This header file contains the definitions for the streaming (rolling-window) blur.
+*   Rows are read one at a time and each blurred row is written as soon as the rows below it
+*   have arrived, so only 2*filterSize+1 rows per channel are ever held in memory.
+*/
+
+#ifndef BLUR_STREAM_H
+#define BLUR_STREAM_H
+
+#include <cstdio>
+
+//  Blur a binary PNM (P5 / P6) from input to output; returns the number of rows written
+long blur_stream( std::FILE *input , std::FILE *output , int filterSize , double sigma );
+
+#endif
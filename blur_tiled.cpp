@@ -0,0 +1,156 @@
+/*
+*   blur_tiled.cpp
+*   part of image blur software using CUDA
+*   for CSC 630 with Dr. Zhang
+*
+*   This program implements the tiled blur for images too large to blur in one piece.
+*/
+
+#include "blur_tiled.h"
+#include "buffer_pool.h"
+#include "cimg_utils.h"
+#include "trace_events.h"
+#include "utils.h"
+#include <algorithm>
+#include <cstring>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+//  Bytes of one tile's input and output buffers, both with halo and rows padded to cache lines;
+//  channels are done one at a time
+static size_t tileBytes(int tileWidth, int tileHeight, int filterSize)
+{
+    return 2 * paddedRowStride(tileWidth + 2*filterSize) * (tileHeight + 2*filterSize);
+}
+
+/*
+*   Without a budget, tiles are 512 pixels square and every thread has one in flight.
+*   With a budget, the tile edge is the largest (up to 2048) that lets every thread have a tile
+*   in flight; if even 64-pixel tiles don't fit, fewer tiles are kept in flight instead.
+*/
+TilePlan planTiles( int64_t width , int64_t height , int filterSize , const TileOptions& options )
+{
+    const int defaultTile = 512, largestTile = 2048, smallestTile = 64;
+    TilePlan plan;
+    plan.tilesInFlight = std::max(1, options.threads);
+
+    int tile = options.tileSize > 0 ? options.tileSize : defaultTile;
+    if ( options.maxMemory > 0 && options.tileSize <= 0 )
+    {
+        tile = smallestTile;
+        while ( tile < largestTile &&
+                tileBytes(2*tile, 2*tile, filterSize) * plan.tilesInFlight <= options.maxMemory )
+        {
+            tile *= 2;
+        }
+    }
+    if ( options.maxMemory > 0 )
+    {
+        size_t fits = options.maxMemory / tileBytes(tile, tile, filterSize);
+        if ( fits == 0 )
+        {
+            throw std::invalid_argument("planTiles(): memory budget of " + std::to_string(options.maxMemory) +
+                " bytes can't hold a single " + std::to_string(tile) + " pixel tile");
+        }
+        plan.tilesInFlight = (int)std::min<size_t>(plan.tilesInFlight, fits);
+    }
+
+    plan.tileWidth = (int)std::min<int64_t>(tile, width);
+    plan.tileHeight = (int)std::min<int64_t>(tile, height);
+    plan.tilesX = (width + plan.tileWidth - 1) / plan.tileWidth;
+    plan.tilesY = (height + plan.tileHeight - 1) / plan.tileHeight;
+    plan.tilesInFlight = (int)std::min<int64_t>(plan.tilesInFlight, plan.tilesX * plan.tilesY);
+    plan.bytesPerTile = tileBytes(plan.tileWidth, plan.tileHeight, filterSize);
+    plan.scratchStride = paddedRowStride(plan.bytesPerTile);
+    return plan;
+}
+
+/*
+*   Each tile reads its interior plus a halo of up to filterSize pixels (clipped at the image edge)
+*   into a private buffer, blurs it into a second buffer that starts as a copy, and writes the
+*   interior back.  Pixels within filterSize of the image edge are never blurred, as in blur_plane,
+*   so the stitched result is identical to blurring the whole image at once.
+*/
+void blur_tiled( const ImageView& dst , const ConstImageView& src , int filterSize , double sigma , const TilePlan& plan )
+{
+    //  Filter and tile buffers come from this thread's arena, so repeated calls don't allocate
+    ScratchArena& arena = threadArena();
+    ArenaScope scope(arena);
+    float *filter = arena.allocate<float>((size_t)(2*filterSize + 1) * (2*filterSize + 1));
+    getFilter(filterSize, sigma, filter);
+    unsigned char *scratch = arena.allocate(plan.scratchStride * plan.tilesInFlight);
+
+    blur_tiled(dst, src, filter, filterSize, plan, scratch);
+}
+
+//  Everything a tile needs, so the worker lambda captures one pointer and std::function stores it without allocating
+struct TileJob
+{
+    const ImageView& dst;
+    const ConstImageView& src;
+    const float *filter;
+    int filterSize;
+    const TilePlan& plan;
+    unsigned char *scratch;
+};
+
+static void blurTile( const TileJob& job , int64_t tile , int worker )
+{
+    const ImageView& dst = job.dst;
+    const ConstImageView& src = job.src;
+    const TilePlan& plan = job.plan;
+    const int filterSize = job.filterSize;
+    const int64_t width = src.width, height = src.height;
+
+    const int64_t x0 = (tile % plan.tilesX) * plan.tileWidth;
+    const int64_t y0 = (tile / plan.tilesX) * plan.tileHeight;
+    const int64_t x1 = std::min(width, x0 + plan.tileWidth);
+    const int64_t y1 = std::min(height, y0 + plan.tileHeight);
+
+    //  Halo-extended region, clipped to the image
+    const int64_t hx0 = std::max<int64_t>(0, x0 - filterSize), hy0 = std::max<int64_t>(0, y0 - filterSize);
+    const int64_t hx1 = std::min(width, x1 + filterSize), hy1 = std::min(height, y1 + filterSize);
+    const int regionWidth = (int)(hx1 - hx0), regionHeight = (int)(hy1 - hy0);
+    //  Both buffers start on a cache line and so does every row in them
+    const size_t regionStride = paddedRowStride(regionWidth);
+    const size_t regionSize = regionStride * regionHeight;
+    unsigned char *input = job.scratch + (size_t)worker * plan.scratchStride;
+    unsigned char *output = input + regionSize;
+
+    for (int c = 0; c < src.channels; c++)
+    {
+        for (int row = 0; row < regionHeight; row++)
+        {
+            std::memcpy(input + (size_t)row * regionStride, src.row(c, hy0 + row) + hx0, regionWidth);
+        }
+        std::memcpy(output, input, regionSize);
+
+        //  Region pixels within filterSize of the region edge are halo or image border
+        blur_plane(input, regionStride, output, regionStride, regionWidth, regionHeight, job.filter, filterSize);
+
+        for (int64_t y = y0; y < y1; y++)
+        {
+            std::memcpy(dst.row(c, y) + x0, output + (size_t)(y - hy0) * regionStride + (x0 - hx0), x1 - x0);
+        }
+    }
+}
+
+void blur_tiled( const ImageView& dst , const ConstImageView& src , const float *filter , int filterSize ,
+                 const TilePlan& plan , unsigned char *scratch , WorkerPool *workers )
+{
+    const TileJob job = { dst, src, filter, filterSize, plan, scratch };
+    const std::function<void(int64_t, int)> body = [&job](int64_t tile, int worker)
+    {
+        TraceSpan span("tile", "blur", tile);
+        blurTile(job, tile, worker);
+    };
+    if ( workers )
+    {
+        workers->run(plan.tilesX * plan.tilesY, body);
+    }
+    else
+    {
+        parallelForWorkers(plan.tilesX * plan.tilesY, plan.tilesInFlight, body);
+    }
+}
@@ -0,0 +1,47 @@
+/*
+*   blur_tiled.h
+*   part of image blur software using CUDA
+*   for CSC 630 with Dr. Zhang
+*
+*   This header file contains the definitions for the tiled blur.
+*   The image is cut into tiles; each tile is copied out with a filterSize-pixel halo of its
+*   neighbours' pixels, blurred on its own, and its interior is stitched back into the output.
+*   Tiles are processed on several threads, and a memory budget bounds the tile buffers in flight.
+*/
+
+#ifndef BLUR_TILED_H
+#define BLUR_TILED_H
+
+#include "image_view.h"
+#include "utils.h"
+#include <cstddef>
+#include <cstdint>
+
+struct TileOptions
+{
+    size_t maxMemory = 0;       // bytes for tile buffers in flight; 0 means no limit
+    int threads = 1;            // tiles processed at once, at most
+    int tileSize = 0;           // tile edge in pixels; 0 picks one from the budget
+};
+
+struct TilePlan
+{
+    int tileWidth, tileHeight;  // interior, without halo
+    int64_t tilesX, tilesY;
+    int tilesInFlight;          // worker threads
+    size_t bytesPerTile;        // input + output buffer of one tile, halo included
+    size_t scratchStride;       // bytesPerTile rounded up to a cache line: one worker's share of the scratch
+};
+
+//  Tile size and concurrency for an image under the options' memory budget; throws if it can't fit
+TilePlan planTiles( int64_t width , int64_t height , int filterSize , const TileOptions& options );
+
+//  Tiled blur between views; same result as blur_sequential_into
+void blur_tiled( const ImageView& dst , const ConstImageView& src , int filterSize , double sigma , const TilePlan& plan );
+
+//  Same with a ready-made filter and plan.tilesInFlight * plan.scratchStride bytes of scratch, 64-byte aligned.
+//  The tiles run on workers, when given (plan.tilesInFlight threads), or else on threads started for the call.
+void blur_tiled( const ImageView& dst , const ConstImageView& src , const float *filter , int filterSize ,
+                 const TilePlan& plan , unsigned char *scratch , WorkerPool *workers = nullptr );
+
+#endif
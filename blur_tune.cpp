@@ -0,0 +1,277 @@
+/*
+*   blur_tune.cpp
+*   part of image blur software using CUDA
+*   for CSC 630 with Dr. Zhang
+*
+*   This program implements engine autotuning and the tuning profile.
+*/
+
+#include "blur_tune.h"
+#include "blur_engines.h"
+#include "blur_tiled.h"
+#include "buffer_pool.h"
+#include "logging.h"
+#include "utils.h"
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <fstream>
+#include <sstream>
+#include <stdexcept>
+#include <vector>
+#include <sys/stat.h>
+#include <unistd.h>
+
+//  Samples are at most this many pixels on a side: big enough for several tiles of the largest
+//  candidate size, small enough to tune in seconds
+static const int64_t SAMPLE_EDGE = 1024;
+static const int WARM_UPS = 1, REPETITIONS = 3;
+
+std::string hostKey()
+{
+    std::string model = "unknown cpu";
+    std::ifstream cpuinfo("/proc/cpuinfo");
+    std::string line;
+    while ( std::getline(cpuinfo, line) )
+    {
+        //  "model name" on x86, "Model" on some ARM kernels
+        if ( line.compare(0, 10, "model name") == 0 || line.compare(0, 5, "Model") == 0 )
+        {
+            size_t colon = line.find(':');
+            if ( colon != std::string::npos && colon + 2 <= line.size() )
+            {
+                model = line.substr(colon + 2);
+                break;
+            }
+        }
+    }
+    //  '|' separates profile fields
+    std::replace(model.begin(), model.end(), '|', '/');
+    return model + " x" + std::to_string(hardwareThreads());
+}
+
+std::string imageClass( int64_t width , int64_t height , int channels , int filterSize , BorderMode border )
+{
+    const char *borders[] = { "keep", "clamp", "mirror" };
+    const int64_t pixels = width * height;
+    int64_t bucket = 1;
+    while ( bucket * 2 <= pixels )
+    {
+        bucket *= 2;
+    }
+    return std::to_string(bucket) + "px c" + std::to_string(channels) + " r" + std::to_string(filterSize) +
+           " " + borders[(int)border];
+}
+
+std::string defaultTuningProfilePath()
+{
+    const char *home = std::getenv("HOME");
+    if ( !home || !*home )
+    {
+        return ".blur_tuning.profile";
+    }
+    return std::string(home) + "/.cache/cuda-blur/tuning.profile";
+}
+
+//  Profile lines other than the one for host and imageClass; the match, if any, goes to choice
+static std::vector<std::string> readProfile( const std::string& path , const std::string& host ,
+                                             const std::string& image , TuneChoice& choice , bool& found )
+{
+    std::vector<std::string> others;
+    std::ifstream profile(path);
+    std::string line;
+    found = false;
+    while ( std::getline(profile, line) )
+    {
+        std::vector<std::string> fields = split(line, '|');
+        BlurEngine engine;
+        if ( fields.size() == 6 && fields[0] == host && fields[1] == image && engineFromName(fields[2], engine) &&
+             findEngine(engine) )
+        {
+            choice.engine = engine;
+            choice.threads = std::max(1, std::atoi(fields[3].c_str()));
+            choice.tileSize = std::max(0, std::atoi(fields[4].c_str()));
+            choice.milliseconds = std::atof(fields[5].c_str());
+            choice.fromProfile = true;
+            found = true;
+        }
+        else if ( !line.empty() && line[0] != '#' )
+        {
+            others.push_back(line);
+        }
+    }
+    return others;
+}
+
+//  Rewrite the profile with the new line, through a temporary file so readers never see half of it
+static void writeProfile( const std::string& path , const std::vector<std::string>& others , const std::string& line )
+{
+    //  Create the directories on the way, e.g. ~/.cache/cuda-blur
+    for (size_t slash = path.find('/', 1); slash != std::string::npos; slash = path.find('/', slash + 1))
+    {
+        mkdir(path.substr(0, slash).c_str(), 0755);
+    }
+    const std::string temporary = path + ".tmp" + std::to_string(::getpid());
+    {
+        std::ofstream profile(temporary);
+        profile << "# blur tuning profile: host|image class|engine|threads|tile size|sample ms\n";
+        for (const std::string& other : others)
+        {
+            profile << other << "\n";
+        }
+        profile << line << "\n";
+        if ( !profile )
+        {
+            std::remove(temporary.c_str());
+            return;
+        }
+    }
+    if ( std::rename(temporary.c_str(), path.c_str()) != 0 )
+    {
+        std::remove(temporary.c_str());
+    }
+}
+
+//  Fit a choice to this call: the profile isn't keyed by thread cap or memory budget, so a choice
+//  tuned with more threads is cut to maxThreads, and a tile size that no longer fits maxMemory goes
+//  back to planTiles' pick from the budget
+static void fitChoice( TuneChoice& choice , int64_t width , int64_t height , int filterSize , int maxThreads ,
+                       size_t maxMemory )
+{
+    choice.threads = std::min(choice.threads, std::max(1, maxThreads));
+    if ( choice.engine == BlurEngine::Tiled && choice.tileSize > 0 && maxMemory > 0 )
+    {
+        TileOptions tiling;
+        tiling.maxMemory = maxMemory;
+        tiling.threads = choice.threads;
+        tiling.tileSize = choice.tileSize;
+        try
+        {
+            planTiles(width, height, filterSize, tiling);
+        }
+        catch (std::invalid_argument&)
+        {
+            LOG_DEBUG("Tuned tile size " << choice.tileSize << " doesn't fit " << maxMemory << " bytes, letting planTiles choose");
+            choice.tileSize = 0;
+        }
+    }
+}
+
+//  Median blur time of one candidate on the sample, or a negative time if it can't run here
+static double timeCandidate( const ConstImageView& src , const ImageView& dst , double sigma , int filterSize ,
+                             BorderMode border , const BlurPlanOptions& options )
+{
+    try
+    {
+        BlurPlan plan = make_blur_plan(src.width, src.height, src.channels, PixelType::UInt8, sigma, border, options);
+        std::vector<double> times;
+        for (int run = 0; run < WARM_UPS + REPETITIONS; run++)
+        {
+            std::chrono::steady_clock::time_point begin = std::chrono::steady_clock::now();
+            execute(plan, src, dst);
+            std::chrono::steady_clock::time_point end = std::chrono::steady_clock::now();
+            if ( run >= WARM_UPS )
+            {
+                times.push_back(std::chrono::duration<double, std::milli>(end - begin).count());
+            }
+        }
+        std::sort(times.begin(), times.end());
+        return times[times.size() / 2];
+    }
+    catch (std::exception&)
+    {
+        //  e.g. no GPU on this host, or a tile that doesn't fit the memory budget
+        return -1.0;
+    }
+}
+
+TuneChoice tuneEngine( int64_t width , int64_t height , int channels , double sigma , int filterSize ,
+                       BorderMode border , int maxThreads , size_t maxMemory , const std::string& profilePath )
+{
+    if ( filterSize <= 0 )
+    {
+        filterSize = std::max(1, (int)std::ceil(3.0 * sigma));
+    }
+    const std::string host = hostKey();
+    const std::string image = imageClass(width, height, channels, filterSize, border);
+
+    TuneChoice best;
+    bool found;
+    const std::vector<std::string> others = readProfile(profilePath, host, image, best, found);
+    if ( found )
+    {
+        fitChoice(best, width, height, filterSize, maxThreads, maxMemory);
+        return best;
+    }
+
+    //  Synthetic sample of the image class with rows padded as the pool lays them out
+    const int64_t sampleWidth = std::min(width, SAMPLE_EDGE), sampleHeight = std::min(height, SAMPLE_EDGE);
+    PooledBuffer input = bufferPool().acquire(paddedImageBytes(sampleWidth, sampleHeight, channels));
+    PooledBuffer output = bufferPool().acquire(paddedImageBytes(sampleWidth, sampleHeight, channels));
+    const ImageView src = paddedImageView(input.data(), sampleWidth, sampleHeight, channels);
+    const ImageView dst = paddedImageView(output.data(), sampleWidth, sampleHeight, channels);
+    uint32_t noise = 12345;
+    for (size_t i = 0; i < paddedImageBytes(sampleWidth, sampleHeight, channels); i++)
+    {
+        noise = noise * 1103515245u + 12345u;
+        input.data()[i] = (unsigned char)(noise >> 24);
+    }
+
+    //  Candidates: every engine built in, the tiled one at a few thread counts and tile sizes
+    std::vector<TuneChoice> candidates;
+    std::vector<int> threadCounts = { 1, std::max(1, maxThreads / 2), std::max(1, maxThreads) };
+    std::sort(threadCounts.begin(), threadCounts.end());
+    threadCounts.erase(std::unique(threadCounts.begin(), threadCounts.end()), threadCounts.end());
+    for (const EngineEntry& entry : blurEngines())
+    {
+        TuneChoice candidate;
+        candidate.engine = entry.engine;
+        if ( entry.engine != BlurEngine::Tiled )
+        {
+            candidates.push_back(candidate);
+            continue;
+        }
+        for (int threads : threadCounts)
+        {
+            for (int tileSize : { 128, 256, 512 })
+            {
+                candidate.threads = threads;
+                candidate.tileSize = tileSize;
+                candidates.push_back(candidate);
+            }
+        }
+    }
+
+    best.milliseconds = -1.0;
+    for (TuneChoice& candidate : candidates)
+    {
+        BlurPlanOptions options;
+        options.filterSize = filterSize;
+        options.cuda = candidate.engine == BlurEngine::Cuda;
+        options.tiled = candidate.engine == BlurEngine::Tiled;
+        if ( options.tiled )
+        {
+            options.tiling.threads = candidate.threads;
+            options.tiling.tileSize = candidate.tileSize;
+            options.tiling.maxMemory = maxMemory;
+        }
+        candidate.milliseconds = timeCandidate(src, dst, sigma, filterSize, border, options);
+        LOG_DEBUG("Tuning " << image << ": " << engineName(candidate.engine) << ", " << candidate.threads <<
+            " threads, tile size " << candidate.tileSize << ": " << candidate.milliseconds << " ms");
+        if ( candidate.milliseconds >= 0.0 && ( best.milliseconds < 0.0 || candidate.milliseconds < best.milliseconds ) )
+        {
+            best = candidate;
+        }
+    }
+    if ( best.milliseconds < 0.0 )
+    {
+        throw std::runtime_error("tuneEngine(): no engine could blur a " + image + " sample");
+    }
+
+    std::ostringstream line;
+    line << host << "|" << image << "|" << engineName(best.engine) << "|" << best.threads << "|" << best.tileSize << "|" << best.milliseconds;
+    writeProfile(profilePath, others, line.str());
+    return best;
+}
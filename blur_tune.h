@@ -0,0 +1,52 @@
+/*
+*   blur_tune.h
+*   part of image blur software using CUDA
+*   for CSC 630 with Dr. Zhang
+*
+*   This header file contains the definitions for engine autotuning.
+*   The fastest engine, thread count and tile size depend on the host and on the kind of image,
+*   so they are measured instead of guessed: every candidate blurs a synthetic sample of the image
+*   class, and the winner is kept in a per-host tuning profile so later runs skip the measuring.
+*
+*   Profile lines (text, one per host and image class):
+*       <cpu model> x<hardware threads>|<image class>|<engine>|<threads>|<tile size>|<sample ms>
+*/
+
+#ifndef BLUR_TUNE_H
+#define BLUR_TUNE_H
+
+#include "blur_plan.h"
+#include <cstddef>
+#include <cstdint>
+#include <string>
+
+struct TuneChoice
+{
+    BlurEngine engine = BlurEngine::Sequential;
+    int threads = 1;
+    int tileSize = 0;           // tiled engine; 0 lets planTiles choose
+    double milliseconds = 0.0;  // median blur time of the sample
+    bool fromProfile = false;   // found in the profile, nothing was measured
+};
+
+//  What the profile is keyed by: "<cpu model> x<hardware threads>"
+std::string hostKey();
+
+//  Images that tune alike: pixel count rounded to a power of two, channels, filter size and border
+std::string imageClass( int64_t width , int64_t height , int channels , int filterSize , BorderMode border );
+
+//  ~/.cache/cuda-blur/tuning.profile, or ./.blur_tuning.profile without a home directory
+std::string defaultTuningProfilePath();
+
+/*
+*   Engine, threads and tile size for width x height x channels images: from the profile if this
+*   host has tuned the image class before, otherwise measured and then saved to the profile.
+*   At most maxThreads threads are tried; maxMemory (0 for none) bounds the tiled candidates.  The
+*   profile holds neither, so a profile choice is cut to maxThreads, and its tile size dropped (0)
+*   when that tile no longer fits maxMemory.
+*   An unwritable profile only means the next run tunes again.
+*/
+TuneChoice tuneEngine( int64_t width , int64_t height , int channels , double sigma , int filterSize ,
+                       BorderMode border , int maxThreads , size_t maxMemory , const std::string& profilePath );
+
+#endif
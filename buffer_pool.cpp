@@ -0,0 +1,286 @@
+/*
+*   buffer_pool.cpp
+*   part of image blur software using CUDA
+*   for CSC 630 with Dr. Zhang
+*
+*   This program implements the buffer pool and the per-thread scratch arenas.
+*/
+
+#include "buffer_pool.h"
+#include "utils.h"
+#include <algorithm>
+#include <cstdint>
+#include <cstdlib>
+#include <new>
+#include <sys/mman.h>
+
+#ifndef MAP_HUGE_SHIFT
+#define MAP_HUGE_SHIFT 26
+#endif
+#ifndef MAP_HUGE_2MB
+#define MAP_HUGE_2MB (21 << MAP_HUGE_SHIFT)
+#endif
+
+const size_t BufferPool::ALIGNMENT;
+const size_t BufferPool::HUGE_PAGE_THRESHOLD;
+const size_t ScratchArena::MINIMUM_CHUNK;
+
+//  Size class k holds buffers of 64 << k bytes
+static int sizeClass(size_t bytes)
+{
+    int k = 0;
+    while ( ((size_t)BufferPool::ALIGNMENT << k) < bytes )
+    {
+        k++;
+    }
+    return k;
+}
+
+static size_t classBytes(int k)
+{
+    return (size_t)BufferPool::ALIGNMENT << k;
+}
+
+/*
+*   Small buffers come from posix_memalign.  Large ones (whole size classes of 2MB and up) are
+*   mapped on their own so they start on a page boundary, can be given huge pages, and go back to
+*   the kernel with munmap; the size class says which way a buffer was made.
+*/
+static unsigned char *allocateBuffer(size_t bytes, HugePages mode, bool& huge)
+{
+    huge = false;
+    if ( bytes < BufferPool::HUGE_PAGE_THRESHOLD )
+    {
+        return alignedBytes(bytes, BufferPool::ALIGNMENT).release();
+    }
+
+#ifdef MAP_HUGETLB
+    if ( mode == HugePages::Explicit )
+    {
+        void *data = mmap(nullptr, bytes, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB | MAP_HUGE_2MB, -1, 0);
+        if ( data != MAP_FAILED )
+        {
+            huge = true;
+            return (unsigned char*)data;
+        }
+        //  No reserved huge pages free: fall back to transparent ones
+    }
+#endif
+    void *data = mmap(nullptr, bytes, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if ( data == MAP_FAILED )
+    {
+        throw std::bad_alloc();
+    }
+#ifdef MADV_HUGEPAGE
+    if ( mode != HugePages::Off )
+    {
+        huge = madvise(data, bytes, MADV_HUGEPAGE) == 0;
+    }
+#endif
+    return (unsigned char*)data;
+}
+
+static void freeBuffer(unsigned char *data, size_t bytes)
+{
+    if ( bytes < BufferPool::HUGE_PAGE_THRESHOLD )
+    {
+        std::free(data);
+    }
+    else
+    {
+        munmap(data, bytes);
+    }
+}
+
+bool adviseHugePages(void *data, size_t bytes)
+{
+#ifdef MADV_HUGEPAGE
+    if ( bufferPool().hugePages() == HugePages::Off )
+    {
+        return false;
+    }
+    const uintptr_t hugePage = BufferPool::HUGE_PAGE_THRESHOLD;
+    const uintptr_t begin = ((uintptr_t)data + hugePage - 1) / hugePage * hugePage;
+    const uintptr_t end = ((uintptr_t)data + bytes) / hugePage * hugePage;
+    return begin < end && madvise((void*)begin, end - begin, MADV_HUGEPAGE) == 0;
+#else
+    return false;
+#endif
+}
+
+PooledBuffer::PooledBuffer(PooledBuffer&& other)
+    : _data(other._data), _bytes(other._bytes), _sizeClass(other._sizeClass), _pool(other._pool)
+{
+    other._data = nullptr;
+    other._pool = nullptr;
+}
+
+PooledBuffer& PooledBuffer::operator=(PooledBuffer&& other)
+{
+    if ( this != &other )
+    {
+        reset();
+        _data = other._data;
+        _bytes = other._bytes;
+        _sizeClass = other._sizeClass;
+        _pool = other._pool;
+        other._data = nullptr;
+        other._pool = nullptr;
+    }
+    return *this;
+}
+
+void PooledBuffer::reset()
+{
+    if ( _data && _pool )
+    {
+        _pool->release(_data, _sizeClass);
+    }
+    _data = nullptr;
+    _pool = nullptr;
+    _bytes = 0;
+}
+
+BufferPool::~BufferPool()
+{
+    trim();
+}
+
+size_t BufferPool::classSize(size_t bytes)
+{
+    return classBytes(sizeClass(std::max<size_t>(bytes, 1)));
+}
+
+PooledBuffer BufferPool::acquire(size_t bytes)
+{
+    const int k = sizeClass(std::max<size_t>(bytes, 1));
+    if ( k >= SIZE_CLASSES )
+    {
+        throw std::bad_alloc();
+    }
+    {
+        std::lock_guard<std::mutex> lock(_mutex);
+        if ( !_free[k].empty() )
+        {
+            unsigned char *data = _free[k].back();
+            _free[k].pop_back();
+            _cachedBytes -= classBytes(k);
+            countReuse(classBytes(k));
+            return PooledBuffer(data, classBytes(k), k, this);
+        }
+    }
+
+    bool huge;
+    unsigned char *data = allocateBuffer(classBytes(k), _hugePages, huge);
+    _heapAllocations++;
+    _heapBytes += classBytes(k);
+    if ( huge )
+    {
+        _hugePageBytes += classBytes(k);
+    }
+    return PooledBuffer(data, classBytes(k), k, this);
+}
+
+void BufferPool::release(unsigned char *data, int sizeClass)
+{
+    {
+        std::lock_guard<std::mutex> lock(_mutex);
+        if ( _cachedBytes + classBytes(sizeClass) <= _cacheLimit )
+        {
+            //  Free lists only grow while the working set does, so steady state doesn't allocate here
+            _free[sizeClass].push_back(data);
+            _cachedBytes += classBytes(sizeClass);
+            return;
+        }
+    }
+    freeBuffer(data, classBytes(sizeClass));
+}
+
+void BufferPool::trim()
+{
+    std::lock_guard<std::mutex> lock(_mutex);
+    for (int k = 0; k < SIZE_CLASSES; k++)
+    {
+        for (unsigned char *data : _free[k])
+        {
+            freeBuffer(data, classBytes(k));
+        }
+        _free[k].clear();
+    }
+    _cachedBytes = 0;
+}
+
+void BufferPool::setCacheLimit(size_t bytes)
+{
+    std::lock_guard<std::mutex> lock(_mutex);
+    _cacheLimit = bytes;
+}
+
+PoolCounters BufferPool::counters() const
+{
+    PoolCounters counters;
+    counters.heapAllocations = _heapAllocations;
+    counters.heapBytes = _heapBytes;
+    counters.reusedAllocations = _reusedAllocations;
+    counters.reusedBytes = _reusedBytes;
+    counters.hugePageBytes = _hugePageBytes;
+    std::lock_guard<std::mutex> lock(_mutex);
+    counters.cachedBytes = _cachedBytes;
+    return counters;
+}
+
+void BufferPool::countReuse(size_t bytes)
+{
+    _reusedAllocations++;
+    _reusedBytes += bytes;
+}
+
+BufferPool& bufferPool()
+{
+    //  Never destroyed, so buffers released by other static or thread-local destructors still have a home
+    static BufferPool *pool = new BufferPool();
+    return *pool;
+}
+
+/*
+*   Chunks are used in order.  When the current chunk can't fit a request the arena moves to the
+*   next one, acquiring a chunk big enough if it has none; after a rewind the same chunks serve
+*   the same sequence of requests again.
+*/
+unsigned char *ScratchArena::allocate(size_t bytes)
+{
+    bytes = (bytes + BufferPool::ALIGNMENT - 1) / BufferPool::ALIGNMENT * BufferPool::ALIGNMENT;
+    while ( _chunk < _chunks.size() )
+    {
+        if ( _offset + bytes <= _chunks[_chunk].size() )
+        {
+            unsigned char *data = _chunks[_chunk].data() + _offset;
+            _offset += bytes;
+            _pool.countReuse(bytes);
+            return data;
+        }
+        _chunk++;
+        _offset = 0;
+    }
+
+    _chunks.push_back(_pool.acquire(std::max(bytes, MINIMUM_CHUNK)));
+    _chunk = _chunks.size() - 1;
+    _offset = bytes;
+    return _chunks.back().data();
+}
+
+size_t ScratchArena::capacity() const
+{
+    size_t bytes = 0;
+    for (auto& chunk : _chunks)
+    {
+        bytes += chunk.size();
+    }
+    return bytes;
+}
+
+ScratchArena& threadArena()
+{
+    static thread_local ScratchArena arena(bufferPool());
+    return arena;
+}
@@ -0,0 +1,180 @@
+/*
+*   buffer_pool.h
+*   part of image blur software using CUDA
+*   for CSC 630 with Dr. Zhang
+*
+*   This header file contains the definitions for the buffer pool and the scratch arenas.
+*   Batch workloads blur the same shapes over and over, so buffers are recycled instead of going
+*   back to the heap:
+*       BufferPool      process-wide, thread-safe free lists of 64-byte aligned buffers in
+*                       power-of-two size classes; a PooledBuffer returns itself when destroyed
+*       ScratchArena    one per thread, hands out short-lived scratch (filters, tile buffers) from
+*                       chunks it keeps, rewound by an ArenaScope when the blur call returns
+*   Once a workload has run for a while every request is served from memory already held, and
+*   the counters show it.
+*   Large buffers can be backed by 2MB huge pages, so a blur sweeping a big image or tile block
+*   takes one TLB entry per 2MB instead of per 4KB.
+*/
+
+#ifndef BUFFER_POOL_H
+#define BUFFER_POOL_H
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <mutex>
+#include <vector>
+
+class BufferPool;
+
+//  How buffers of BufferPool::HUGE_PAGE_THRESHOLD bytes or more are backed:
+//      Off          ordinary pages
+//      Transparent  madvise(MADV_HUGEPAGE): the kernel uses huge pages when it has them (THP)
+//      Explicit     MAP_HUGETLB from the pages reserved in vm.nr_hugepages; Transparent if none are free
+enum class HugePages { Off, Transparent, Explicit };
+
+//  A pool buffer, given back to the pool on destruction.  Move-only.
+class PooledBuffer
+{
+public:
+    PooledBuffer() : _data(nullptr), _bytes(0), _sizeClass(0), _pool(nullptr) {}
+    ~PooledBuffer() { reset(); }
+    PooledBuffer(PooledBuffer&& other);
+    PooledBuffer& operator=(PooledBuffer&& other);
+    PooledBuffer(const PooledBuffer&) = delete;
+    PooledBuffer& operator=(const PooledBuffer&) = delete;
+
+    unsigned char *data() const { return _data; }
+    size_t size() const { return _bytes; }      // capacity of the size class, at least what was asked for
+
+    //  Give the buffer back now
+    void reset();
+
+private:
+    friend class BufferPool;
+
+    PooledBuffer(unsigned char *data, size_t bytes, int sizeClass, BufferPool *pool)
+        : _data(data), _bytes(bytes), _sizeClass(sizeClass), _pool(pool) {}
+
+    unsigned char *_data;
+    size_t _bytes;
+    int _sizeClass;
+    BufferPool *_pool;
+};
+
+//  What the pool (and the arenas drawing from it) did since the process started
+struct PoolCounters
+{
+    uint64_t heapAllocations;       // buffers that had to come from the heap
+    uint64_t heapBytes;
+    uint64_t reusedAllocations;     // requests served from memory already held: heap allocations avoided
+    uint64_t reusedBytes;
+    uint64_t cachedBytes;           // held in the free lists right now
+    uint64_t hugePageBytes;         // allocated with huge pages granted (MAP_HUGETLB) or advised (THP)
+};
+
+class BufferPool
+{
+public:
+    //  Buffers are 64-byte aligned; sizes are rounded up to a power of two, 64 bytes at least
+    static const size_t ALIGNMENT = 64;
+
+    //  Buffers this large are mapped on their own, page aligned, and may use huge pages
+    static const size_t HUGE_PAGE_THRESHOLD = (size_t)2 << 20;
+
+    BufferPool() {}
+    ~BufferPool();
+    BufferPool(const BufferPool&) = delete;
+    BufferPool& operator=(const BufferPool&) = delete;
+
+    //  A buffer of at least `bytes` bytes; contents are undefined
+    PooledBuffer acquire(size_t bytes);
+
+    //  Bytes acquire(bytes) takes: its power-of-two size class
+    static size_t classSize(size_t bytes);
+
+    //  Free every cached buffer
+    void trim();
+
+    //  Keep at most this many bytes in the free lists; beyond it released buffers go back to the heap
+    void setCacheLimit(size_t bytes);
+
+    //  Backing of large buffers allocated from now on; buffers already held keep theirs
+    void setHugePages(HugePages mode) { _hugePages = mode; }
+    HugePages hugePages() const { return _hugePages; }
+
+    PoolCounters counters() const;
+
+    //  Count a request served without touching the pool, e.g. from an arena chunk
+    void countReuse(size_t bytes);
+
+private:
+    friend class PooledBuffer;
+    void release(unsigned char *data, int sizeClass);
+
+    static const int SIZE_CLASSES = 48;
+    mutable std::mutex _mutex;
+    std::vector<unsigned char*> _free[SIZE_CLASSES];
+    size_t _cachedBytes = 0;
+    size_t _cacheLimit = (size_t)1 << 30;
+    std::atomic<HugePages> _hugePages{HugePages::Off};
+    std::atomic<uint64_t> _heapAllocations{0}, _heapBytes{0}, _reusedAllocations{0}, _reusedBytes{0}, _hugePageBytes{0};
+};
+
+//  The process-wide pool
+BufferPool& bufferPool();
+
+//  Ask for huge pages on memory not yet touched, e.g. a freshly allocated output image, under the
+//  pool's setting; only whole 2MB pages inside the range are affected.  False if nothing was advised.
+bool adviseHugePages(void *data, size_t bytes);
+
+/*
+*   Bump allocator over pool chunks.  allocate() is a pointer increment; rewind() gives back
+*   everything allocated since a mark, and the chunks stay with the arena for the next call.
+*/
+class ScratchArena
+{
+public:
+    struct Mark { size_t chunk, offset; };
+
+    explicit ScratchArena(BufferPool& pool) : _pool(pool), _chunk(0), _offset(0) {}
+    ScratchArena(const ScratchArena&) = delete;
+    ScratchArena& operator=(const ScratchArena&) = delete;
+
+    //  `bytes` bytes aligned to BufferPool::ALIGNMENT, valid until rewound past
+    unsigned char *allocate(size_t bytes);
+
+    template <typename T>
+    T *allocate(size_t count) { return reinterpret_cast<T*>(allocate(sizeof(T) * count)); }
+
+    Mark mark() const { return Mark{ _chunk, _offset }; }
+    void rewind(const Mark& mark) { _chunk = mark.chunk; _offset = mark.offset; }
+
+    //  Bytes held in chunks
+    size_t capacity() const;
+
+private:
+    static const size_t MINIMUM_CHUNK = (size_t)1 << 20;
+    BufferPool& _pool;
+    std::vector<PooledBuffer> _chunks;
+    size_t _chunk, _offset;
+};
+
+//  The calling thread's arena
+ScratchArena& threadArena();
+
+//  Rewinds an arena to where it was when the scope was entered
+class ArenaScope
+{
+public:
+    explicit ArenaScope(ScratchArena& arena) : _arena(arena), _mark(arena.mark()) {}
+    ~ArenaScope() { _arena.rewind(_mark); }
+    ArenaScope(const ArenaScope&) = delete;
+    ArenaScope& operator=(const ArenaScope&) = delete;
+
+private:
+    ScratchArena& _arena;
+    ScratchArena::Mark _mark;
+};
+
+#endif
@@ -11,16 +11,47 @@
 #define cimg_display 0
 #include "CImg.h" 
 #include "cimg_utils.h"
+#include "blur_plan.h"
+#include "buffer_pool.h"
+#include "stage_timings.h"
 #include <iostream> 
 #include <stdlib.h>
+#include <algorithm>
 #include <vector>
 #include <cmath>
-#include <chrono>
+#include <cstring>
+#include <stdexcept>
 
 namespace cl=cimg_library;
  
+//  Views of a CImg's pixels; CImg keeps its planes packed
+ImageView imageView( cl::CImg<unsigned char>& image )
+{
+    return packedImageView(image.data(), image.width(), image.height(), image.spectrum());
+}
+
+ConstImageView imageView( const cl::CImg<unsigned char>& image )
+{
+    return ConstImageView(image.data(), image.width(), image.height(), image.spectrum(),
+                          image.width(), (size_t)image.width() * image.height());
+}
+
+//  Blur between views, on the engine the params ask for, through a one-off plan
+void blur_into( const ImageView& dst , const ConstImageView& src , const BlurParams& params )
+{
+    if ( dst.width != src.width || dst.height != src.height || dst.channels != src.channels )
+    {
+        throw std::invalid_argument("blur_into(): source and destination dimensions differ");
+    }
+    BlurPlanOptions options;
+    options.filterSize = params.filterSize;
+    options.cuda = params.cuda;
+    BlurPlan plan = make_blur_plan(src.width, src.height, src.channels, PixelType::UInt8, params.sigma, params.border, options);
+    execute(plan, src, dst);
+}
+
 //  Blur
-cl::CImg<unsigned char> blur( cl::CImg<unsigned char> image , int filterSize , bool cudaFlag )
+cl::CImg<unsigned char> blur( const cl::CImg<unsigned char>& image , int filterSize , bool cudaFlag , double sigma )
 { 
     /*
     cimg_forX(image,x) 
@@ -30,77 +61,142 @@ cl::CImg<unsigned char> blur( cl::CImg<unsigned char> image , int filterSize , b
     */
     if (cudaFlag)
     {
-        //  Placeholding until cuda function finished
-        return blur_cuda(image, filterSize);
+        return blur_cuda(image, filterSize, sigma);
     }
     else
     {
-        return blur_sequential(image, filterSize);
+        return blur_sequential(image, filterSize, sigma);
     }
 }
 
-//  Sequential blur
-cl::CImg<unsigned char> blur_sequential( cl::CImg<unsigned char> image , int filterSize )
+//  Cuda blur into a new image
+cl::CImg<unsigned char> blur_cuda( const cl::CImg<unsigned char>& image , int filterSize , double sigma )
 {
-    //  Had to ditch vector of vectors, as they apparently can't be sent to cuda
-    //std::vector<std::vector<float>> filter = getFilter(filterSize);
-
-    //  Create filter 2D array
-    float **filter = new float*[2*filterSize + 1];
-
-    getFilter(filter, filterSize);
+    cl::CImg<unsigned char> blurred(image.width(), image.height(), 1, image.spectrum());
+    blur_cuda_into(imageView(blurred), imageView(image), filterSize, sigma);
+    return blurred;
+}
 
-    printFilter(filter, filterSize);
+//  Sequential blur into a new image
+cl::CImg<unsigned char> blur_sequential( const cl::CImg<unsigned char>& image , int filterSize , double sigma )
+{
+    //  Neighbours are read from the untouched original, so the output is a separate image
+    cl::CImg<unsigned char> blurred(image.width(), image.height(), 1, image.spectrum());
+    blur_sequential_into(imageView(blurred), imageView(image), filterSize, sigma);
+    return blurred;
+}
 
+//  Blur the interior of one channel plane; strides are in pixels
+void blur_plane( const unsigned char *src , size_t srcStride , unsigned char *dst , size_t dstStride ,
+                 int64_t width , int64_t height , const float *filter , int filterSize )
+{
+    const int filterWidth = 2*filterSize + 1;
+    //  Loop rows; 64-bit so row * stride can't overflow on very large planes
+    for (int64_t row = filterSize; row < (height-filterSize); row++)
+    {
+        //  Loop cols
+        for (int64_t col = filterSize; col < (width-filterSize); col++)
+        {
+            float pixelValue=0.0;
+            //  Loop filter rows
+            for (int64_t frow = row - filterSize; frow <= row + filterSize; frow++)
+            {
+                //  Loop filter cols
+                for (int64_t fcol = col - filterSize; fcol <= col + filterSize; fcol++)
+                {
+                    //  vector row and column index
+                    int vrow = (int)(frow - row + filterSize);
+                    int vcol = (int)(fcol - col + filterSize);
+                    pixelValue += ( src[frow*srcStride + fcol] * filter[vrow*filterWidth + vcol] );
+                }
+            }
 
-    //  Only the blurring operation should be timed
-    std::chrono::steady_clock::time_point begin = std::chrono::steady_clock::now();
+            dst[row*dstStride + col] = pixelValue;
+        }
+    }
+}
 
+//  Index i moved back inside 0 .. n-1
+static int64_t borderIndex( int64_t i , int64_t n , BorderMode border )
+{
+    if ( border == BorderMode::Clamp || n == 1 )
+    {
+        return std::min(std::max<int64_t>(i, 0), n - 1);
+    }
+    while ( i < 0 || i >= n )
+    {
+        i = i < 0 ? -i : 2*(n - 1) - i;
+    }
+    return i;
+}
 
-    //  Loop over image channels
-    cimg_forC(image, c)
+//  Blur the border of one channel plane, reaching outside the image through borderIndex()
+void blur_border( const unsigned char *src , size_t srcStride , unsigned char *dst , size_t dstStride ,
+                  int64_t width , int64_t height , const float *filter , int filterSize , BorderMode border )
+{
+    const int filterWidth = 2*filterSize + 1;
+    if ( border == BorderMode::Keep )
+    {
+        return;
+    }
+    for (int64_t row = 0; row < height; row++)
     {
-        //  Loop rows
-        for (int row = filterSize; row < (image.height()-filterSize); row++)
+        //  Interior rows only have a border at either end
+        const bool borderRow = row < filterSize || row >= height - filterSize;
+        for (int64_t col = 0; col < width; col++)
         {
-            //  Loop cols
-            for (int col = filterSize; col < (image.width()-filterSize); col++)
+            if ( !borderRow && col == filterSize && width - filterSize > filterSize )
+            {
+                col = width - filterSize;
+            }
+            float pixelValue=0.0;
+            for (int vrow = 0; vrow <= 2*filterSize; vrow++)
             {
-                float pixelValue=0.0;
-                //  Loop filter rows
-                for (int frow = row - filterSize; frow <= row + filterSize; frow++)
+                const unsigned char *source = src + borderIndex(row - filterSize + vrow, height, border)*srcStride;
+                for (int vcol = 0; vcol <= 2*filterSize; vcol++)
                 {
-                    //  Loop filter cols
-                    for (int fcol = col - filterSize; fcol <= col + filterSize; fcol++)
-                    {
-                        //  vector row and column index
-                        int vrow = frow - row + filterSize;
-                        int vcol = fcol - col + filterSize;
-                        pixelValue += ( image(fcol, frow, 0, c) * filter[vrow][vcol] );
-                    }
+                    pixelValue += ( source[borderIndex(col - filterSize + vcol, width, border)] * filter[vrow*filterWidth + vcol] );
                 }
-
-                image(col, row, 0, c) = pixelValue;
             }
+            dst[row*dstStride + col] = pixelValue;
         }
     }
+}
 
+//  Sequential blur between caller-owned buffers, e.g. memory-mapped files
+void blur_sequential_into( const ImageView& dst , const ConstImageView& src , int filterSize , double sigma )
+{
+    //  The filter comes from this thread's arena, so repeated calls don't allocate
+    ScratchArena& arena = threadArena();
+    ArenaScope scope(arena);
+    float *filter = arena.allocate<float>((size_t)(2*filterSize + 1) * (2*filterSize + 1));
+    {
+        StageTimer timer("kernel");
+        getFilter(filterSize, sigma, filter);
+    }
 
-    std::chrono::steady_clock::time_point end = std::chrono::steady_clock::now();
-
-    std::cout << "=========\nBlur time: " <<
-        std::to_string( std::chrono::duration_cast<std::chrono::microseconds>(end - begin).count() ) << "[µs], or " <<
-        std::to_string( std::chrono::duration_cast<std::chrono::nanoseconds>(end - begin).count() ) << "[ns]" << std::endl;
-
-
-    return image;
+    for (int c = 0; c < src.channels; c++)
+    {
+        //  The border is left as it was, so start from a copy of the source
+        {
+            StageTimer timer("copy", c);
+            for (int64_t row = 0; row < src.height; row++)
+            {
+                std::memcpy(dst.row(c, row), src.row(c, row), src.width);
+            }
+        }
+        StageTimer timer("convolution", c);
+        blur_plane(src.row(c, 0), src.rowStride, dst.row(c, 0), dst.rowStride, src.width, src.height, filter, filterSize);
+    }
 }
 
 /*      -getFilter-
 Create gaussian filter with formula from sources below.
-filter is a pointer to a 2d array of floats, 
-    the first dimension of which has already been initilized dynamically.
-This approach replaced the 2d vector approach, as 2d vectors can't cuda!
+The filter is returned as one block of (2*filterSize+1)^2 floats, row after row, which the CPU
+loops index directly and CUDA takes with a single copy.  Each call builds its own, so there is
+no shared state between concurrent blurs; the pointer overload fills memory the caller already
+has, such as a plan's pool buffer or an arena block.
+sigma is the standard deviation of the gaussian in pixels.
 
 Information on gaussian filter from:
 Obtained through http://dev.theomader.com/gaussian-kernel-calculator/
@@ -118,16 +214,18 @@ Example size 2 filter:
 0.015019,  0.059912,   0.094907,   0.059912,   0.015019
 0.003765,  0.015019,   0.023792,   0.015019,   0.003765
 */
-void getFilter(float **filter, int filterSize)
+std::vector<float> getFilter(int filterSize, double sigma)
 {
-    //  Initialize second dimension of float 2d array
-    for (int row=0; row<2*filterSize + 1; row++)
-    {
-        filter[row] = new float[2*filterSize + 1];
-    }
+    std::vector<float> filter((size_t)(2*filterSize + 1) * (2*filterSize + 1));
+    getFilter(filterSize, sigma, filter.data());
+    return filter;
+}
+
+void getFilter(int filterSize, double sigma, float *filter)
+{
+    const int filterWidth = 2*filterSize + 1;
+    const size_t weights = (size_t)filterWidth * filterWidth;
 
-    //  Initilize standard deviation to 1.0
-    double sigma = 1.0;
     double r, s = 2.0 * sigma * sigma;
 
     //  Sum for normalization
@@ -139,18 +237,15 @@ void getFilter(float **filter, int filterSize)
         for (int col = -filterSize; col <= filterSize; col++)
         {
             r = sqrt( row * row + col * col );
-            filter[row + filterSize][col + filterSize] = (exp(-(r * r) / s)) / (M_PI * s); 
-            sum += filter[row + filterSize][col + filterSize];
+            filter[(row + filterSize)*filterWidth + col + filterSize] = (exp(-(r * r) / s)) / (M_PI * s); 
+            sum += filter[(row + filterSize)*filterWidth + col + filterSize];
         }
     }
 
     //  Normalize kernel
-    for (int row = 0; row < 2*filterSize + 1; row++)
+    for (size_t i = 0; i < weights; i++)
     {
-        for (int col = 0; col < 2*filterSize + 1; col++)
-        {
-            filter[row][col] /= sum;
-        }
+        filter[i] /= sum;
     }
 }
 
@@ -220,22 +315,21 @@ std::vector<std::vector<float>> getFilter(int filterSize)
         break;
 */
         default:
-            std::cerr << "filter() ERROR: can't handle size " << filterSize << std::endl;
-            exit (EXIT_FAILURE);
+            throw std::invalid_argument("getFilter(): can't handle size " + std::to_string(filterSize));
         break;
     }
 }
 
 //  Print Filter
-void printFilter(float **filter, int filterSize)
+void printFilter(const std::vector<float>& filter, int filterSize, std::ostream& out)
 {
     for (int row=0; row<2*filterSize + 1; row++)
     {
         for (int col=0; col<2*filterSize + 1; col++)
         {
-            std::cout << filter[row][col] << ", ";
+            out << filter[row*(2*filterSize + 1) + col] << ", ";
         }
-        std::cout << std::endl;
+        out << std::endl;
     }
 }
 
@@ -7,27 +7,88 @@
 *   This program contains CImg-manipulating function definitions for the image blur software
 */
 
+#ifndef CIMG_UTILS_H
+#define CIMG_UTILS_H
+
 #define cimg_OS 1
 #define cimg_display 0
 #include "CImg.h" 
+#include "image_view.h"
+#include <cstdint>
 #include <iostream> 
+#include <memory>
+#include <string>
 #include <vector>
 
 namespace cl=cimg_library;
+
+//  What happens within filterSize of the image edge, where the filter would reach outside:
+//      Keep    the pixels are copied from the source unblurred (the original behaviour)
+//      Clamp   the edge pixels are repeated outwards
+//      Mirror  the image is reflected about its edge pixels
+enum class BorderMode { Keep, Clamp, Mirror };
+
+//  What to blur with
+struct BlurParams
+{
+    int filterSize = 1;         // 1 for 3x3, 2 for 5x5, ...
+    double sigma = 1.0;         // gaussian standard deviation in pixels
+    bool cuda = false;          // run on the GPU instead of the CPU
+    BorderMode border = BorderMode::Keep;
+};
+
+//  Views of a CImg's pixels
+ImageView imageView( cl::CImg<unsigned char>& image );
+ConstImageView imageView( const cl::CImg<unsigned char>& image );
+
+//  Blur src into dst, which must have the same dimensions and must not overlap src.
+//  Neither image is copied; the filterSize-wide border of dst is copied from src.
+void blur_into( const ImageView& dst , const ConstImageView& src , const BlurParams& params );
  
-//  Blur original image
-cl::CImg<unsigned char> blur( cl::CImg<unsigned char> image , int filterSize , bool cudaFlag );
+//  Blur original image into a new image
+cl::CImg<unsigned char> blur( const cl::CImg<unsigned char>& image , int filterSize , bool cudaFlag , double sigma = 1.0 );
 
 //  Blur original image sequentially
-cl::CImg<unsigned char> blur_sequential( cl::CImg<unsigned char> image , int filterSize );
+cl::CImg<unsigned char> blur_sequential( const cl::CImg<unsigned char>& image , int filterSize , double sigma = 1.0 );
+
+//  Sequential blur between views
+void blur_sequential_into( const ImageView& dst , const ConstImageView& src , int filterSize , double sigma );
+
+//  Blur the interior of one channel plane (the filterSize-wide border is not written); strides are in pixels
+void blur_plane( const unsigned char *src , size_t srcStride , unsigned char *dst , size_t dstStride ,
+                 int64_t width , int64_t height , const float *filter , int filterSize );
+
+//  Blur the filterSize-wide border of one channel plane under a border mode (Keep writes nothing)
+void blur_border( const unsigned char *src , size_t srcStride , unsigned char *dst , size_t dstStride ,
+                  int64_t width , int64_t height , const float *filter , int filterSize , BorderMode border );
 
 //  Blur original image with cuda
-cl::CImg<unsigned char> blur_cuda( cl::CImg<unsigned char> image , int filterSize );
+cl::CImg<unsigned char> blur_cuda( const cl::CImg<unsigned char>& image , int filterSize , double sigma = 1.0 );
+
+//  CUDA blur between views; each plane is copied to the device and back once
+void blur_cuda_into( const ImageView& dst , const ConstImageView& src , int filterSize , double sigma );
+
+//  Device side of a CUDA blur: one plane in, one plane out and the uploaded filter, freed by the deleter
+struct CudaBuffers;
+struct CudaBuffersDeleter
+{
+    void operator()( CudaBuffers *buffers ) const;
+};
+typedef std::unique_ptr<CudaBuffers, CudaBuffersDeleter> CudaBuffersPtr;
 
-//  Filter based on filterSize
+//  Allocate the device planes for width x height images and upload the (2*filterSize+1)^2 filter weights
+CudaBuffersPtr make_cuda_buffers( int64_t width , int64_t height , const float *filter , int filterSize );
+
+//  CUDA blur between views through buffers made for their shape; nothing is allocated or uploaded but the pixels
+void blur_cuda_into( const ImageView& dst , const ConstImageView& src , int filterSize , CudaBuffers& buffers );
+
+//  Filter based on filterSize and gaussian standard deviation
 std::vector<std::vector<float>> getFilter(int filterSize);
-void getFilter(float **filter, int filterSize);
+std::vector<float> getFilter(int filterSize, double sigma);
+void getFilter(int filterSize, double sigma, float *filter);     // into (2*filterSize+1)^2 floats of the caller's
 
 //  Print filter
 void printFilter(std::vector<std::vector<float>> filter);
-void printFilter(float **filter, int filterSize);
+void printFilter(const std::vector<float>& filter, int filterSize, std::ostream& out = std::cout);
+
+#endif
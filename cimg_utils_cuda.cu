@@ -11,27 +11,54 @@
 #define cimg_display 0
 #include "CImg.h" 
 #include "cimg_utils.h"
+#include "buffer_pool.h"
+#include "stage_timings.h"
+#include <algorithm>
+#include <cstdint>
 #include <iostream> 
 #include <stdlib.h>
+#include <stdexcept>
+#include <string>
 #include <vector>
-#include <chrono>
 
 namespace cl=cimg_library;
+
+//  Largest grid of any CUDA device, in blocks
+static const int64_t MAXIMUM_GRID_X = 2147483647;
+static const int64_t MAXIMUM_GRID_Y = 65535;
  
 /*
 *           CUDA FUNCTIONS
 */
 
+//  CUDA errors are thrown, never printed or exited on, so a library caller decides what to do
 #define gpuErrchk(ans) { gpuAssert((ans), __FILE__, __LINE__); }
-inline void gpuAssert(cudaError_t code, const char *file, int line, bool abort=true)
+inline void gpuAssert(cudaError_t code, const char *file, int line)
 {
    if (code != cudaSuccess) 
    {
-      fprintf(stderr,"GPUassert: %s %s %d\n", cudaGetErrorString(code), file, line);
-      if (abort) exit(code);
+      throw std::runtime_error(std::string("GPUassert: ") + cudaGetErrorString(code) + " " + file + " " + std::to_string(line));
    }
 }
 
+//  Device allocation freed when it goes out of scope, also when a CUDA call throws
+template <typename T>
+struct DeviceBuffer
+{
+    T *data = nullptr;
+
+    explicit DeviceBuffer(size_t count)
+    {
+        gpuErrchk( cudaMalloc((void**)&data, sizeof(T) * count) );
+    }
+    ~DeviceBuffer()
+    {
+        cudaFree(data);
+    }
+    DeviceBuffer(const DeviceBuffer&) = delete;
+    DeviceBuffer& operator=(const DeviceBuffer&) = delete;
+};
+
 /*
 *   Split the channels apart.
 *   uchar4 is a built-in vector struct with special allignment:
@@ -63,33 +90,41 @@ void split_channels(const uchar4* const image, int rows, int cols,
 /*
 *   Blur
 */
+//  Grid-stride loops: each thread blurs every pixel a grid's width and height apart, so a grid
+//  capped at the device's limits still covers any image
 __global__
 void apply_blur_cuda(const unsigned char* const input, unsigned char* const output,
-                   int rows, int cols, const float* const filter, const int filterSize)
+                   int64_t rows, int64_t cols, const float* const filter, const int filterSize)
 {
-    
-    int col = blockIdx.x * blockDim.x + threadIdx.x;
-    int row = blockIdx.y * blockDim.y + threadIdx.y;
-    //  Set bounds for blur filter (no padding)
-    if (col >= cols - filterSize || row >= rows - filterSize || col < filterSize || row < filterSize) 
-    {
-        return;
-    }
-    int index = row * cols + col;
-    
-    float sum = 0.0;
-
-    for (int frow = row - filterSize; frow <= row + filterSize; frow++)
+    const int64_t rowStep = (int64_t)blockDim.y * gridDim.y;
+    const int64_t colStep = (int64_t)blockDim.x * gridDim.x;
+    for (int64_t row = (int64_t)blockIdx.y * blockDim.y + threadIdx.y; row < rows; row += rowStep)
     {
-        for (int fcol = col - filterSize; fcol <= col + filterSize; fcol++)
+        for (int64_t col = (int64_t)blockIdx.x * blockDim.x + threadIdx.x; col < cols; col += colStep)
         {
-            //  vector row and column index
-            int vrow = frow - row + filterSize;
-            int vcol = fcol - col + filterSize;
-            sum += filter[vrow*filterSize+vcol] * input[frow*cols+fcol];
+            //  Set bounds for blur filter (no padding)
+            if (col >= cols - filterSize || row >= rows - filterSize || col < filterSize || row < filterSize) 
+            {
+                continue;
+            }
+            //  64-bit offsets: a plane of more than 2^31 pixels would overflow row * cols in int
+            size_t index = (size_t)row * cols + col;
+
+            float sum = 0.0;
+
+            for (int64_t frow = row - filterSize; frow <= row + filterSize; frow++)
+            {
+                for (int64_t fcol = col - filterSize; fcol <= col + filterSize; fcol++)
+                {
+                    //  vector row and column index
+                    int vrow = (int)(frow - row + filterSize);
+                    int vcol = (int)(fcol - col + filterSize);
+                    sum += filter[vrow*(2*filterSize+1)+vcol] * input[(size_t)frow*cols+fcol];
+                }
+            }
+            output[index] = (unsigned char)sum;
         }
     }
-    output[index] = (unsigned char)sum;
 }
 
 /*
@@ -125,172 +160,98 @@ void merge_channels(const unsigned char* const c_red,
 *       END CUDA KERNELS ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
 */
 
-//  Cuda blur
-cl::CImg<unsigned char> blur_cuda( cl::CImg<unsigned char> image , int filterSize )
+//  A plan's device planes and filter, allocated once and reused by every blur through it
+struct CudaBuffers
 {
-    //  Create filter 2D array
-    float **filter = new float*[2*filterSize + 1];
-    getFilter(filter, filterSize);
-    printFilter(filter, filterSize);
-
-    //  Set block size (number of threads per block), then grid size (number of blocks per kernel)
-    const dim3 block_size(16,16,1);
-    const dim3 grid_size(image.width()/block_size.x+1, image.height()/block_size.y+1,1);
-
-    //  Variables to hold information on cuda memory
-    unsigned char *cuda_red, *cuda_green, *cuda_blue;
-    float *cuda_filter;
-    /*  A NOTE ABOUT *ptr = CImg.data():
-    'T *ptr = img.data()' gives you the pointer to the first value of the image 'img'. 
-    The overall size of the used memory for one instance image (in bytes) is then 'width*height*depth*dim*sizeof(T)'.
-    Now, the ordering of the pixel values in this buffer follows these rules : 
-        The values are not interleaved, and are ordered first along the X,Y,Z and V axis respectively 
-        (corresponding to the width,height,depth,dim dimensions), 
-        starting from the upper-left pixel to the bottom-right pixel of the instane image, with a classical scanline run.
-        So, a color image with dim=3 and depth=1, will be stored in memory as :R1R2R3R4R5R6......G1G2G3G4G5G6.......B1B2B3B4B5B6.... 
-        (i.e following a 'planar' structure)and not as R1G1B1R2G2B2R3G3B3... (interleaved channels).
-    */
-    //unsigned char *cuda_image = image.data();
-    //unsigned char *cuda_image;
-
-    //  Declare GPU memory pointers
-    unsigned char *cuda_red_blurred, *cuda_green_blurred, *cuda_blue_blurred;//, *cuda_image_blurred;
-
-    //  Allocate memory to cuda
-    int channel_size = image.get_channel(0).size();
-    std::cout << "Channel size: " << channel_size << std::endl;
-
-    gpuErrchk( cudaMalloc((void**)&cuda_red, sizeof(unsigned char) * channel_size) );
-    gpuErrchk( cudaMalloc((void**)&cuda_red_blurred, sizeof(unsigned char) * channel_size) );
-    gpuErrchk( cudaMalloc((void**)&cuda_green, sizeof(unsigned char) * channel_size) );
-    gpuErrchk( cudaMalloc((void**)&cuda_green_blurred, sizeof(unsigned char) * channel_size) );
-    gpuErrchk( cudaMalloc((void**)&cuda_blue, sizeof(unsigned char) * channel_size) );
-    gpuErrchk( cudaMalloc((void**)&cuda_blue_blurred, sizeof(unsigned char) * channel_size) );
-    gpuErrchk( cudaMalloc((void**)&cuda_filter, sizeof(float) * (2*filterSize+1) * (2*filterSize+1)) );
-    //gpuErrchk( cudaMalloc((void**)&cuda_image, sizeof(uchar4) * image.size()) );
-    //gpuErrchk( cudaMalloc((void**)&cuda_image_blurred, sizeof(uchar4) * image.size()) );
-    //gpuErrchk( cudaMalloc((void**)&cuda_image, sizeof(unsigned char) * image.size()) );
-    //gpuErrchk( cudaMalloc((void**)&cuda_image_blurred, sizeof(unsigned char) * image.size()) );
-
-    //  Transfer image and filter to GPU
-    //gpuErrchk( cudaMemcpy(cuda_image, image.data(), sizeof(uchar4) * image.size(), cudaMemcpyHostToDevice) );
-    //gpuErrchk( cudaMemcpy(cuda_image, image.data(), sizeof(unsigned char) * image.size(), cudaMemcpyHostToDevice) );
-    gpuErrchk( cudaMemcpy(cuda_filter, &(filter[0][0]), sizeof(float) * (2*filterSize+1) * (2*filterSize+1), cudaMemcpyHostToDevice) );
-    //gpuErrchk( cudaMemcpy(cuda_red, cuda_red, sizeof(unsigned char) * image.height() * image.width(), cudaMemcpyHostToDevice) );
-    //gpuErrchk( cudaMemcpy(cuda_green, cuda_green, sizeof(unsigned char) * image.height() * image.width(), cudaMemcpyHostToDevice) );
-    //gpuErrchk( cudaMemcpy(cuda_blue, cuda_blue, sizeof(unsigned char) * image.height() * image.width(), cudaMemcpyHostToDevice) );
-
-/*  Kept getting segmentation faults on merge_channels
-    //  Split channels
-    split_channels<<<grid_size, block_size>>> (reinterpret_cast<uchar4*>(cuda_image),
-                                                image.height(), 
-                                                image.width(), 
-                                                cuda_red, 
-                                                cuda_green, 
-                                                cuda_blue);
-*/
-
-/*
-    unsigned char cpu_red = new unsigned char [channel_size];
-    unsigned char cpu_green = new unsigned char [channel_size];
-    unsigned char cpu_blue = new unsigned char [channel_size];
-*/
-
-    unsigned char *cpu_red = image.get_channel(0);
-    unsigned char *cpu_green = image.get_channel(1);
-    unsigned char *cpu_blue = image.get_channel(2);
-
-    gpuErrchk( cudaMemcpy(cuda_red, cpu_red, sizeof(unsigned char) * channel_size, cudaMemcpyHostToDevice) );
-    gpuErrchk( cudaMemcpy(cuda_green, cpu_green, sizeof(unsigned char) * channel_size, cudaMemcpyHostToDevice) );
-    gpuErrchk( cudaMemcpy(cuda_blue, cpu_blue, sizeof(unsigned char) * channel_size, cudaMemcpyHostToDevice) );
-
+    int64_t width, height;
+    DeviceBuffer<unsigned char> input, output;
+    DeviceBuffer<float> filter;
 
-    
-    //  Only the blurring operation should be timed
-    std::chrono::steady_clock::time_point begin = std::chrono::steady_clock::now();
+    CudaBuffers(int64_t width, int64_t height, size_t filterWeights)
+        : width(width), height(height), input((size_t)width * height), output((size_t)width * height), filter(filterWeights) {}
+};
 
+void CudaBuffersDeleter::operator()( CudaBuffers *buffers ) const
+{
+    delete buffers;
+}
 
+CudaBuffersPtr make_cuda_buffers( int64_t width , int64_t height , const float *filter , int filterSize )
+{
+    //  The filter is one block of floats, so it goes to the device in one copy
+    const size_t filterWeights = (size_t)(2*filterSize + 1) * (2*filterSize + 1);
+    CudaBuffersPtr buffers(new CudaBuffers(width, height, filterWeights));
+    gpuErrchk( cudaMemcpy(buffers->filter.data, filter, sizeof(float) * filterWeights, cudaMemcpyHostToDevice) );
+    return buffers;
+}
 
-    //  Apply blur
-    apply_blur_cuda<<<grid_size, block_size>>> (cuda_red, 
-                                                cuda_red_blurred, 
-                                                image.height(), 
-                                                image.width(), 
-                                                cuda_filter, 
-                                                filterSize);
-    apply_blur_cuda<<<grid_size, block_size>>> (cuda_green, 
-                                                cuda_green_blurred, 
-                                                image.height(), 
-                                                image.width(), 
-                                                cuda_filter, 
-                                                filterSize);
-    apply_blur_cuda<<<grid_size, block_size>>> (cuda_blue, 
-                                                cuda_blue_blurred, 
-                                                image.height(), 
-                                                image.width(), 
-                                                cuda_filter, 
-                                                filterSize);
-
-
-
-    std::chrono::steady_clock::time_point end = std::chrono::steady_clock::now();
-
-    std::cout << "=========\nBlur time: " <<
-        std::to_string( std::chrono::duration_cast<std::chrono::microseconds>(end - begin).count() ) << "[µs], or " <<
-        std::to_string( std::chrono::duration_cast<std::chrono::nanoseconds>(end - begin).count() ) << "[ns]" << std::endl;
-
-
+//  Cuda blur between views, with one-off buffers
+void blur_cuda_into( const ImageView& dst , const ConstImageView& src , int filterSize , double sigma )
+{
+    //  The filter is built in this thread's arena
+    ScratchArena& arena = threadArena();
+    ArenaScope scope(arena);
+    float *filter = arena.allocate<float>((size_t)(2*filterSize + 1) * (2*filterSize + 1));
+    {
+        StageTimer timer("kernel");
+        getFilter(filterSize, sigma, filter);
+    }
+    CudaBuffersPtr buffers = make_cuda_buffers(src.width, src.height, filter, filterSize);
+    blur_cuda_into(dst, src, filterSize, *buffers);
+}
 
-    gpuErrchk( cudaDeviceSynchronize() );
+//  Cuda blur between views, through buffers made for their shape
+void blur_cuda_into( const ImageView& dst , const ConstImageView& src , int filterSize , CudaBuffers& buffers )
+{
+    if ( src.width != buffers.width || src.height != buffers.height )
+    {
+        throw std::invalid_argument("blur_cuda_into(): image shape differs from the device buffers");
+    }
 
-    unsigned char *red_blurred =  (unsigned char*)malloc (sizeof(unsigned char) * channel_size);
-    unsigned char *green_blurred = (unsigned char*)malloc (sizeof(unsigned char) * channel_size);
-    unsigned char *blue_blurred = (unsigned char*)malloc (sizeof(unsigned char) * channel_size);
-    gpuErrchk( cudaMemcpy(red_blurred, cuda_red_blurred, sizeof(unsigned char) * channel_size, cudaMemcpyDeviceToHost) );
-    gpuErrchk( cudaMemcpy(green_blurred, cuda_green_blurred, sizeof(unsigned char) * channel_size, cudaMemcpyDeviceToHost) );
-    gpuErrchk( cudaMemcpy(blue_blurred, cuda_blue_blurred, sizeof(unsigned char) * channel_size, cudaMemcpyDeviceToHost) );
-    //gpuErrchk( cudaMemcpy(&image, cuda_image, image.size(), cudaMemcpyDeviceToHost) );
+    //  Set block size (number of threads per block), then grid size (number of blocks per kernel).
+    //  One thread per pixel up to the grid limits (2^31-1 blocks across, 65535 down); past them,
+    //  the kernel's grid-stride loops give each thread several pixels.
+    const dim3 block_size(16,16,1);
+    const dim3 grid_size((unsigned int)std::min<int64_t>(( src.width + block_size.x - 1 ) / block_size.x, MAXIMUM_GRID_X),
+                         (unsigned int)std::min<int64_t>(( src.height + block_size.y - 1 ) / block_size.y, MAXIMUM_GRID_Y), 1);
 
+    /*  A NOTE ABOUT *ptr = CImg.data():
+    The values are not interleaved, and are ordered first along the X,Y,Z and V axis respectively,
+    so a color image is stored in memory as R1R2R3......G1G2G3.......B1B2B3.... (planar).
+    The views describe the same layout, possibly with padded rows, so each plane goes to the device
+    with one strided copy instead of going through get_channel() copies.
+    */
+    const size_t channel_size = (size_t)src.width * src.height;
 
-    //  loop through image to get blurred pixels
-    for (int row = 0; row < image.height(); row++)
+    //  One device plane in, one out, reused for every channel
+    for (int c = 0; c < src.channels; c++)
     {
-        for (int col = 0; col < image.width(); col++)
         {
-            int index = row*image.width()+col;
-            //std::cout << "R" << (int)red_blurred[index] << "G" << (int)green_blurred[index] << "B" << (int)blue_blurred[index] << ", ";
-            image(col, row, 0, 0) = red_blurred[index];
-            image(col, row, 0, 1) = green_blurred[index];
-            image(col, row, 0, 2) = blue_blurred[index];
-        }
-        //std::cout<<std::endl;
-    }
-
-
-/*  Kept getting segmentation faults on merge_channels
-    //  Merge channels
-    merge_channels<<<grid_size, block_size>>> (cuda_red_blurred, 
-                                                cuda_green_blurred, 
-                                                cuda_blue_blurred,
-                                                reinterpret_cast<uchar4*>(cuda_image_blurred),
-                                                image.height(),
-                                                image.width());
-*/
+            StageTimer timer("upload", c);
+            gpuErrchk( cudaMemcpy2D(buffers.input.data, src.width, src.row(c, 0), src.rowStride, src.width, src.height, cudaMemcpyHostToDevice) );
 
-    //gpuErrchk( cudaMemcpy(&image, cuda_image, image.size(), cudaMemcpyDeviceToHost) );
+            //  The border is left as it was
+            gpuErrchk( cudaMemcpy(buffers.output.data, buffers.input.data, channel_size, cudaMemcpyDeviceToDevice) );
+        }
 
-    //  Free up space
-    cudaFree(cuda_red);
-    cudaFree(cuda_red_blurred);
-    cudaFree(cuda_green);
-    cudaFree(cuda_green_blurred);
-    cudaFree(cuda_blue);
-    cudaFree(cuda_blue_blurred);
-    //cudaFree(cuda_image);
-    //cudaFree(cuda_image_blurred);
-    cudaFree(cuda_filter);
+        {
+            StageTimer timer("convolution", c);
+            apply_blur_cuda<<<grid_size, block_size>>> (buffers.input.data, 
+                                                        buffers.output.data, 
+                                                        src.height, 
+                                                        src.width, 
+                                                        buffers.filter.data, 
+                                                        filterSize);
+            gpuErrchk( cudaGetLastError() );
+
+            //  Launches are asynchronous; only wait for the kernel when it is being timed
+            if ( threadStageTimings() )
+            {
+                gpuErrchk( cudaDeviceSynchronize() );
+            }
+        }
 
-    return image;
+        StageTimer timer("copy_back", c);
+        gpuErrchk( cudaMemcpy2D(dst.row(c, 0), dst.rowStride, buffers.output.data, src.width, src.width, src.height, cudaMemcpyDeviceToHost) );
+    }
 }
-
-
@@ -0,0 +1,1333 @@
+/*
+*   image_io.cpp
+*   part of image blur software using CUDA
+*   for CSC 630 with Dr. Zhang
+*
+*   This file implements image decoding and encoding for the image blur software.
+*   Encoded images live in memory buffers so that nothing is written to or read from a temporary file.
+*
+*   JPEG and PNG are coded in-process with libjpeg(-turbo) and libpng when built with
+*   BLUR_USE_JPEG / BLUR_USE_PNG (see Makefile).  PNM and raw planar (raw_planar.h) are always built in.
+*   Anything else goes through CImg, whose FILE* codecs are fed by fmemopen / open_memstream.
+*/
+
+#define cimg_OS 1
+#define cimg_display 0
+#include "CImg.h"
+#include "image_io.h"
+#include "raw_planar.h"
+#include "trace_events.h"
+#include "utils.h"
+#include <algorithm>
+#include <cctype>
+#include <cmath>
+#include <csetjmp>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+#ifdef BLUR_USE_JPEG
+#include <jpeglib.h>
+#endif
+#ifdef BLUR_USE_PNG
+#include <png.h>
+#include <zlib.h>
+#endif
+
+namespace cl=cimg_library;
+
+/*
+*           PIXEL LAYOUT
+*   Codecs work on interleaved rows (RGBRGB...), CImg stores planes (RRR...GGG...BBB...)
+*/
+
+//  Copy one interleaved row into row y of every plane
+static void storeInterleavedRow(cl::CImg<unsigned char>& image, int y, const unsigned char *row)
+{
+    const int width = image.width();
+    const int channels = image.spectrum();
+    for (int c = 0; c < channels; c++)
+    {
+        unsigned char *plane = image.data(0, y, 0, c);
+        for (int x = 0; x < width; x++)
+        {
+            plane[x] = row[(size_t)x*channels + c];
+        }
+    }
+}
+
+//  Gather row y of the first `channels` planes into an interleaved row
+static void loadInterleavedRow(const cl::CImg<unsigned char>& image, int y, int channels, unsigned char *row)
+{
+    const int width = image.width();
+    for (int c = 0; c < channels; c++)
+    {
+        const unsigned char *plane = image.data(0, y, 0, c);
+        for (int x = 0; x < width; x++)
+        {
+            row[(size_t)x*channels + c] = plane[x];
+        }
+    }
+}
+
+/*
+*           PNM (built-in)
+*   Binary P5 / P6 and ASCII P2 / P3, 8 or 16 bits.  Bitmaps (P1 / P4) are left to CImg.
+*/
+
+struct PnmHeader
+{
+    char type;
+    int width, height, maxval, channels;
+};
+
+//  Skip whitespace and # comments
+static void skipPnmSpace(const std::vector<unsigned char>& buffer, size_t& offset)
+{
+    while ( offset < buffer.size() )
+    {
+        if ( buffer[offset] == '#' )
+        {
+            while ( offset < buffer.size() && buffer[offset] != '\n' ) offset++;
+        }
+        else if ( std::isspace(buffer[offset]) )
+        {
+            offset++;
+        }
+        else
+        {
+            break;
+        }
+    }
+}
+
+static int readPnmInt(const std::vector<unsigned char>& buffer, size_t& offset)
+{
+    skipPnmSpace(buffer, offset);
+    if ( offset >= buffer.size() || !std::isdigit(buffer[offset]) )
+    {
+        throw std::runtime_error("decodePnm(): malformed header");
+    }
+    long value = 0;
+    while ( offset < buffer.size() && std::isdigit(buffer[offset]) && value < (1L << 30) )
+    {
+        value = value*10 + (buffer[offset++] - '0');
+    }
+    return (int)value;
+}
+
+//  Parse the header; offset is left on the first pixel byte
+static PnmHeader parsePnmHeader(const std::vector<unsigned char>& buffer, size_t& offset)
+{
+    PnmHeader header;
+    header.type = buffer[1];
+    offset = 2;
+    header.width = readPnmInt(buffer, offset);
+    header.height = readPnmInt(buffer, offset);
+    header.maxval = readPnmInt(buffer, offset);
+    header.channels = ( header.type == '3' || header.type == '6' ) ? 3 : 1;
+    if ( header.width <= 0 || header.height <= 0 || header.maxval <= 0 || header.maxval > 65535 )
+    {
+        throw std::runtime_error("decodePnm(): bad dimensions or maxval");
+    }
+    //  exactly one whitespace byte separates the header from binary data
+    offset++;
+    return header;
+}
+
+static cl::CImg<unsigned char> decodePnm(const std::vector<unsigned char>& buffer)
+{
+    size_t offset;
+    PnmHeader header = parsePnmHeader(buffer, offset);
+    cl::CImg<unsigned char> image(header.width, header.height, 1, header.channels);
+    const size_t rowSamples = (size_t)header.width * header.channels;
+    std::vector<unsigned char> row(rowSamples);
+
+    if ( header.type == '5' || header.type == '6' )
+    {
+        const size_t bytesPerSample = header.maxval > 255 ? 2 : 1;
+        if ( buffer.size() < offset + rowSamples * bytesPerSample * header.height )
+        {
+            throw std::runtime_error("decodePnm(): truncated pixel data");
+        }
+        const unsigned char *data = buffer.data() + offset;
+        for (int y = 0; y < header.height; y++)
+        {
+            if ( bytesPerSample == 1 && header.maxval == 255 )
+            {
+                storeInterleavedRow(image, y, data);
+            }
+            else
+            {
+                for (size_t i = 0; i < rowSamples; i++)
+                {
+                    unsigned int value = bytesPerSample == 2 ? (data[2*i] << 8 | data[2*i + 1]) : data[i];
+                    row[i] = (unsigned char)((value * 255 + header.maxval/2) / header.maxval);
+                }
+                storeInterleavedRow(image, y, row.data());
+            }
+            data += rowSamples * bytesPerSample;
+        }
+    }
+    else
+    {
+        for (int y = 0; y < header.height; y++)
+        {
+            for (size_t i = 0; i < rowSamples; i++)
+            {
+                unsigned int value = readPnmInt(buffer, offset);
+                row[i] = (unsigned char)((value * 255 + header.maxval/2) / header.maxval);
+            }
+            storeInterleavedRow(image, y, row.data());
+        }
+    }
+    return image;
+}
+
+//  Header of a binary PNM read straight from a stream; the stream is left on the first pixel byte
+ImageInfo readPnmHeader(std::FILE *stream)
+{
+    int magic = std::fgetc(stream);
+    int type = std::fgetc(stream);
+    if ( magic != 'P' || ( type != '5' && type != '6' ) )
+    {
+        throw std::runtime_error("readPnmHeader(): not a binary PNM (P5 / P6)");
+    }
+
+    int values[3];
+    for (int i = 0; i < 3; i++)
+    {
+        int ch = std::fgetc(stream);
+        while ( ch == '#' || std::isspace(ch) )
+        {
+            if ( ch == '#' )
+            {
+                while ( ch != '\n' && ch != EOF ) ch = std::fgetc(stream);
+            }
+            ch = std::fgetc(stream);
+        }
+        long value = 0;
+        while ( std::isdigit(ch) && value < (1L << 30) )
+        {
+            value = value*10 + (ch - '0');
+            ch = std::fgetc(stream);
+        }
+        values[i] = (int)value;
+    }
+
+    ImageInfo info = { values[0], values[1], type == '6' ? 3 : 1 };
+    if ( info.width <= 0 || info.height <= 0 || values[2] != 255 )
+    {
+        throw std::runtime_error("readPnmHeader(): only 8-bit PNM with maxval 255 can be streamed");
+    }
+    return info;
+}
+
+void writePnmHeader(std::FILE *stream, const ImageInfo& info)
+{
+    std::fprintf(stream, "P%c\n%d %d\n255\n", info.channels == 3 ? '6' : '5', info.width, info.height);
+}
+
+//  P5 for grey, P6 for color; a trailing alpha channel is dropped
+static std::vector<unsigned char> encodePnm(const cl::CImg<unsigned char>& image)
+{
+    const int channels = image.spectrum() >= 3 ? 3 : 1;
+    std::string header = std::string(channels == 3 ? "P6" : "P5") + "\n" +
+        std::to_string(image.width()) + " " + std::to_string(image.height()) + "\n255\n";
+
+    const size_t rowSamples = (size_t)image.width() * channels;
+    std::vector<unsigned char> buffer(header.size() + rowSamples * image.height());
+    std::memcpy(buffer.data(), header.data(), header.size());
+    unsigned char *data = buffer.data() + header.size();
+    for (int y = 0; y < image.height(); y++)
+    {
+        loadInterleavedRow(image, y, channels, data);
+        data += rowSamples;
+    }
+    return buffer;
+}
+
+#ifdef BLUR_USE_JPEG
+/*
+*           JPEG (libjpeg)
+*   libjpeg reports errors through error_exit, which must not return; jump back to the caller instead.
+*/
+
+struct JpegErrorManager
+{
+    jpeg_error_mgr base;
+    jmp_buf jump;
+    char message[JMSG_LENGTH_MAX];
+};
+
+static void jpegErrorExit(j_common_ptr info)
+{
+    JpegErrorManager *manager = reinterpret_cast<JpegErrorManager*>(info->err);
+    (*info->err->format_message)(info, manager->message);
+    longjmp(manager->jump, 1);
+}
+
+//  CMYK or YCCK, which libjpeg only decodes to CMYK
+static bool isCmykJpeg(const jpeg_decompress_struct& info)
+{
+    return info.jpeg_color_space == JCS_CMYK || info.jpeg_color_space == JCS_YCCK;
+}
+
+//  A CMYK row to RGB in place: R = (1 - C)(1 - K) and so on.  Adobe's files, nearly all of them,
+//  store the inks inverted, so their samples already are 1 - C and 1 - K.
+static void cmykRowToRgb(unsigned char *row, size_t width, bool inverted)
+{
+    for (size_t x = 0; x < width; x++)
+    {
+        const unsigned char *cmyk = row + 4 * x;
+        const int k = inverted ? cmyk[3] : 255 - cmyk[3];
+        unsigned char rgb[3];
+        for (int c = 0; c < 3; c++)
+        {
+            const int ink = inverted ? cmyk[c] : 255 - cmyk[c];
+            rgb[c] = (unsigned char)(( ink * k + 127 ) / 255);
+        }
+        std::memcpy(row + 3 * x, rgb, 3);
+    }
+}
+
+//  scaleDenominator of 2, 4 or 8 decodes a downscaled image from the DCT coefficients.
+//  CMYK and YCCK images are converted to RGB.
+static cl::CImg<unsigned char> decodeJpeg(const std::vector<unsigned char>& buffer, int scaleDenominator)
+{
+    jpeg_decompress_struct info;
+    JpegErrorManager error;
+    info.err = jpeg_std_error(&error.base);
+    error.base.error_exit = jpegErrorExit;
+    cl::CImg<unsigned char> image;
+    std::vector<unsigned char> row;
+
+    if ( setjmp(error.jump) )
+    {
+        jpeg_destroy_decompress(&info);
+        throw std::runtime_error(std::string("decodeJpeg(): ") + error.message);
+    }
+
+    jpeg_create_decompress(&info);
+    jpeg_mem_src(&info, const_cast<unsigned char*>(buffer.data()), buffer.size());
+    jpeg_read_header(&info, TRUE);
+    const bool cmyk = isCmykJpeg(info);
+    if ( cmyk )
+    {
+        info.out_color_space = JCS_CMYK;
+    }
+    info.scale_num = 1;
+    info.scale_denom = scaleDenominator;
+    jpeg_start_decompress(&info);
+
+    image.assign(info.output_width, info.output_height, 1, cmyk ? 3 : info.output_components);
+    row.resize((size_t)info.output_width * info.output_components);
+    while ( info.output_scanline < info.output_height )
+    {
+        JSAMPROW rowPointer = row.data();
+        const int y = info.output_scanline;
+        jpeg_read_scanlines(&info, &rowPointer, 1);
+        if ( cmyk )
+        {
+            cmykRowToRgb(row.data(), info.output_width, info.saw_Adobe_marker);
+        }
+        storeInterleavedRow(image, y, row.data());
+    }
+
+    jpeg_finish_decompress(&info);
+    jpeg_destroy_decompress(&info);
+    return image;
+}
+
+//  Rows [firstRow, firstRow + rowCount) as a complete JPEG.
+//  Grey or RGB; other channel counts keep their first one or three planes.
+static std::vector<unsigned char> encodeJpegRows(const cl::CImg<unsigned char>& image, int firstRow, int rowCount,
+                                                 const EncodeOptions& options, bool optimize)
+{
+    jpeg_compress_struct info;
+    JpegErrorManager error;
+    info.err = jpeg_std_error(&error.base);
+    error.base.error_exit = jpegErrorExit;
+    unsigned char *data = NULL;
+    unsigned long size = 0;
+    const int channels = image.spectrum() >= 3 ? 3 : 1;
+    std::vector<unsigned char> row((size_t)image.width() * channels);
+
+    if ( setjmp(error.jump) )
+    {
+        jpeg_destroy_compress(&info);
+        free(data);
+        throw std::runtime_error(std::string("encodeJpeg(): ") + error.message);
+    }
+
+    jpeg_create_compress(&info);
+    jpeg_mem_dest(&info, &data, &size);
+    info.image_width = image.width();
+    info.image_height = rowCount;
+    info.input_components = channels;
+    info.in_color_space = channels == 3 ? JCS_RGB : JCS_GRAYSCALE;
+    jpeg_set_defaults(&info);
+    jpeg_set_quality(&info, options.jpegQuality, TRUE);
+    if ( channels == 3 )
+    {
+        info.comp_info[0].h_samp_factor = options.jpegSubsampling == 444 ? 1 : 2;
+        info.comp_info[0].v_samp_factor = options.jpegSubsampling == 420 ? 2 : 1;
+    }
+    info.optimize_coding = optimize ? TRUE : FALSE;
+    jpeg_start_compress(&info, TRUE);
+
+    while ( info.next_scanline < info.image_height )
+    {
+        loadInterleavedRow(image, firstRow + info.next_scanline, channels, row.data());
+        JSAMPROW rowPointer = row.data();
+        jpeg_write_scanlines(&info, &rowPointer, 1);
+    }
+
+    jpeg_finish_compress(&info);
+    jpeg_destroy_compress(&info);
+    std::vector<unsigned char> buffer(data, data + size);
+    free(data);
+    return buffer;
+}
+
+//  Offset just past the SOS segment of a baseline JPEG, where entropy-coded data begins.
+//  Also reports where the SOF0 and SOS segments start.
+static size_t jpegScanOffset(const std::vector<unsigned char>& jpeg, size_t& frameOffset, size_t& sosOffset)
+{
+    size_t offset = 2;
+    while ( offset + 4 <= jpeg.size() && jpeg[offset] == 0xFF )
+    {
+        const unsigned char marker = jpeg[offset + 1];
+        const size_t length = jpeg[offset + 2] << 8 | jpeg[offset + 3];
+        if ( marker == 0xC0 )
+        {
+            frameOffset = offset;
+        }
+        else if ( marker == 0xDA )
+        {
+            sosOffset = offset;
+            return offset + 2 + length;
+        }
+        offset += 2 + length;
+    }
+    throw std::runtime_error("encodeJpeg(): no scan in strip");
+}
+
+/*
+*   Parallel JPEG.  Each strip is a multiple of the MCU height and is encoded as a JPEG of its own
+*   with the standard (non-optimized) Huffman tables, so every strip shares the same tables.
+*   Strips are then spliced into one image: the header of the first strip with the full height,
+*   a DRI marker whose restart interval is one strip, and the entropy-coded segments separated
+*   by RST0..RST7.  A decoder resets its DC predictors at each restart exactly like each strip's
+*   encoder started from zero, so the result is a valid baseline JPEG.
+*/
+static std::vector<unsigned char> encodeJpeg(const cl::CImg<unsigned char>& image, const EncodeOptions& options)
+{
+    const int channels = image.spectrum() >= 3 ? 3 : 1;
+    const int mcuWidth = channels == 3 && options.jpegSubsampling != 444 ? 16 : 8;
+    const int mcuHeight = channels == 3 && options.jpegSubsampling == 420 ? 16 : 8;
+    const long mcusPerRow = (image.width() + mcuWidth - 1) / mcuWidth;
+    const int mcuRows = (image.height() + mcuHeight - 1) / mcuHeight;
+
+    //  Strips of at least 4 MCU rows, one per thread, within the 16-bit restart interval
+    const int minimumMcuRowsPerStrip = 4;
+    int mcuRowsPerStrip = (mcuRows + options.threads - 1) / std::max(options.threads, 1);
+    mcuRowsPerStrip = std::max(mcuRowsPerStrip, minimumMcuRowsPerStrip);
+    mcuRowsPerStrip = (int)std::min<long>(mcuRowsPerStrip, 65535 / mcusPerRow);
+    const int strips = mcuRowsPerStrip > 0 ? (mcuRows + mcuRowsPerStrip - 1) / mcuRowsPerStrip : 1;
+
+    if ( options.threads <= 1 || strips <= 1 || mcuRowsPerStrip == 0 )
+    {
+        return encodeJpegRows(image, 0, image.height(), options, options.jpegOptimize);
+    }
+
+    const int rowsPerStrip = mcuRowsPerStrip * mcuHeight;
+    std::vector<std::vector<unsigned char>> encoded(strips);
+    parallelFor(strips, options.threads, [&](int strip)
+    {
+        int firstRow = strip * rowsPerStrip;
+        int rowCount = std::min(rowsPerStrip, image.height() - firstRow);
+        TraceSpan span("jpeg strip", "encode", strip);
+        encoded[strip] = encodeJpegRows(image, firstRow, rowCount, options, false);
+    });
+
+    //  Header of the first strip, with the full height in SOF0 and a DRI segment before SOS
+    size_t frameOffset = 0, sosOffset = 0;
+    size_t scanOffset = jpegScanOffset(encoded[0], frameOffset, sosOffset);
+
+    std::vector<unsigned char> buffer(encoded[0].begin(), encoded[0].begin() + sosOffset);
+    buffer[frameOffset + 5] = (unsigned char)(image.height() >> 8);
+    buffer[frameOffset + 6] = (unsigned char)(image.height() & 0xFF);
+    const unsigned int restartInterval = (unsigned int)(mcusPerRow * mcuRowsPerStrip);
+    const unsigned char dri[] = { 0xFF, 0xDD, 0x00, 0x04, (unsigned char)(restartInterval >> 8), (unsigned char)(restartInterval & 0xFF) };
+    buffer.insert(buffer.end(), dri, dri + sizeof(dri));
+    buffer.insert(buffer.end(), encoded[0].begin() + sosOffset, encoded[0].begin() + scanOffset);
+
+    //  Entropy-coded segments end just before each strip's EOI
+    for (int strip = 0; strip < strips; strip++)
+    {
+        size_t begin = strip == 0 ? scanOffset : jpegScanOffset(encoded[strip], frameOffset, sosOffset);
+        buffer.insert(buffer.end(), encoded[strip].begin() + begin, encoded[strip].end() - 2);
+        if ( strip + 1 < strips )
+        {
+            buffer.push_back(0xFF);
+            buffer.push_back((unsigned char)(0xD0 + strip % 8));
+        }
+        std::vector<unsigned char>().swap(encoded[strip]);
+    }
+    buffer.push_back(0xFF);
+    buffer.push_back(0xD9);
+    return buffer;
+}
+#endif
+
+#ifdef BLUR_USE_PNG
+/*
+*           PNG decoding (libpng)
+*   The memory source is a plain callback; errors longjmp back through png_jmpbuf.
+*/
+
+struct PngReadState
+{
+    const std::vector<unsigned char> *buffer;
+    size_t offset;
+};
+
+static void pngReadCallback(png_structp png, png_bytep data, png_size_t length)
+{
+    PngReadState *state = static_cast<PngReadState*>(png_get_io_ptr(png));
+    if ( state->offset + length > state->buffer->size() )
+    {
+        png_error(png, "truncated data");
+    }
+    std::memcpy(data, state->buffer->data() + state->offset, length);
+    state->offset += length;
+}
+
+
+//  Any PNG is expanded or reduced to 8-bit grey, grey+alpha, RGB or RGBA
+static cl::CImg<unsigned char> decodePng(const std::vector<unsigned char>& buffer)
+{
+    png_structp png = png_create_read_struct(PNG_LIBPNG_VER_STRING, NULL, NULL, NULL);
+    png_infop info = png ? png_create_info_struct(png) : NULL;
+    if ( !info )
+    {
+        png_destroy_read_struct(&png, NULL, NULL);
+        throw std::runtime_error("decodePng(): out of memory");
+    }
+    PngReadState state = { &buffer, 0 };
+    cl::CImg<unsigned char> image;
+    std::vector<unsigned char> pixels;
+
+    if ( setjmp(png_jmpbuf(png)) )
+    {
+        png_destroy_read_struct(&png, &info, NULL);
+        throw std::runtime_error("decodePng(): corrupt PNG data");
+    }
+
+    png_set_read_fn(png, &state, pngReadCallback);
+    png_read_info(png, info);
+    png_set_expand(png);
+    png_set_strip_16(png);
+    png_set_packing(png);
+    int passes = png_set_interlace_handling(png);
+    png_read_update_info(png, info);
+
+    const int width = png_get_image_width(png, info);
+    const int height = png_get_image_height(png, info);
+    const int channels = png_get_channels(png, info);
+    image.assign(width, height, 1, channels);
+
+    //  Interlaced images need every pass over the whole image before rows are final
+    const size_t rowBytes = png_get_rowbytes(png, info);
+    pixels.resize(rowBytes * (passes > 1 ? height : 1));
+    for (int pass = 0; pass < passes; pass++)
+    {
+        for (int y = 0; y < height; y++)
+        {
+            png_bytep rowPointer = pixels.data() + (passes > 1 ? rowBytes * y : 0);
+            png_read_row(png, rowPointer, NULL);
+            if ( passes == 1 )
+            {
+                storeInterleavedRow(image, y, rowPointer);
+            }
+        }
+    }
+    if ( passes > 1 )
+    {
+        for (int y = 0; y < height; y++)
+        {
+            storeInterleavedRow(image, y, pixels.data() + rowBytes * y);
+        }
+    }
+
+    png_read_end(png, NULL);
+    png_destroy_read_struct(&png, &info, NULL);
+    return image;
+}
+
+/*
+*           PNG encoding (zlib)
+*   libpng writes a single zlib stream from one thread, so encoding is done here instead.
+*   Rows are filtered with the best of the allowed filters (smallest sum of absolute values,
+*   the usual heuristic), and only once every row is filtered are strips of rows deflated in
+*   parallel.  Each strip is primed with the last 32KB of the previous one, ends on a byte
+*   boundary (Z_SYNC_FLUSH) and the strips are concatenated into a single zlib stream whose
+*   Adler-32 is combined from the strips'.
+*/
+
+//  Largest piece handed to deflate or adler32 at once; their lengths are uInt
+static const size_t MAXIMUM_ZLIB_PIECE = 1u << 30;
+
+static unsigned char paethPredictor(int a, int b, int c)
+{
+    int p = a + b - c;
+    int pa = std::abs(p - a), pb = std::abs(p - b), pc = std::abs(p - c);
+    if ( pa <= pb && pa <= pc ) return (unsigned char)a;
+    if ( pb <= pc ) return (unsigned char)b;
+    return (unsigned char)c;
+}
+
+//  Filter one row; out receives the filter type byte followed by the filtered bytes
+static void filterPngRow(int filter, const unsigned char *row, const unsigned char *previous, size_t length, int bpp, unsigned char *out)
+{
+    out[0] = (unsigned char)filter;
+    out++;
+    for (size_t i = 0; i < length; i++)
+    {
+        int left = i >= (size_t)bpp ? row[i - bpp] : 0;
+        int upLeft = i >= (size_t)bpp ? previous[i - bpp] : 0;
+        int up = previous[i];
+        switch (filter)
+        {
+            case 0:  out[i] = row[i]; break;
+            case 1:  out[i] = (unsigned char)(row[i] - left); break;
+            case 2:  out[i] = (unsigned char)(row[i] - up); break;
+            case 3:  out[i] = (unsigned char)(row[i] - ((left + up) >> 1)); break;
+            default: out[i] = (unsigned char)(row[i] - paethPredictor(left, up, upLeft)); break;
+        }
+    }
+}
+
+//  Filter with every allowed type and keep the one with the smallest sum of signed magnitudes
+static void filterPngRowBest(int filters, const unsigned char *row, const unsigned char *previous, size_t length, int bpp,
+                             unsigned char *out, std::vector<unsigned char>& trial)
+{
+    unsigned long bestCost = ~0UL;
+    for (int filter = 0; filter < 5; filter++)
+    {
+        if ( !(filters & (1 << filter)) )
+        {
+            continue;
+        }
+        if ( (filters & ~(1 << filter)) == 0 )
+        {
+            filterPngRow(filter, row, previous, length, bpp, out);
+            return;
+        }
+        filterPngRow(filter, row, previous, length, bpp, trial.data());
+        unsigned long cost = 0;
+        for (size_t i = 1; i <= length; i++)
+        {
+            cost += trial[i] < 128 ? trial[i] : 256 - trial[i];
+        }
+        if ( cost < bestCost )
+        {
+            bestCost = cost;
+            std::memcpy(out, trial.data(), length + 1);
+        }
+    }
+}
+
+static void appendBigEndian(std::vector<unsigned char>& buffer, unsigned long value)
+{
+    buffer.push_back((unsigned char)(value >> 24));
+    buffer.push_back((unsigned char)(value >> 16));
+    buffer.push_back((unsigned char)(value >> 8));
+    buffer.push_back((unsigned char)value);
+}
+
+static void appendPngChunk(std::vector<unsigned char>& buffer, const char *type, const unsigned char *data, size_t length)
+{
+    appendBigEndian(buffer, length);
+    size_t typeOffset = buffer.size();
+    buffer.insert(buffer.end(), type, type + 4);
+    buffer.insert(buffer.end(), data, data + length);
+    unsigned long crc = crc32(0L, buffer.data() + typeOffset, (uInt)(length + 4));
+    appendBigEndian(buffer, crc);
+}
+
+static std::vector<unsigned char> encodePng(const cl::CImg<unsigned char>& image, const EncodeOptions& options)
+{
+    static const unsigned char colorTypes[] = { 0, 4, 2, 6 };    // grey, grey+alpha, RGB, RGBA
+    const int channels = image.spectrum() > 4 ? 4 : image.spectrum();
+    const int height = image.height();
+    const size_t rowBytes = (size_t)image.width() * channels;
+    const size_t filteredBytes = rowBytes + 1;
+
+    //  Strips of at least 256KB of pixel data, one per thread
+    const size_t minimumStripBytes = 256 * 1024;
+    int strips = (int)std::max<size_t>(1, std::min<size_t>(options.threads, rowBytes * height / minimumStripBytes));
+    const int rowsPerStrip = (height + strips - 1) / strips;
+    strips = (height + rowsPerStrip - 1) / rowsPerStrip;
+
+    //  Interleave everything first: filtering a row reads the row above, which may be in another strip
+    std::vector<unsigned char> pixels(rowBytes * height);
+    parallelFor(strips, options.threads, [&](int strip)
+    {
+        TraceSpan span("png interleave", "encode", strip);
+        for (int y = strip * rowsPerStrip; y < std::min(height, (strip + 1) * rowsPerStrip); y++)
+        {
+            loadInterleavedRow(image, y, channels, pixels.data() + rowBytes * y);
+        }
+    });
+
+    //  Filter everything next: a strip's dictionary is the end of the filtered strip before it
+    std::vector<unsigned char> filtered(filteredBytes * height);
+    parallelFor(strips, options.threads, [&](int strip)
+    {
+        TraceSpan span("png filter", "encode", strip);
+        std::vector<unsigned char> zeroRow(rowBytes, 0);
+        std::vector<unsigned char> trial(filteredBytes);
+        for (int y = strip * rowsPerStrip; y < std::min(height, (strip + 1) * rowsPerStrip); y++)
+        {
+            const unsigned char *previous = y > 0 ? pixels.data() + rowBytes * (y - 1) : zeroRow.data();
+            filterPngRowBest(options.pngFilters, pixels.data() + rowBytes * y, previous, rowBytes, channels,
+                             filtered.data() + filteredBytes * y, trial);
+        }
+    });
+
+    std::vector<std::vector<unsigned char>> deflated(strips);
+    std::vector<unsigned long> adlers(strips);
+    parallelFor(strips, options.threads, [&](int strip)
+    {
+        TraceSpan span("png strip", "encode", strip);
+        const int firstRow = strip * rowsPerStrip;
+        const int lastRow = std::min(height, firstRow + rowsPerStrip);
+        const unsigned char *input = filtered.data() + filteredBytes * firstRow;
+        const size_t length = filteredBytes * (lastRow - firstRow);
+        z_stream stream;
+        std::memset(&stream, 0, sizeof(stream));
+        if ( deflateInit2(&stream, options.pngLevel, Z_DEFLATED, -15, 8, Z_DEFAULT_STRATEGY) != Z_OK )
+        {
+            throw std::runtime_error("encodePng(): deflateInit2 failed");
+        }
+        if ( strip > 0 )
+        {
+            size_t dictionary = std::min<size_t>(32768, filteredBytes * firstRow);
+            deflateSetDictionary(&stream, input - dictionary, (uInt)dictionary);
+        }
+
+        //  zlib counts bytes in uInt, so strips of 4GB and more go in and come out in pieces
+        std::vector<unsigned char>& output = deflated[strip];
+        output.resize(deflateBound(&stream, length) + 16);
+        const int finalFlush = strip + 1 == strips ? Z_FINISH : Z_SYNC_FLUSH;
+        int status = Z_OK;
+        size_t consumed = 0;
+        do
+        {
+            const size_t piece = std::min(MAXIMUM_ZLIB_PIECE, length - consumed);
+            const bool lastPiece = consumed + piece == length;
+            stream.next_in = const_cast<unsigned char*>(input + consumed);
+            stream.avail_in = (uInt)piece;
+            do
+            {
+                stream.next_out = output.data() + stream.total_out;
+                stream.avail_out = (uInt)std::min(MAXIMUM_ZLIB_PIECE, output.size() - stream.total_out);
+                status = deflate(&stream, lastPiece ? finalFlush : Z_NO_FLUSH);
+            }
+            while ( status != Z_STREAM_ERROR && status != Z_STREAM_END && ( stream.avail_in != 0 || stream.avail_out == 0 ) );
+            consumed += piece;
+        }
+        while ( consumed < length && status != Z_STREAM_ERROR );
+        output.resize(stream.total_out);
+        deflateEnd(&stream);
+        if ( status == Z_STREAM_ERROR || stream.avail_in != 0 || ( finalFlush == Z_FINISH && status != Z_STREAM_END ) )
+        {
+            throw std::runtime_error("encodePng(): deflate failed");
+        }
+        unsigned long adler = adler32(0L, Z_NULL, 0);
+        for (size_t offset = 0; offset < length; offset += MAXIMUM_ZLIB_PIECE)
+        {
+            adler = adler32(adler, input + offset, (uInt)std::min(MAXIMUM_ZLIB_PIECE, length - offset));
+        }
+        adlers[strip] = adler;
+    });
+
+    //  zlib header: deflate with a 32KB window, level hint in FLEVEL, check bits making it a multiple of 31
+    const int levelHint = options.pngLevel <= 1 ? 0 : options.pngLevel <= 5 ? 1 : options.pngLevel == 6 ? 2 : 3;
+    unsigned int header = 0x78 << 8 | levelHint << 6;
+    header += 31 - header % 31;
+    std::vector<unsigned char> zlibStream;
+    zlibStream.push_back((unsigned char)(header >> 8));
+    zlibStream.push_back((unsigned char)(header & 0xFF));
+    unsigned long adler = adlers[0];
+    for (int strip = 0; strip < strips; strip++)
+    {
+        zlibStream.insert(zlibStream.end(), deflated[strip].begin(), deflated[strip].end());
+        if ( strip > 0 )
+        {
+            size_t length = filteredBytes * (std::min(height, (strip + 1) * rowsPerStrip) - strip * rowsPerStrip);
+            adler = adler32_combine(adler, adlers[strip], (z_off_t)length);
+        }
+    }
+    appendBigEndian(zlibStream, adler);
+
+    static const unsigned char signature[] = { 0x89, 'P', 'N', 'G', '\r', '\n', 0x1A, '\n' };
+    std::vector<unsigned char> buffer(signature, signature + sizeof(signature));
+    std::vector<unsigned char> ihdr;
+    appendBigEndian(ihdr, image.width());
+    appendBigEndian(ihdr, height);
+    const unsigned char ihdrTail[] = { 8, colorTypes[channels - 1], 0, 0, 0 };
+    ihdr.insert(ihdr.end(), ihdrTail, ihdrTail + sizeof(ihdrTail));
+    appendPngChunk(buffer, "IHDR", ihdr.data(), ihdr.size());
+
+    //  IDAT chunk lengths are 31-bit
+    const size_t maximumChunk = 1 << 30;
+    for (size_t offset = 0; offset < zlibStream.size(); offset += maximumChunk)
+    {
+        appendPngChunk(buffer, "IDAT", zlibStream.data() + offset, std::min(maximumChunk, zlibStream.size() - offset));
+    }
+    appendPngChunk(buffer, "IEND", NULL, 0);
+    return buffer;
+}
+#endif
+
+/*
+*           CImg FILE* fallback
+*   Codecs without a native implementation go through CImg on a FILE* over the memory buffer.
+*/
+
+static cl::CImg<unsigned char> decodeWithCImg(const std::vector<unsigned char>& buffer, ImageFormat format)
+{
+    std::FILE *file = fmemopen(const_cast<unsigned char*>(buffer.data()), buffer.size(), "rb");
+    if ( !file )
+    {
+        throw std::runtime_error("decodeImage(): fmemopen failed");
+    }
+
+    cl::CImg<unsigned char> image;
+    try
+    {
+        switch (format)
+        {
+            case ImageFormat::Jpeg: image.load_jpeg(file); break;
+            case ImageFormat::Png:  image.load_png(file);  break;
+            case ImageFormat::Pnm:  image.load_pnm(file);  break;
+            case ImageFormat::Bmp:  image.load_bmp(file);  break;
+            default: break;
+        }
+    }
+    catch (...)
+    {
+        std::fclose(file);
+        throw;
+    }
+    std::fclose(file);
+    return image;
+}
+
+//  open_memstream grows a malloc'd buffer as CImg writes to it
+static std::vector<unsigned char> encodeWithCImg(const cl::CImg<unsigned char>& image, ImageFormat format, const EncodeOptions& options)
+{
+    char *data = NULL;
+    size_t size = 0;
+    std::FILE *file = open_memstream(&data, &size);
+    if ( !file )
+    {
+        throw std::runtime_error("encodeImage(): open_memstream failed");
+    }
+
+    try
+    {
+        switch (format)
+        {
+            case ImageFormat::Jpeg: image.save_jpeg(file, options.jpegQuality); break;
+            case ImageFormat::Png:  image.save_png(file);  break;
+            case ImageFormat::Pnm:  image.save_pnm(file);  break;
+            case ImageFormat::Bmp:  image.save_bmp(file);  break;
+            default:
+                throw std::runtime_error("encodeImage(): unknown output format; use --format");
+        }
+    }
+    catch (...)
+    {
+        std::fclose(file);
+        free(data);
+        throw;
+    }
+
+    //  size and data are only valid once the stream is flushed or closed
+    std::fclose(file);
+    std::vector<unsigned char> buffer(data, data + size);
+    free(data);
+    return buffer;
+}
+
+//  Whether decodeImage / encodeImage handle a codec without CImg
+bool hasNativeCodec(ImageFormat format)
+{
+    switch (format)
+    {
+#ifdef BLUR_USE_JPEG
+        case ImageFormat::Jpeg: return true;
+#endif
+#ifdef BLUR_USE_PNG
+        case ImageFormat::Png:  return true;
+#endif
+        case ImageFormat::Pnm:  return true;
+        case ImageFormat::RawPlanar: return true;
+        default:                return false;
+    }
+}
+
+/*
+*           HEADERS
+*/
+
+#ifdef BLUR_USE_JPEG
+static bool probeJpeg(const std::vector<unsigned char>& buffer, ImageInfo& imageInfo)
+{
+    jpeg_decompress_struct info;
+    JpegErrorManager error;
+    info.err = jpeg_std_error(&error.base);
+    error.base.error_exit = jpegErrorExit;
+
+    if ( setjmp(error.jump) )
+    {
+        jpeg_destroy_decompress(&info);
+        return false;
+    }
+
+    jpeg_create_decompress(&info);
+    jpeg_mem_src(&info, const_cast<unsigned char*>(buffer.data()), buffer.size());
+    jpeg_read_header(&info, TRUE);
+    imageInfo.width = info.image_width;
+    imageInfo.height = info.image_height;
+    imageInfo.channels = isCmykJpeg(info) ? 3 : info.num_components;
+    jpeg_destroy_decompress(&info);
+    return true;
+}
+#endif
+
+//  IHDR is always the first chunk: width and height are big-endian at bytes 16 and 20
+static bool probePng(const std::vector<unsigned char>& buffer, ImageInfo& info)
+{
+    static const int channelsOfColorType[] = { 1, 0, 3, 1, 2, 0, 4 };
+    if ( buffer.size() < 29 )
+    {
+        return false;
+    }
+    const unsigned char *ihdr = buffer.data() + 16;
+    info.width = ihdr[0] << 24 | ihdr[1] << 16 | ihdr[2] << 8 | ihdr[3];
+    info.height = ihdr[4] << 24 | ihdr[5] << 16 | ihdr[6] << 8 | ihdr[7];
+    info.channels = ihdr[9] <= 6 ? channelsOfColorType[ihdr[9]] : 0;
+    return info.width > 0 && info.height > 0 && info.channels > 0;
+}
+
+bool probeImage(const std::vector<unsigned char>& buffer, ImageFormat format, ImageInfo& info)
+{
+    if ( format == ImageFormat::Unknown )
+    {
+        format = formatFromSignature(buffer);
+    }
+    try
+    {
+        switch (format)
+        {
+#ifdef BLUR_USE_JPEG
+            case ImageFormat::Jpeg: return probeJpeg(buffer, info);
+#endif
+            case ImageFormat::Png:  return probePng(buffer, info);
+            case ImageFormat::RawPlanar:
+            {
+                RawPlanarHeader header;
+                if ( buffer.size() < sizeof(header) ) return false;
+                std::memcpy(&header, buffer.data(), sizeof(header));
+                info.width = (int)header.width;
+                info.height = (int)header.height;
+                info.channels = (int)header.channels;
+                return true;
+            }
+            case ImageFormat::Pnm:
+            {
+                size_t offset;
+                PnmHeader header = parsePnmHeader(buffer, offset);
+                info.width = header.width;
+                info.height = header.height;
+                info.channels = header.channels;
+                return true;
+            }
+            default:                return false;
+        }
+    }
+    catch (std::exception&)
+    {
+        return false;
+    }
+}
+
+/*
+*           REDUCED DECODE
+*   Decoding at 1/d averages roughly d x d blocks, a box filter whose variance is (d*d - 1) / 12
+*   full-resolution pixels squared.  Only the remainder of the requested blur is left to do, and it
+*   is done at 1/d resolution, so sigma and filter size shrink by d as well:
+*       sigma' = sqrt(sigma^2 - (d^2 - 1) / 12) / d
+*   Reduction is allowed when the output is at most 1/(2d) the input size, so that a following
+*   downscale of at least 2 hides the blockiness of DCT scaling, or when the blur is so wide
+*   (sigma >= 2d) that the reduced result can be interpolated back up without visible error.
+*   The keep border never reduces: its filterSize-wide frame of unblurred pixels would be decoded
+*   at 1/d and interpolated back up, nothing like the sharp frame of the full-resolution blur.
+*   blur.exe --verify checks the other borders on JPEG input against the full-resolution
+*   blur-then-scale (36dB PSNR).
+*/
+ReducedDecode planReducedDecode(double outputScale, double sigma, int filterSize, bool keepBorder)
+{
+    const double minimumSigma = 0.5;
+    ReducedDecode plan = { 1, sigma, filterSize };
+    if ( keepBorder )
+    {
+        return plan;
+    }
+
+    double allowed = std::max(0.5 / outputScale, sigma / 2.0);
+    while ( plan.denominator < 8 && 2 * plan.denominator <= allowed )
+    {
+        plan.denominator *= 2;
+    }
+    if ( plan.denominator == 1 )
+    {
+        return plan;
+    }
+
+    const double d = plan.denominator;
+    double residual = sigma * sigma - (d * d - 1.0) / 12.0;
+    plan.sigma = std::max(std::sqrt(std::max(residual, 0.0)) / d, minimumSigma);
+    plan.filterSize = std::max(1, (int)std::ceil(filterSize * plan.sigma / sigma - 1e-9));
+    return plan;
+}
+
+void resizeToOutput(cl::CImg<unsigned char>& image, const ImageInfo& fullSize, double outputScale)
+{
+    const int outputWidth = std::max(1, (int)std::lround(fullSize.width * outputScale));
+    const int outputHeight = std::max(1, (int)std::lround(fullSize.height * outputScale));
+    if ( outputWidth != image.width() || outputHeight != image.height() )
+    {
+        image.resize(outputWidth, outputHeight, -100, -100, outputWidth < image.width() ? 2 : 3);
+    }
+}
+
+/*
+*   Codec from a command-line name.  Case-insensitive, accepts the common extensions.
+*/
+ImageFormat formatFromName(const std::string& name)
+{
+    std::string lower;
+    for (char ch : name)
+    {
+        lower += std::tolower(static_cast<unsigned char>(ch));
+    }
+
+    if ( lower == "jpg" || lower == "jpeg" ) return ImageFormat::Jpeg;
+    if ( lower == "png" ) return ImageFormat::Png;
+    if ( lower == "pnm" || lower == "ppm" || lower == "pgm" ) return ImageFormat::Pnm;
+    if ( lower == "bmp" ) return ImageFormat::Bmp;
+    if ( lower == "raw" ) return ImageFormat::RawPlanar;
+    return ImageFormat::Unknown;
+}
+
+/*
+*   Codec from the extension of a path, e.g. img/dog.jpg => Jpeg
+*/
+ImageFormat formatFromPath(const std::string& path)
+{
+    std::vector<std::string> pathTokens = split(path, '.');
+    if ( pathTokens.size() < 2 )
+    {
+        return ImageFormat::Unknown;
+    }
+    return formatFromName(pathTokens.back());
+}
+
+/*
+*   Sniff the codec from its magic bytes, used when stdin arrives without --format
+*/
+ImageFormat formatFromSignature(const std::vector<unsigned char>& buffer)
+{
+    if ( buffer.size() >= 3 && buffer[0] == 0xFF && buffer[1] == 0xD8 && buffer[2] == 0xFF )
+    {
+        return ImageFormat::Jpeg;
+    }
+    if ( buffer.size() >= 8 && buffer[0] == 0x89 && buffer[1] == 'P' && buffer[2] == 'N' && buffer[3] == 'G' )
+    {
+        return ImageFormat::Png;
+    }
+    if ( buffer.size() >= 2 && buffer[0] == 'P' && buffer[1] >= '1' && buffer[1] <= '6' )
+    {
+        return ImageFormat::Pnm;
+    }
+    if ( buffer.size() >= sizeof(RAW_PLANAR_MAGIC) && std::memcmp(buffer.data(), RAW_PLANAR_MAGIC, sizeof(RAW_PLANAR_MAGIC)) == 0 )
+    {
+        return ImageFormat::RawPlanar;
+    }
+    if ( buffer.size() >= 2 && buffer[0] == 'B' && buffer[1] == 'M' )
+    {
+        return ImageFormat::Bmp;
+    }
+    return ImageFormat::Unknown;
+}
+
+std::string formatName(ImageFormat format)
+{
+    switch (format)
+    {
+        case ImageFormat::Jpeg: return "jpeg";
+        case ImageFormat::Png:  return "png";
+        case ImageFormat::Pnm:  return "pnm";
+        case ImageFormat::Bmp:  return "bmp";
+        case ImageFormat::RawPlanar: return "raw";
+        default:                return "unknown";
+    }
+}
+
+EncodeOptions encodeOptionsForPreset(EncodePreset preset)
+{
+    EncodeOptions options;
+    switch (preset)
+    {
+        case EncodePreset::Fast:
+            options.jpegQuality = 85;
+            options.pngLevel = 1;
+            options.pngFilters = PNG_FILTER_BIT_UP;
+            break;
+        case EncodePreset::Balanced:
+            break;
+        case EncodePreset::Small:
+            options.jpegOptimize = true;
+            options.pngLevel = 9;
+            options.pngFilters = PNG_FILTER_BITS_ALL;
+            break;
+    }
+    return options;
+}
+
+bool presetFromName(const std::string& name, EncodePreset& preset)
+{
+    if ( name == "fast" ) preset = EncodePreset::Fast;
+    else if ( name == "balanced" ) preset = EncodePreset::Balanced;
+    else if ( name == "small" ) preset = EncodePreset::Small;
+    else return false;
+    return true;
+}
+
+int pngFiltersFromName(const std::string& name)
+{
+    if ( name == "none" ) return PNG_FILTER_BIT_NONE;
+    if ( name == "sub" ) return PNG_FILTER_BIT_SUB;
+    if ( name == "up" ) return PNG_FILTER_BIT_UP;
+    if ( name == "average" ) return PNG_FILTER_BIT_AVERAGE;
+    if ( name == "paeth" ) return PNG_FILTER_BIT_PAETH;
+    if ( name == "all" ) return PNG_FILTER_BITS_ALL;
+    return 0;
+}
+
+/*
+*   Read everything left in a stream into a buffer
+*/
+std::vector<unsigned char> readStream(std::FILE *stream)
+{
+    std::vector<unsigned char> buffer;
+    unsigned char chunk[1 << 16];
+    size_t count;
+    while ( (count = std::fread(chunk, 1, sizeof(chunk), stream)) > 0 )
+    {
+        buffer.insert(buffer.end(), chunk, chunk + count);
+    }
+    if ( std::ferror(stream) )
+    {
+        throw std::runtime_error("readStream(): read error");
+    }
+    return buffer;
+}
+
+std::vector<unsigned char> readFile(const std::string& path)
+{
+    std::FILE *file = std::fopen(path.c_str(), "rb");
+    if ( !file )
+    {
+        throw std::runtime_error("readFile(): unable to open " + path);
+    }
+    std::vector<unsigned char> buffer = readStream(file);
+    std::fclose(file);
+    return buffer;
+}
+
+void writeStream(std::FILE *stream, const std::vector<unsigned char>& buffer)
+{
+    if ( std::fwrite(buffer.data(), 1, buffer.size(), stream) != buffer.size() || std::fflush(stream) != 0 )
+    {
+        throw std::runtime_error("writeStream(): write error");
+    }
+}
+
+void writeFile(const std::string& path, const std::vector<unsigned char>& buffer)
+{
+    std::FILE *file = std::fopen(path.c_str(), "wb");
+    if ( !file )
+    {
+        throw std::runtime_error("writeFile(): unable to open " + path);
+    }
+    writeStream(file, buffer);
+    std::fclose(file);
+}
+
+/*
+*   Decode an image held in memory with the native codec when there is one, CImg otherwise.
+*   CImg can only decode JPEG and PNG from memory when built with cimg_use_jpeg / cimg_use_png,
+*   otherwise it throws a CImgIOException which surfaces to main.
+*/
+cl::CImg<unsigned char> decodeImage(const std::vector<unsigned char>& buffer, ImageFormat format, int scaleDenominator)
+{
+    if ( format == ImageFormat::Unknown )
+    {
+        format = formatFromSignature(buffer);
+    }
+    if ( buffer.empty() || format == ImageFormat::Unknown )
+    {
+        throw std::runtime_error("decodeImage(): unrecognized image data; use --format");
+    }
+
+    switch (format)
+    {
+#ifdef BLUR_USE_JPEG
+        case ImageFormat::Jpeg: return decodeJpeg(buffer, scaleDenominator);
+#endif
+#ifdef BLUR_USE_PNG
+        case ImageFormat::Png:  return decodePng(buffer);
+#endif
+        case ImageFormat::RawPlanar: return decodeRawPlanar(buffer);
+        case ImageFormat::Pnm:
+            if ( buffer.size() > 2 && buffer[1] != '1' && buffer[1] != '4' )
+            {
+                return decodePnm(buffer);
+            }
+            return decodeWithCImg(buffer, format);
+        default:
+            return decodeWithCImg(buffer, format);
+    }
+}
+
+/*
+*   Encode an image to memory
+*/
+std::vector<unsigned char> encodeImage(const cl::CImg<unsigned char>& image, ImageFormat format, const EncodeOptions& options)
+{
+    switch (format)
+    {
+#ifdef BLUR_USE_JPEG
+        case ImageFormat::Jpeg: return encodeJpeg(image, options);
+#endif
+#ifdef BLUR_USE_PNG
+        case ImageFormat::Png:  return encodePng(image, options);
+#endif
+        case ImageFormat::Pnm:  return encodePnm(image);
+        case ImageFormat::RawPlanar: return encodeRawPlanar(image);
+        default:                return encodeWithCImg(image, format, options);
+    }
+}
+
+/*
+*   Peak memory of decoding: the encoded input and the decoded image
+*/
+size_t decodeMemory(size_t encodedBytes, const ImageInfo& decoded, ImageFormat format)
+{
+    const size_t pixels = (size_t)decoded.width * decoded.height * decoded.channels;
+    //  Interlaced PNG is decoded into a whole interleaved copy first; the rest go row by row
+    return encodedBytes + pixels + ( format == ImageFormat::Png ? pixels : 0 );
+}
+
+/*
+*   Peak memory of encoding: the encoder's buffers, not the image
+*/
+size_t encodeMemory(const ImageInfo& image, ImageFormat format, const EncodeOptions& options)
+{
+    const size_t rowBytes = (size_t)image.width * std::min(image.channels, 4);
+    const size_t pixels = rowBytes * image.height;
+    switch (format)
+    {
+        //  Interleaved pixels, filtered rows, deflated strips, the joined zlib stream and the file
+        case ImageFormat::Png:  return pixels + 4 * (pixels + image.height) + 64 * 1024 * std::max(1, options.threads);
+        //  Encoded strips and the joined file
+        case ImageFormat::Jpeg: return 2 * pixels + 64 * 1024 * std::max(1, options.threads);
+        //  The file
+        default:                return pixels + 4096;
+    }
+}
+
+/*
+*   stdin is buffered and decoded in memory.  Files with a native codec are read whole and decoded
+*   the same way; everything else still goes through CImg's own loader, which may call an external converter.
+*   An Unknown format is filled in with the detected one, so the caller can encode the output alike.
+*   stdin's magic bytes win over the format passed in, which only names input that has none.
+*/
+cl::CImg<unsigned char> loadImage(const std::string& path, ImageFormat& format, int scaleDenominator, ImageInfo *fullSize)
+{
+    cl::CImg<unsigned char> image;
+    std::vector<unsigned char> buffer;
+    if ( path == STDIO_PATH )
+    {
+        buffer = readStream(stdin);
+        const ImageFormat detected = formatFromSignature(buffer);
+        if ( detected != ImageFormat::Unknown )
+        {
+            format = detected;
+        }
+    }
+    else if ( format == ImageFormat::Unknown )
+    {
+        format = formatFromPath(path);
+    }
+
+    if ( path == STDIO_PATH || hasNativeCodec(format) )
+    {
+        if ( buffer.empty() )
+        {
+            buffer = readFile(path);
+        }
+        image = decodeImage(buffer, format, scaleDenominator);
+        if ( fullSize && scaleDenominator > 1 && probeImage(buffer, format, *fullSize) )
+        {
+            return image;
+        }
+    }
+    else
+    {
+        image.load(path.c_str());
+    }
+
+    if ( fullSize )
+    {
+        fullSize->width = image.width();
+        fullSize->height = image.height();
+        fullSize->channels = image.spectrum();
+    }
+    return image;
+}
+
+void saveImage(const cl::CImg<unsigned char>& image, const std::string& path, ImageFormat format, const EncodeOptions& options)
+{
+    if ( path == STDIO_PATH )
+    {
+        writeStream(stdout, encodeImage(image, format, options));
+        return;
+    }
+    if ( hasNativeCodec(format) )
+    {
+        writeFile(path, encodeImage(image, format, options));
+        return;
+    }
+    image.save(path.c_str());
+}
@@ -0,0 +1,145 @@
+/*
+*   image_io.h
+*   part of image blur software using CUDA
+*   for CSC 630 with Dr. Zhang
+*
+*   This header file contains the definitions for image decoding and encoding.
+*   Images are decoded from and encoded to in-memory buffers, so the same code path serves
+*   files on disk as well as stdin/stdout in shell pipelines (path "-").
+*/
+
+#ifndef IMAGE_IO_H
+#define IMAGE_IO_H
+
+#define cimg_OS 1
+#define cimg_display 0
+#include "CImg.h"
+#include <cstdio>
+#include <string>
+#include <vector>
+
+namespace cl=cimg_library;
+
+//  Path used on the command-line to mean stdin (input) or stdout (output)
+const std::string STDIO_PATH = "-";
+
+//  Codecs understood by decodeImage / encodeImage
+enum class ImageFormat { Unknown, Jpeg, Png, Pnm, Bmp, RawPlanar };
+
+//  Codec from a name given at the command-line, such as "jpg" or "png"
+ImageFormat formatFromName(const std::string& name);
+
+//  Codec from the extension of a file path
+ImageFormat formatFromPath(const std::string& path);
+
+//  Codec from the leading bytes of an encoded image
+ImageFormat formatFromSignature(const std::vector<unsigned char>& buffer);
+
+//  Printable codec name
+std::string formatName(ImageFormat format);
+
+//  Dimensions of an image, as read from its header
+struct ImageInfo
+{
+    int width;
+    int height;
+    int channels;
+};
+
+/*
+*   Decode-time downscaling.  JPEG can decode at 1/2, 1/4 or 1/8 resolution straight from the DCT
+*   coefficients, which is much cheaper than decoding everything and blurring most of it away.
+*   The blur is then run at the reduced resolution with a kernel shrunk to match.
+*/
+struct ReducedDecode
+{
+    int denominator;    // decode at 1/denominator resolution: 1, 2, 4 or 8
+    double sigma;       // gaussian standard deviation at the reduced resolution
+    int filterSize;     // filter size at the reduced resolution
+};
+
+//  Pick the reduction allowed by the output scale (output size / input size) and the blur.
+//  keepBorder (the frame is left unblurred) allows none: the frame would come out DCT-scaled.
+ReducedDecode planReducedDecode(double outputScale, double sigma, int filterSize, bool keepBorder);
+
+//  Resize a blurred image to outputScale of the full-size input: moving average when shrinking,
+//  linear when growing (a reduced decode is scaled back up by the same rule)
+void resizeToOutput(cl::CImg<unsigned char>& image, const ImageInfo& fullSize, double outputScale);
+
+/*
+*   Encoder settings.  A preset fills in everything; individual fields can then be overridden.
+*       fast        zlib level 1 with the Up filter, JPEG quality 85
+*       balanced    zlib level 4 choosing Sub/Up/Paeth per row, JPEG quality 90
+*       small       zlib level 9 choosing among all filters per row, JPEG quality 90 with optimized Huffman tables
+*   Large images are cut into strips of rows that are encoded on `threads` threads: PNG strips are
+*   deflated separately and joined into one zlib stream, JPEG strips are joined with restart markers.
+*/
+enum class EncodePreset { Fast, Balanced, Small };
+
+//  PNG row filters, as bits of EncodeOptions::pngFilters
+const int PNG_FILTER_BIT_NONE = 1 << 0;
+const int PNG_FILTER_BIT_SUB = 1 << 1;
+const int PNG_FILTER_BIT_UP = 1 << 2;
+const int PNG_FILTER_BIT_AVERAGE = 1 << 3;
+const int PNG_FILTER_BIT_PAETH = 1 << 4;
+const int PNG_FILTER_BITS_ALL = 0x1F;
+
+struct EncodeOptions
+{
+    int jpegQuality = 90;           // 1 to 100
+    int jpegSubsampling = 420;      // 444, 422 or 420
+    bool jpegOptimize = false;      // optimized Huffman tables (serial only)
+    int pngLevel = 4;               // zlib level 0 to 9
+    int pngFilters = PNG_FILTER_BIT_SUB | PNG_FILTER_BIT_UP | PNG_FILTER_BIT_PAETH;     // candidates, best per row
+    int threads = 1;                // strips encoded in parallel
+};
+
+//  Settings of a preset
+EncodeOptions encodeOptionsForPreset(EncodePreset preset);
+
+//  Preset from its name: fast, balanced or small; false if unknown
+bool presetFromName(const std::string& name, EncodePreset& preset);
+
+//  PNG filter set from a name: none, sub, up, average, paeth or all; 0 if unknown
+int pngFiltersFromName(const std::string& name);
+
+//  Read a whole stream (or file) into memory
+std::vector<unsigned char> readStream(std::FILE *stream);
+std::vector<unsigned char> readFile(const std::string& path);
+
+//  Write a memory buffer to a stream (or file)
+void writeStream(std::FILE *stream, const std::vector<unsigned char>& buffer);
+void writeFile(const std::string& path, const std::vector<unsigned char>& buffer);
+
+//  Whether a codec is built in (libjpeg, libpng, PNM) rather than delegated to CImg
+bool hasNativeCodec(ImageFormat format);
+
+//  Binary PNM (P5 / P6, maxval 255) headers on a stream, for row-by-row processing
+ImageInfo readPnmHeader(std::FILE *stream);
+void writePnmHeader(std::FILE *stream, const ImageInfo& info);
+
+//  Read the dimensions from a header without decoding pixels (JPEG, PNG, PNM)
+bool probeImage(const std::vector<unsigned char>& buffer, ImageFormat format, ImageInfo& info);
+
+//  Decode an in-memory image; Unknown format is detected from the signature.
+//  JPEG honours scaleDenominator (1, 2, 4 or 8), other formats always decode at full resolution.
+cl::CImg<unsigned char> decodeImage(const std::vector<unsigned char>& buffer, ImageFormat format, int scaleDenominator = 1);
+
+//  Encode an image to memory
+std::vector<unsigned char> encodeImage(const cl::CImg<unsigned char>& image, ImageFormat format, const EncodeOptions& options = EncodeOptions());
+
+//  Upper bounds of the memory decoding and encoding hold at their peak, for admitting jobs before
+//  they start: decode counts the encoded input and the decoded image, encode the buffers of the
+//  encoder (not the image).  Incompressible pixels are assumed.
+size_t decodeMemory(size_t encodedBytes, const ImageInfo& decoded, ImageFormat format);
+size_t encodeMemory(const ImageInfo& image, ImageFormat format, const EncodeOptions& options = EncodeOptions());
+
+//  Load from a path, or stdin when path is "-"; an Unknown format is replaced by the detected one,
+//  and stdin's format is always taken from its magic bytes when it has them.
+//  fullSize, when given, receives the full-resolution dimensions even if a reduced decode happened.
+cl::CImg<unsigned char> loadImage(const std::string& path, ImageFormat& format, int scaleDenominator = 1, ImageInfo *fullSize = NULL);
+
+//  Save to a path, or stdout when path is "-"
+void saveImage(const cl::CImg<unsigned char>& image, const std::string& path, ImageFormat format, const EncodeOptions& options = EncodeOptions());
+
+#endif
@@ -0,0 +1,92 @@
+/*
+*   image_view.h
+*   part of image blur software using CUDA
+*   for CSC 630 with Dr. Zhang
+*
+*   This header file contains the definitions for non-owning image views.
+*   A view describes pixels that live somewhere else (a CImg, a memory-mapped file, a caller's
+*   buffer) in the planar layout the blur uses: channel planes, each made of rows.
+*   Nothing is copied or freed through a view.  Samples are 8-bit, so strides in bytes are also
+*   strides in samples.
+*/
+
+#ifndef IMAGE_VIEW_H
+#define IMAGE_VIEW_H
+
+#include <cstddef>
+#include <cstdint>
+
+//  Sample type of the pixels
+enum class PixelType : uint32_t { UInt8 = 1, UInt16 = 2, Float32 = 3 };
+
+//  Bytes per sample of a pixel type
+inline size_t pixelTypeSize(PixelType type)
+{
+    switch (type)
+    {
+        case PixelType::UInt8:   return 1;
+        case PixelType::UInt16:  return 2;
+        case PixelType::Float32: return 4;
+    }
+    return 0;
+}
+
+//  Rows that start on a cache line keep vector loads aligned and rows from sharing a line
+const size_t CACHE_LINE_BYTES = 64;
+
+//  Bytes per row of `rowBytes` samples, padded to a whole number of cache lines
+inline size_t paddedRowStride(size_t rowBytes)
+{
+    return (rowBytes + CACHE_LINE_BYTES - 1) / CACHE_LINE_BYTES * CACHE_LINE_BYTES;
+}
+
+template <typename T>
+struct BasicImageView
+{
+    T *data = nullptr;          // first sample of plane 0, row 0
+    int64_t width = 0;
+    int64_t height = 0;
+    int channels = 0;
+    size_t rowStride = 0;       // bytes from one row to the next
+    size_t planeStride = 0;     // bytes from one channel plane to the next
+
+    BasicImageView() {}
+
+    BasicImageView(T *data, int64_t width, int64_t height, int channels, size_t rowStride, size_t planeStride)
+        : data(data), width(width), height(height), channels(channels), rowStride(rowStride), planeStride(planeStride) {}
+
+    //  A writable view can always be read from
+    template <typename U>
+    BasicImageView(const BasicImageView<U>& other)
+        : data(other.data), width(other.width), height(other.height), channels(other.channels),
+          rowStride(other.rowStride), planeStride(other.planeStride) {}
+
+    //  Row y of channel c
+    T *row(int c, int64_t y) const
+    {
+        return data + c*planeStride + y*rowStride;
+    }
+};
+
+typedef BasicImageView<unsigned char> ImageView;
+typedef BasicImageView<const unsigned char> ConstImageView;
+
+//  View of densely packed planar 8-bit pixels
+inline ImageView packedImageView(unsigned char *data, int64_t width, int64_t height, int channels)
+{
+    return ImageView(data, width, height, channels, width, width * height);
+}
+
+//  View of planar 8-bit pixels with rows padded to cache lines; data needs paddedImageBytes() bytes
+inline ImageView paddedImageView(unsigned char *data, int64_t width, int64_t height, int channels)
+{
+    const size_t rowStride = paddedRowStride(width);
+    return ImageView(data, width, height, channels, rowStride, rowStride * height);
+}
+
+inline size_t paddedImageBytes(int64_t width, int64_t height, int channels)
+{
+    return paddedRowStride(width) * height * channels;
+}
+
+#endif
@@ -0,0 +1,165 @@
+/*
+*   json_writer.cpp
+*   part of image blur software using CUDA
+*   for CSC 630 with Dr. Zhang
+*
+*   This program implements the streaming JSON writer.
+*/
+
+#include "json_writer.h"
+#include <cmath>
+#include <cstdio>
+
+void JsonWriter::separate()
+{
+    if ( _afterKey )
+    {
+        _afterKey = false;
+        return;
+    }
+    if ( _empty.empty() )
+    {
+        return;
+    }
+    if ( !_empty.back() )
+    {
+        _out << ",";
+    }
+    _empty.back() = false;
+    if ( _pretty )
+    {
+        _out << "\n" << std::string(2 * _empty.size(), ' ');
+    }
+}
+
+void JsonWriter::close(char bracket)
+{
+    const bool empty = _empty.back();
+    _empty.pop_back();
+    if ( _pretty && !empty )
+    {
+        _out << "\n" << std::string(2 * _empty.size(), ' ');
+    }
+    _out << bracket;
+    if ( _empty.empty() && _pretty )
+    {
+        _out << "\n";
+    }
+}
+
+JsonWriter& JsonWriter::beginObject()
+{
+    separate();
+    _out << "{";
+    _empty.push_back(true);
+    return *this;
+}
+
+JsonWriter& JsonWriter::endObject()
+{
+    close('}');
+    return *this;
+}
+
+JsonWriter& JsonWriter::beginArray()
+{
+    separate();
+    _out << "[";
+    _empty.push_back(true);
+    return *this;
+}
+
+JsonWriter& JsonWriter::endArray()
+{
+    close(']');
+    return *this;
+}
+
+JsonWriter& JsonWriter::key(const std::string& name)
+{
+    separate();
+    _out << quote(name) << (_pretty ? ": " : ":");
+    _afterKey = true;
+    return *this;
+}
+
+JsonWriter& JsonWriter::value(const std::string& text)
+{
+    separate();
+    _out << quote(text);
+    return *this;
+}
+
+JsonWriter& JsonWriter::value(const char *text)
+{
+    return value(std::string(text ? text : ""));
+}
+
+JsonWriter& JsonWriter::value(double number)
+{
+    if ( !std::isfinite(number) )
+    {
+        return null();
+    }
+    separate();
+    char buffer[32];
+    std::snprintf(buffer, sizeof(buffer), "%.12g", number);
+    _out << buffer;
+    return *this;
+}
+
+JsonWriter& JsonWriter::value(int64_t number)
+{
+    separate();
+    _out << number;
+    return *this;
+}
+
+JsonWriter& JsonWriter::value(uint64_t number)
+{
+    separate();
+    _out << number;
+    return *this;
+}
+
+JsonWriter& JsonWriter::value(bool flag)
+{
+    separate();
+    _out << (flag ? "true" : "false");
+    return *this;
+}
+
+JsonWriter& JsonWriter::null()
+{
+    separate();
+    _out << "null";
+    return *this;
+}
+
+std::string JsonWriter::quote(const std::string& text)
+{
+    std::string quoted = "\"";
+    for (unsigned char c : text)
+    {
+        switch (c)
+        {
+            case '"':  quoted += "\\\""; break;
+            case '\\': quoted += "\\\\"; break;
+            case '\n': quoted += "\\n"; break;
+            case '\r': quoted += "\\r"; break;
+            case '\t': quoted += "\\t"; break;
+            default:
+                if ( c < 0x20 )
+                {
+                    char escape[8];
+                    std::snprintf(escape, sizeof(escape), "\\u%04x", c);
+                    quoted += escape;
+                }
+                else
+                {
+                    quoted += (char)c;
+                }
+        }
+    }
+    return quoted + "\"";
+}
@@ -0,0 +1,60 @@
+/*
+*   json_writer.h
+*   part of image blur software using CUDA
+*   for CSC 630 with Dr. Zhang
+*
+*   This header file contains the definitions for a small streaming JSON writer.
+*   Benchmarks and reports are written as JSON so they can be compared between releases; this
+*   writer takes care of commas, indentation and string escaping so callers only say what goes where:
+*       JsonWriter json(out);
+*       json.beginObject().field("engine", "tiled").key("times").beginArray().value(1.5).endArray().endObject();
+*/
+
+#ifndef JSON_WRITER_H
+#define JSON_WRITER_H
+
+#include <cstdint>
+#include <ostream>
+#include <string>
+#include <vector>
+
+class JsonWriter
+{
+public:
+    //  pretty puts every member and element on its own indented line
+    explicit JsonWriter(std::ostream& out, bool pretty = true) : _out(out), _pretty(pretty), _afterKey(false) {}
+
+    JsonWriter& beginObject();
+    JsonWriter& endObject();
+    JsonWriter& beginArray();
+    JsonWriter& endArray();
+
+    //  Member name; the next value or container is its value
+    JsonWriter& key(const std::string& name);
+
+    JsonWriter& value(const std::string& text);
+    JsonWriter& value(const char *text);
+    JsonWriter& value(double number);           // NaN and infinities become null
+    JsonWriter& value(int64_t number);
+    JsonWriter& value(uint64_t number);
+    JsonWriter& value(int number) { return value((int64_t)number); }
+    JsonWriter& value(bool flag);
+    JsonWriter& null();
+
+    template <typename T>
+    JsonWriter& field(const std::string& name, const T& v) { key(name); return value(v); }
+
+    //  Quoted and escaped JSON string
+    static std::string quote(const std::string& text);
+
+private:
+    void separate();            // comma and newline before a member or element
+    void close(char bracket);
+
+    std::ostream& _out;
+    bool _pretty;
+    bool _afterKey;
+    std::vector<bool> _empty;   // per open container: nothing written in it yet
+};
+
+#endif
@@ -0,0 +1,227 @@
+/*
+*   large_image.cpp
+*   part of image blur software using CUDA
+*   for CSC 630 with Dr. Zhang
+*
+*   This program checks blurs of images with more than 2^31 samples, where any 32-bit index or
+*   size in the blur paths would wrap.  `make test-large` runs it around blur.exe.
+*   --create writes a sparse raw planar image, 65536x32769 single-channel by default (2^31 + 65536
+*   samples): zero everywhere except noise in a few windows at the corners, at the edges, and
+*   across sample 2^31.  blur.exe then blurs it from one memory mapping into the other with the
+*   tiled engine.  --check cuts each window out of the input with a filter-size margin, blurs it
+*   with the sequential engine, and compares the result with the same window of the output.
+*
+*   Command-line arguments:
+*         option            input           description
+*       --create            path            write the sparse test image
+*       --check             input output    compare the windows of a blurred image
+*       --width             pixels          width of the test image
+*       --height            pixels          height of the test image
+*       --channels          count           channels of the test image
+*       --filtersize, -f    integer         filter size the image was blurred with
+*       --sigma, -s         std deviation   sigma the image was blurred with
+*       --border            keep, clamp...  border mode the image was blurred with
+*       --help, -h          none            display help for this program
+*
+*   Running the program:
+*       ./large_image.exe --create large_in.raw
+*       ./blur.exe -i large_in.raw -o large_out.raw --tiled --max-memory 64M -t 4
+*       ./large_image.exe --check large_in.raw large_out.raw
+*/
+
+#include "boost/program_options.hpp"
+#include "libblur.h"
+#include "raw_planar.h"
+#include <algorithm>
+#include <iostream>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+namespace
+{
+    const size_t ERROR_IN_COMMAND_LINE = 1;
+    const size_t SUCCESS = 0;
+    const size_t ERROR_UNHANDLED_EXCEPTION = 2;
+    const size_t ERROR_MISMATCH = 3;
+
+    //  Edge of the checked windows, in pixels
+    const int64_t WINDOW_EDGE = 256;
+} // namespace
+
+struct Window
+{
+    const char *name;
+    int64_t col, row;
+};
+
+//  Windows of a width x height image, each WINDOW_EDGE square and inside the image
+static std::vector<Window> testWindows(int64_t width, int64_t height)
+{
+    const int64_t boundaryRow = ( int64_t(1) << 31 ) / width;
+    std::vector<Window> windows = {
+        { "top left", 0, 0 },
+        { "across sample 2^31", 0, boundaryRow - WINDOW_EDGE / 2 },
+        { "right edge", width - WINDOW_EDGE, height / 4 },
+        { "zeros", width / 3, height / 3 },
+        { "bottom right", width - WINDOW_EDGE, height - WINDOW_EDGE },
+    };
+    for (Window& window : windows)
+    {
+        window.col = std::min(std::max<int64_t>(0, window.col), std::max<int64_t>(0, width - WINDOW_EDGE));
+        window.row = std::min(std::max<int64_t>(0, window.row), std::max<int64_t>(0, height - WINDOW_EDGE));
+    }
+    return windows;
+}
+
+//  Noise inside the windows with a margin of `margin` pixels; the rest of the file stays a hole
+static void createImage(const std::string& path, int64_t width, int64_t height, int channels, int64_t margin)
+{
+    MappedImage image = MappedImage::create(path, makeRawPlanarHeader(width, height, channels, PixelType::UInt8));
+    const RawPlanarHeader& header = image.header();
+    uint32_t seed = 1;
+    for (const Window& window : testWindows(width, height))
+    {
+        if ( std::string(window.name) == "zeros" )
+        {
+            continue;
+        }
+        for (int c = 0; c < channels; c++)
+        {
+            for (int64_t row = std::max<int64_t>(0, window.row - margin); row < std::min(height, window.row + WINDOW_EDGE + margin); row++)
+            {
+                unsigned char *pixels = image.pixels() + c * header.planeStride + row * header.rowStride;
+                for (int64_t col = std::max<int64_t>(0, window.col - margin); col < std::min(width, window.col + WINDOW_EDGE + margin); col++)
+                {
+                    seed = seed * 1103515245u + 12345u;
+                    pixels[col] = (unsigned char)(seed >> 24);
+                }
+            }
+        }
+    }
+    std::cout << "Wrote " << width << "x" << height << "x" << channels << " (" << width * height * channels
+              << " samples) to " << path << std::endl;
+}
+
+//  Mismatched pixels over all the windows
+static int64_t checkImage(const std::string& inputPath, const std::string& outputPath, blur_params params)
+{
+    MappedImage input = MappedImage::open(inputPath), output = MappedImage::open(outputPath);
+    const RawPlanarHeader& in = input.header();
+    const RawPlanarHeader& out = output.header();
+    if ( in.width != out.width || in.height != out.height || in.channels != out.channels )
+    {
+        throw std::runtime_error("input and output shapes differ");
+    }
+    const int64_t width = in.width, height = in.height;
+    const int channels = (int)in.channels;
+    const int64_t margin = params.filter_size;
+    params.engine = BLUR_ENGINE_SEQUENTIAL;
+    params.threads = 1;
+
+    int64_t mismatches = 0;
+    for (const Window& window : testWindows(width, height))
+    {
+        //  The window with its margin, cut at the image's edges: its own edges then blur as the image's do
+        const int64_t left = std::max<int64_t>(0, window.col - margin), top = std::max<int64_t>(0, window.row - margin);
+        const int64_t right = std::min(width, window.col + WINDOW_EDGE + margin), bottom = std::min(height, window.row + WINDOW_EDGE + margin);
+        const blur_image src = { input.pixels() + top * in.rowStride + left, right - left, bottom - top, channels,
+                                 (size_t)in.rowStride, (size_t)in.planeStride };
+        std::vector<unsigned char> expected((size_t)( right - left ) * ( bottom - top ) * channels);
+        const blur_image dst = blur_image_packed(expected.data(), right - left, bottom - top, channels);
+        if ( blur_image_into(&src, &dst, &params) != BLUR_OK )
+        {
+            throw std::runtime_error(std::string("direct blur failed: ") + blur_last_error());
+        }
+
+        int64_t windowMismatches = 0;
+        for (int c = 0; c < channels; c++)
+        {
+            for (int64_t row = window.row; row < std::min(height, window.row + WINDOW_EDGE); row++)
+            {
+                const unsigned char *blurred = output.pixels() + c * out.planeStride + row * out.rowStride;
+                const unsigned char *reference = dst.data + c * dst.plane_stride + ( row - top ) * dst.row_stride - left;
+                for (int64_t col = window.col; col < std::min(width, window.col + WINDOW_EDGE); col++)
+                {
+                    windowMismatches += blurred[col] != reference[col];
+                }
+            }
+        }
+        std::cout << ( windowMismatches ? "  FAIL  " : "  pass  " ) << window.name << " at (" << window.col << ", "
+                  << window.row << "): " << windowMismatches << " mismatched samples" << std::endl;
+        mismatches += windowMismatches;
+    }
+    return mismatches;
+}
+
+int main(int argc, char** argv)
+{
+    try
+    {
+        std::string createPath, borderName;
+        std::vector<std::string> checkPaths;
+        int64_t width, height;
+        int channels;
+        blur_params params;
+        blur_params_default(&params);
+        namespace po = boost::program_options;
+        po::options_description desc("Options");
+        desc.add_options()
+            ("help,h", "Print help messages")
+            ("create", po::value(&createPath), "Write the sparse test image to this raw planar path.")
+            ("check", po::value(&checkPaths) -> multitoken(), "Input and output raw planar paths: compare the windows of the blurred output with the sequential engine.")
+            ("width", po::value(&width) -> default_value(65536), "Width of the test image.")
+            ("height", po::value(&height) -> default_value(32769), "Height of the test image.")
+            ("channels", po::value(&channels) -> default_value(1), "Channels of the test image.")
+            ("filtersize,f", po::value(&params.filter_size) -> default_value(1), "Filter size the image was blurred with.")
+            ("sigma,s", po::value(&params.sigma) -> default_value(1.0), "Standard deviation the image was blurred with.")
+            ("border", po::value(&borderName) -> default_value("keep"), "Border mode the image was blurred with: keep, clamp or mirror.");
+
+        po::variables_map vm;
+        try
+        {
+            po::store(po::parse_command_line(argc, argv, desc), vm);
+            if ( vm.count("help") )
+            {
+                std::cout << "Create and check a blur of an image with more than 2^31 samples." << std::endl << desc << std::endl;
+                return SUCCESS;
+            }
+            po::notify(vm);
+        }
+        catch(po::error& e)
+        {
+            std::cerr << "ERROR: " << e.what() << std::endl << std::endl << desc << std::endl;
+            return ERROR_IN_COMMAND_LINE;
+        }
+
+        if ( createPath.empty() == checkPaths.empty() || ( !checkPaths.empty() && checkPaths.size() != 2 ) ||
+             width < 1 || height < 1 || channels < 1 || params.filter_size < 1 || params.sigma <= 0.0 )
+        {
+            std::cerr << "ERROR: Give --create or --check with two paths, and a positive shape, filter size and sigma. Exit with code "
+                      << ERROR_IN_COMMAND_LINE << "." << std::endl;
+            return ERROR_IN_COMMAND_LINE;
+        }
+        if ( borderName == "keep" ) params.border = BLUR_BORDER_KEEP;
+        else if ( borderName == "clamp" ) params.border = BLUR_BORDER_CLAMP;
+        else if ( borderName == "mirror" ) params.border = BLUR_BORDER_MIRROR;
+        else
+        {
+            std::cerr << "ERROR: Unknown border " << borderName << ". Exit with code " << ERROR_IN_COMMAND_LINE << "." << std::endl;
+            return ERROR_IN_COMMAND_LINE;
+        }
+
+        if ( !createPath.empty() )
+        {
+            createImage(createPath, width, height, channels, params.filter_size);
+            return SUCCESS;
+        }
+        const int64_t mismatches = checkImage(checkPaths[0], checkPaths[1], params);
+        std::cout << mismatches << " mismatched samples" << std::endl;
+        return mismatches == 0 ? SUCCESS : ERROR_MISMATCH;
+    }
+    catch(std::exception& e)
+    {
+        std::cerr << "Unhandled Exception reached the top of main: " << e.what() << ", application will now exit" << std::endl;
+        return ERROR_UNHANDLED_EXCEPTION;
+    }
+}
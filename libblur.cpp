@@ -0,0 +1,370 @@
+/*
+*   libblur.cpp
+*   part of image blur software using CUDA
+*   for CSC 630 with Dr. Zhang
+*
+*   This program implements the C interface of libblur on top of blur plans.
+*   Exceptions never cross the interface: they become status codes and a per-thread message.
+*/
+
+#include "libblur.h"
+#include "blur_engines.h"
+#include "blur_plan.h"
+#include "blur_tune.h"
+#include "stage_timings.h"
+#include <algorithm>
+#include <exception>
+#include <new>
+#include <stdexcept>
+#include <string>
+
+struct blur_plan
+{
+    BlurPlan plan;
+};
+
+//  Message of the last failure on this thread
+static thread_local std::string lastError;
+
+//  Run body, turning whatever it throws into a status
+template <typename Body>
+static blur_status guarded(Body body)
+{
+    try
+    {
+        body();
+        return BLUR_OK;
+    }
+    catch (std::invalid_argument& e)
+    {
+        lastError = e.what();
+        return BLUR_ERROR_INVALID_ARGUMENT;
+    }
+    catch (std::bad_alloc& e)
+    {
+        lastError = "out of memory";
+        return BLUR_ERROR_OUT_OF_MEMORY;
+    }
+    catch (UnsupportedError& e)
+    {
+        lastError = e.what();
+        return BLUR_ERROR_UNSUPPORTED;
+    }
+    catch (std::runtime_error& e)
+    {
+        lastError = e.what();
+        return BLUR_ERROR_ENGINE;
+    }
+    catch (std::exception& e)
+    {
+        lastError = e.what();
+        return BLUR_ERROR_INTERNAL;
+    }
+    catch (...)
+    {
+        lastError = "unknown error";
+        return BLUR_ERROR_INTERNAL;
+    }
+}
+
+static ConstImageView constView(const blur_image& image)
+{
+    return ConstImageView(image.data, image.width, image.height, image.channels, image.row_stride, image.plane_stride);
+}
+
+static ImageView view(const blur_image& image)
+{
+    return ImageView(image.data, image.width, image.height, image.channels, image.row_stride, image.plane_stride);
+}
+
+static BorderMode borderMode(blur_border_mode border)
+{
+    const BorderMode borders[] = { BorderMode::Keep, BorderMode::Clamp, BorderMode::Mirror };
+    return borders[border];
+}
+
+//  Plan options from C params; throws invalid_argument on bad params
+static BlurPlanOptions optionsFromParams(const blur_params *params)
+{
+    if ( !params )
+    {
+        throw std::invalid_argument("null params");
+    }
+    if ( params->border < BLUR_BORDER_KEEP || params->border > BLUR_BORDER_MIRROR ||
+         params->engine < BLUR_ENGINE_AUTO || params->engine > BLUR_ENGINE_CUDA || params->threads < 0 )
+    {
+        throw std::invalid_argument("unknown engine or border, or negative threads");
+    }
+
+    BlurPlanOptions options;
+    options.filterSize = params->filter_size;
+    options.cuda = params->engine == BLUR_ENGINE_CUDA;
+    options.tiled = params->engine == BLUR_ENGINE_TILED;
+    if ( params->engine == BLUR_ENGINE_TILED || params->engine == BLUR_ENGINE_AUTO )
+    {
+        options.tiling.threads = std::max(1, params->threads);
+        options.tiling.maxMemory = params->max_memory;
+        options.tiling.tileSize = params->tile_size;
+    }
+    return options;
+}
+
+static BlurPlan planFromParams(int64_t width, int64_t height, int channels, const blur_params *params)
+{
+    const BlurPlanOptions options = optionsFromParams(params);
+    return make_blur_plan(width, height, channels, PixelType::UInt8, params->sigma, borderMode(params->border), options);
+}
+
+extern "C" {
+
+void blur_params_default(blur_params *params)
+{
+    if ( !params )
+    {
+        return;
+    }
+    params->filter_size = 1;
+    params->sigma = 1.0;
+    params->engine = BLUR_ENGINE_AUTO;
+    params->border = BLUR_BORDER_KEEP;
+    params->threads = 1;
+    params->max_memory = 0;
+    params->tile_size = 0;
+}
+
+blur_image blur_image_packed(unsigned char *data, int64_t width, int64_t height, int channels)
+{
+    blur_image image = { data, width, height, channels, (size_t)width, (size_t)width * height };
+    return image;
+}
+
+blur_image blur_image_padded(unsigned char *data, int64_t width, int64_t height, int channels)
+{
+    const ImageView padded = paddedImageView(data, width, height, channels);
+    blur_image image = { data, width, height, channels, padded.rowStride, padded.planeStride };
+    return image;
+}
+
+size_t blur_image_padded_bytes(int64_t width, int64_t height, int channels)
+{
+    return paddedImageBytes(width, height, channels);
+}
+
+blur_status blur_plan_create(blur_plan **plan, int64_t width, int64_t height, int channels, const blur_params *params)
+{
+    if ( !plan )
+    {
+        lastError = "blur_plan_create(): null plan";
+        return BLUR_ERROR_INVALID_ARGUMENT;
+    }
+    *plan = NULL;
+    return guarded([&]()
+    {
+        *plan = new blur_plan{ planFromParams(width, height, channels, params) };
+    });
+}
+
+blur_status blur_plan_memory(size_t *bytes, int64_t width, int64_t height, int channels, const blur_params *params)
+{
+    if ( !bytes )
+    {
+        lastError = "blur_plan_memory(): null bytes";
+        return BLUR_ERROR_INVALID_ARGUMENT;
+    }
+    *bytes = 0;
+    return guarded([&]()
+    {
+        if ( width < 1 || height < 1 || channels < 1 || !params || params->sigma <= 0.0 || params->filter_size < 0 )
+        {
+            throw std::invalid_argument("blur_plan_memory(): bad image shape, sigma or filter size");
+        }
+        *bytes = planMemory(width, height, params->sigma, optionsFromParams(params));
+    });
+}
+
+blur_status blur_plan_execute(blur_plan *plan, const blur_image *src, const blur_image *dst)
+{
+    if ( !plan || !src || !dst || !src->data || !dst->data )
+    {
+        lastError = "blur_plan_execute(): null plan or image";
+        return BLUR_ERROR_INVALID_ARGUMENT;
+    }
+    return guarded([&]()
+    {
+        execute(plan->plan, constView(*src), view(*dst));
+    });
+}
+
+blur_engine blur_plan_engine(const blur_plan *plan)
+{
+    if ( !plan )
+    {
+        return BLUR_ENGINE_AUTO;
+    }
+    switch (plan->plan.engine)
+    {
+        case BlurEngine::Sequential: return BLUR_ENGINE_SEQUENTIAL;
+        case BlurEngine::Tiled:      return BLUR_ENGINE_TILED;
+        case BlurEngine::Cuda:       return BLUR_ENGINE_CUDA;
+    }
+    return BLUR_ENGINE_AUTO;
+}
+
+int blur_engine_available(blur_engine engine)
+{
+    switch (engine)
+    {
+        case BLUR_ENGINE_AUTO:          return 1;
+        case BLUR_ENGINE_SEQUENTIAL:    return findEngine(BlurEngine::Sequential) != nullptr;
+        case BLUR_ENGINE_TILED:         return findEngine(BlurEngine::Tiled) != nullptr;
+        case BLUR_ENGINE_CUDA:          return findEngine(BlurEngine::Cuda) != nullptr;
+    }
+    return 0;
+}
+
+blur_status blur_tune(blur_params *params, int64_t width, int64_t height, int channels,
+                      const char *profile_path, int *measured)
+{
+    if ( !params || params->border < BLUR_BORDER_KEEP || params->border > BLUR_BORDER_MIRROR )
+    {
+        lastError = "blur_tune(): null params or unknown border";
+        return BLUR_ERROR_INVALID_ARGUMENT;
+    }
+    return guarded([&]()
+    {
+        if ( width < 1 || height < 1 || channels < 1 || params->sigma <= 0.0 )
+        {
+            throw std::invalid_argument("blur_tune(): bad image shape or sigma");
+        }
+        const TuneChoice choice = tuneEngine(width, height, channels, params->sigma, params->filter_size,
+                                             borderMode(params->border), std::max(1, params->threads), params->max_memory,
+                                             profile_path ? profile_path : defaultTuningProfilePath());
+        switch (choice.engine)
+        {
+            case BlurEngine::Sequential: params->engine = BLUR_ENGINE_SEQUENTIAL; break;
+            case BlurEngine::Tiled:      params->engine = BLUR_ENGINE_TILED; break;
+            case BlurEngine::Cuda:       params->engine = BLUR_ENGINE_CUDA; break;
+        }
+        params->threads = choice.threads;
+        params->tile_size = choice.tileSize;
+        if ( measured )
+        {
+            *measured = choice.fromProfile ? 0 : 1;
+        }
+    });
+}
+
+void blur_plan_destroy(blur_plan *plan)
+{
+    delete plan;
+}
+
+blur_status blur_image_into(const blur_image *src, const blur_image *dst, const blur_params *params)
+{
+    if ( !src || !dst || !src->data || !dst->data )
+    {
+        lastError = "blur_image_into(): null image";
+        return BLUR_ERROR_INVALID_ARGUMENT;
+    }
+    //  The plan lives on the stack and its buffers go back to the pool, so nothing is left on the heap
+    return guarded([&]()
+    {
+        BlurPlan plan = planFromParams(src->width, src->height, src->channels, params);
+        execute(plan, constView(*src), view(*dst));
+    });
+}
+
+void blur_pool_stats(blur_pool_counters *counters)
+{
+    if ( !counters )
+    {
+        return;
+    }
+    const PoolCounters pool = bufferPool().counters();
+    counters->heap_allocations = pool.heapAllocations;
+    counters->heap_bytes = pool.heapBytes;
+    counters->reused_allocations = pool.reusedAllocations;
+    counters->reused_bytes = pool.reusedBytes;
+    counters->cached_bytes = pool.cachedBytes;
+    counters->huge_page_bytes = pool.hugePageBytes;
+}
+
+void blur_pool_trim(void)
+{
+    bufferPool().trim();
+}
+
+blur_status blur_pool_set_huge_pages(blur_huge_pages mode)
+{
+    const HugePages modes[] = { HugePages::Off, HugePages::Transparent, HugePages::Explicit };
+    if ( mode < BLUR_HUGE_PAGES_OFF || mode > BLUR_HUGE_PAGES_EXPLICIT )
+    {
+        lastError = "blur_pool_set_huge_pages(): unknown mode";
+        return BLUR_ERROR_INVALID_ARGUMENT;
+    }
+    bufferPool().setHugePages(modes[mode]);
+    return BLUR_OK;
+}
+
+int blur_advise_huge_pages(void *data, size_t bytes)
+{
+    return data && adviseHugePages(data, bytes) ? 1 : 0;
+}
+
+void blur_timings_start(void)
+{
+    static thread_local StageTimings timings;
+    timings.clear();
+    setThreadStageTimings(&timings);
+}
+
+size_t blur_timings_stop(blur_stage_time *times, size_t capacity)
+{
+    StageTimings *timings = threadStageTimings();
+    setThreadStageTimings(nullptr);
+    if ( !timings )
+    {
+        return 0;
+    }
+    const std::vector<StageTiming>& entries = timings->entries();
+    for (size_t i = 0; times && i < std::min(capacity, entries.size()); i++)
+    {
+        times[i].stage = entries[i].stage;
+        times[i].channel = entries[i].channel;
+        times[i].microseconds = entries[i].microseconds;
+    }
+    return entries.size();
+}
+
+const char *blur_status_string(blur_status status)
+{
+    switch (status)
+    {
+        case BLUR_OK:                       return "ok";
+        case BLUR_ERROR_INVALID_ARGUMENT:   return "invalid argument";
+        case BLUR_ERROR_OUT_OF_MEMORY:      return "out of memory";
+        case BLUR_ERROR_UNSUPPORTED:        return "unsupported";
+        case BLUR_ERROR_ENGINE:             return "engine error";
+        case BLUR_ERROR_INTERNAL:           return "internal error";
+    }
+    return "unknown status";
+}
+
+const char *blur_engine_string(blur_engine engine)
+{
+    switch (engine)
+    {
+        case BLUR_ENGINE_AUTO:          return "auto";
+        case BLUR_ENGINE_SEQUENTIAL:    return "sequential";
+        case BLUR_ENGINE_TILED:         return "tiled";
+        case BLUR_ENGINE_CUDA:          return "cuda";
+    }
+    return "unknown";
+}
+
+const char *blur_last_error(void)
+{
+    return lastError.c_str();
+}
+
+}   // extern "C"
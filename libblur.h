@@ -0,0 +1,183 @@
+/*
+*   libblur.h
+*   part of image blur software using CUDA
+*   for CSC 630 with Dr. Zhang
+*
+*   This header file is the C interface of libblur (libblur.a / libblur.so).
+*   It blurs 8-bit planar images in caller-owned buffers.  Nothing is printed: every function
+*   returns a status, and blur_last_error() describes the last failure on the calling thread.
+*
+*   Usage:
+*       blur_params params;
+*       blur_params_default(&params);
+*       params.sigma = 2.0;
+*       blur_plan *plan;
+*       if ( blur_plan_create(&plan, width, height, channels, &params) == BLUR_OK )
+*       {
+*           for each frame: blur_plan_execute(plan, &src, &dst);
+*           blur_plan_destroy(plan);
+*       }
+*/
+
+#ifndef LIBBLUR_H
+#define LIBBLUR_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define BLUR_API_VERSION 5
+
+typedef enum
+{
+    BLUR_OK = 0,
+    BLUR_ERROR_INVALID_ARGUMENT = 1,    /* null pointer, bad shape, or images that don't match the plan */
+    BLUR_ERROR_OUT_OF_MEMORY = 2,
+    BLUR_ERROR_UNSUPPORTED = 3,         /* e.g. an engine this build doesn't have */
+    BLUR_ERROR_ENGINE = 4,              /* the engine failed, e.g. a CUDA error */
+    BLUR_ERROR_INTERNAL = 5
+} blur_status;
+
+typedef enum
+{
+    BLUR_ENGINE_AUTO = 0,               /* tiled when threads > 1, sequential otherwise; see blur_tune() */
+    BLUR_ENGINE_SEQUENTIAL = 1,
+    BLUR_ENGINE_TILED = 2,
+    BLUR_ENGINE_CUDA = 3
+} blur_engine;
+
+typedef enum
+{
+    BLUR_BORDER_KEEP = 0,               /* pixels within filter_size of the edge are copied unblurred */
+    BLUR_BORDER_CLAMP = 1,              /* edge pixels are repeated outwards */
+    BLUR_BORDER_MIRROR = 2              /* the image is reflected about its edge pixels */
+} blur_border_mode;
+
+typedef enum
+{
+    BLUR_HUGE_PAGES_OFF = 0,
+    BLUR_HUGE_PAGES_TRANSPARENT = 1,    /* madvise(MADV_HUGEPAGE), used when the kernel has huge pages */
+    BLUR_HUGE_PAGES_EXPLICIT = 2        /* MAP_HUGETLB from vm.nr_hugepages, transparent when none are free */
+} blur_huge_pages;
+
+/* Planar 8-bit pixels: channel planes of rows.  Strides are in bytes. */
+typedef struct
+{
+    unsigned char *data;
+    int64_t width;
+    int64_t height;
+    int channels;
+    size_t row_stride;
+    size_t plane_stride;
+} blur_image;
+
+typedef struct
+{
+    int filter_size;                    /* filter radius, 1 for 3x3; 0 picks ceil(3 * sigma) */
+    double sigma;                       /* gaussian standard deviation in pixels */
+    blur_engine engine;
+    blur_border_mode border;
+    int threads;                        /* worker threads of the tiled engine */
+    size_t max_memory;                  /* tiled engine: bytes of tile buffers in flight, 0 for no limit */
+    int tile_size;                      /* tiled engine: tile edge in pixels, 0 to choose */
+} blur_params;
+
+/* What the buffer pool behind plans and scratch has done in this process */
+typedef struct
+{
+    uint64_t heap_allocations;          /* buffers that had to come from the heap */
+    uint64_t heap_bytes;
+    uint64_t reused_allocations;        /* requests served from buffers already held: allocations avoided */
+    uint64_t reused_bytes;
+    uint64_t cached_bytes;              /* held for reuse right now */
+    uint64_t huge_page_bytes;           /* allocated with huge pages */
+} blur_pool_counters;
+
+/* Time of one stage of a blur, e.g. "kernel", "copy", "convolution" or "border" */
+typedef struct
+{
+    const char *stage;                  /* static string, valid for the life of the process */
+    int channel;                        /* -1 when the stage covers every channel */
+    double microseconds;                /* monotonic clock */
+} blur_stage_time;
+
+/* Opaque plan: filter, engine, tiling and scratch for one image shape */
+typedef struct blur_plan blur_plan;
+
+/* filter_size 1, sigma 1.0, auto engine, keep border, 1 thread */
+void blur_params_default(blur_params *params);
+
+/* Describe a densely packed planar image */
+blur_image blur_image_packed(unsigned char *data, int64_t width, int64_t height, int channels);
+
+/* Describe a planar image whose rows are padded to 64-byte cache lines, which the blur loops read
+   faster; data needs blur_image_padded_bytes() bytes and should be 64-byte aligned */
+blur_image blur_image_padded(unsigned char *data, int64_t width, int64_t height, int channels);
+size_t blur_image_padded_bytes(int64_t width, int64_t height, int channels);
+
+/* Plan blurs of width x height x channels images; *plan is NULL on failure */
+blur_status blur_plan_create(blur_plan **plan, int64_t width, int64_t height, int channels, const blur_params *params);
+
+/* Host memory blur_plan_create() would take for the same arguments (filter and tile scratch, in
+   the pool's power-of-two size classes), worked out without allocating it; with the caller's
+   source and destination images this is what a blur needs.  The CUDA engine also takes two
+   planes of device memory. */
+blur_status blur_plan_memory(size_t *bytes, int64_t width, int64_t height, int channels, const blur_params *params);
+
+/* Blur src into dst (src is only read; the two must not overlap).  A plan must not be executed
+   from two threads at once. */
+blur_status blur_plan_execute(blur_plan *plan, const blur_image *src, const blur_image *dst);
+
+/* Engine the plan chose */
+blur_engine blur_plan_engine(const blur_plan *plan);
+
+/* 1 if this build has the engine (cuda needs a USE_CUDA=1 build); AUTO always is */
+int blur_engine_available(blur_engine engine);
+
+/* Autotune params->engine, threads and tile_size for width x height x channels images with its
+   sigma, filter size and border.  The choice comes from the tuning profile at profile_path (NULL
+   for ~/.cache/cuda-blur/tuning.profile) when this host has tuned the image class before;
+   otherwise every engine and a few tile and thread settings (up to params->threads) are timed on
+   a synthetic sample, and the winner is saved there.  *measured, if given, is 1 when timing ran. */
+blur_status blur_tune(blur_params *params, int64_t width, int64_t height, int channels,
+                      const char *profile_path, int *measured);
+
+/* Free a plan; NULL is ignored */
+void blur_plan_destroy(blur_plan *plan);
+
+/* One-off blur: create, execute and destroy a plan.  Its buffers come back from the pool on the
+   next call, so a batch of same-shaped images allocates nothing after the first. */
+blur_status blur_image_into(const blur_image *src, const blur_image *dst, const blur_params *params);
+
+/* Buffer pool counters; blur_pool_trim() frees the buffers held for reuse */
+void blur_pool_stats(blur_pool_counters *counters);
+void blur_pool_trim(void);
+
+/* Huge pages for pool buffers of 2MB and up allocated from now on (off by default) */
+blur_status blur_pool_set_huge_pages(blur_huge_pages mode);
+
+/* Ask for huge pages on a caller buffer that hasn't been written yet, e.g. an output image;
+   does nothing while huge pages are off.  Returns 1 if any range was advised. */
+int blur_advise_huge_pages(void *data, size_t bytes);
+
+/* Record the stages of blurs on this thread (plan creation included) until blur_timings_stop(),
+   which copies up to capacity of them into times and returns how many were recorded.  Blurs on
+   threads that aren't recording measure nothing. */
+void blur_timings_start(void);
+size_t blur_timings_stop(blur_stage_time *times, size_t capacity);
+
+/* Name of a status or engine */
+const char *blur_status_string(blur_status status);
+const char *blur_engine_string(blur_engine engine);
+
+/* Message of the last failed call on this thread, "" if none */
+const char *blur_last_error(void);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -0,0 +1,163 @@
+/*
+*   logging.cpp
+*   part of image blur software using CUDA
+*   for CSC 630 with Dr. Zhang
+*
+*   This program implements leveled logging with an optional background writer.
+*/
+
+#include "logging.h"
+#include <condition_variable>
+#include <deque>
+#include <iostream>
+#include <mutex>
+#include <thread>
+
+std::atomic<int> logLevel((int)LogLevel::Info);
+
+void setLogLevel(LogLevel level)
+{
+    logLevel.store((int)level, std::memory_order_relaxed);
+}
+
+bool logLevelFromName(const std::string& name, LogLevel& level)
+{
+    static const char *names[] = { "trace", "debug", "info", "warn", "error", "off" };
+    for (int i = 0; i <= (int)LogLevel::Off; i++)
+    {
+        if ( name == names[i] )
+        {
+            level = (LogLevel)i;
+            return true;
+        }
+    }
+    return false;
+}
+
+static const char *levelPrefix(LogLevel level)
+{
+    switch (level)
+    {
+        case LogLevel::Trace: return "TRACE: ";
+        case LogLevel::Debug: return "DEBUG: ";
+        case LogLevel::Info:  return "INFO: ";
+        case LogLevel::Warn:  return "WARNING: ";
+        case LogLevel::Error: return "ERROR: ";
+        case LogLevel::Off:   break;
+    }
+    return "";
+}
+
+namespace
+{
+    //  Messages are written whole under _writeLock so lines from different threads don't interleave;
+    //  in async mode callers only append to _queue and the writer thread drains it.
+    class LogSink
+    {
+    public:
+        ~LogSink()
+        {
+            setAsync(false);
+        }
+
+        void setAsync(bool async)
+        {
+            std::unique_lock<std::mutex> lock(_queueLock);
+            if ( async == _writer.joinable() )
+            {
+                return;
+            }
+            if ( async )
+            {
+                _stopping = false;
+                _writer = std::thread(&LogSink::drain, this);
+                return;
+            }
+            _stopping = true;
+            lock.unlock();
+            _wake.notify_one();
+            _writer.join();
+        }
+
+        void write(LogLevel level, const std::string& message)
+        {
+            std::string line = levelPrefix(level) + message + '\n';
+            {
+                std::lock_guard<std::mutex> lock(_queueLock);
+                if ( _writer.joinable() )
+                {
+                    _queue.push_back(std::move(line));
+                    _wake.notify_one();
+                    return;
+                }
+            }
+            std::lock_guard<std::mutex> lock(_writeLock);
+            std::cout << line;
+        }
+
+        void flush()
+        {
+            std::unique_lock<std::mutex> lock(_queueLock);
+            _drained.wait(lock, [this] { return _queue.empty() && !_writing; });
+            std::lock_guard<std::mutex> writeLock(_writeLock);
+            std::cout.flush();
+        }
+
+    private:
+        void drain()
+        {
+            std::unique_lock<std::mutex> lock(_queueLock);
+            for (;;)
+            {
+                _wake.wait(lock, [this] { return _stopping || !_queue.empty(); });
+                if ( _queue.empty() )
+                {
+                    return;
+                }
+                std::deque<std::string> batch;
+                batch.swap(_queue);
+                _writing = true;
+                lock.unlock();
+                {
+                    std::lock_guard<std::mutex> writeLock(_writeLock);
+                    for (const std::string& line : batch)
+                    {
+                        std::cout << line;
+                    }
+                    std::cout.flush();
+                }
+                lock.lock();
+                _writing = false;
+                _drained.notify_all();
+            }
+        }
+
+        std::mutex _queueLock, _writeLock;
+        std::condition_variable _wake, _drained;
+        std::deque<std::string> _queue;
+        std::thread _writer;
+        bool _stopping = false;
+        bool _writing = false;
+    };
+
+    LogSink& logSink()
+    {
+        static LogSink sink;
+        return sink;
+    }
+}
+
+void setLogAsync(bool async)
+{
+    logSink().setAsync(async);
+}
+
+void logMessage(LogLevel level, const std::string& message)
+{
+    logSink().write(level, message);
+}
+
+void flushLog()
+{
+    logSink().flush();
+}
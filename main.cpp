@@ -9,11 +9,42 @@
 *   This software uses the boost library with program_options for command-line parsing.
 *   Command-line arguments:
 *         option            input           description
-*       --debug, -d         none            boolean flag for verbose print statements
-*       --input, -i         input path      specify the image path for the image to blur
-*       --output, -o        output path     specify the image path for the blurred image
+*       --debug, -d         none            boolean flag for verbose print statements (--log-level debug)
+*       --log-level         level name      trace, debug, info, warn, error or off; info by default
+*       --log-async         none            write log messages on a background thread
+*       --input, -i         input path      specify the image path for the image to blur ("-" for stdin)
+*       --output, -o        output path     specify the image path for the blurred image ("-" for stdout)
+*       --format            codec name      codec for stdout: jpg, png, pnm, bmp or raw (raw planar); stdin is detected
 *       --filtersize, -f    filter size     1 for 3x3, 2 for 5x5, 3 for 7x7
-*       --cuda              none            boolean flag for using cuda vs cpu
+*       --sigma, -s         std deviation   standard deviation of the gaussian in pixels
+*       --scale             output scale    resize the blurred output by this factor
+*       --exact-decode      none            always decode JPEG at full resolution
+*       --encode-preset     preset name     fast, balanced or small output encoding
+*       --jpeg-quality      1 to 100        JPEG quality, overrides the preset
+*       --jpeg-subsampling  444/422/420     JPEG chroma subsampling, overrides the preset
+*       --png-level         0 to 9          zlib level, overrides the preset
+*       --png-filter        filter name     none, sub, up, average, paeth or all, overrides the preset
+*       --threads, -t       thread count    worker threads for parallel stages (encoding, tiles)
+*       --stream            none            blur binary PNM row by row in O(width * filtersize) memory
+*       --tiled             none            blur in tiles with halos, on --threads threads
+*       --max-memory        byte count      budget for tile buffers, e.g. 512M or 16G (implies --tiled)
+*       --tile-size         pixels          tile edge, picked from the budget otherwise
+*       --border            border mode     keep (unblurred), clamp or mirror the pixels near the edge
+*       --huge-pages        mode            off, thp or explicit huge pages for buffers of 2MB and up
+*       --engine            engine name     sequential, tiled, cuda, or auto to pick the fastest for this host
+*       --tuning-profile    path            where --engine auto keeps its measurements
+*       --timings           json or text    print the time of every stage (decode, kernel, convolution per channel, ...)
+*       --perf-counters     none            count cycles, instructions, cache and branch misses of the blur
+*       --trace             trace path      write a Chrome trace of the stages, tiles and worker threads
+*       --memory-report     json or text    print resident peak and allocations of every stage
+*       --predict-memory    none            print the memory the run would need as JSON, without running it
+*       --scaling-report    json or text    speedup, efficiency and Karp-Flatt at 1 .. --threads threads, without writing an output
+*       --scaling-engines   engine list     engines of the scaling report, tiled by default, or all
+*       --scaling-repetitions count         timed runs per thread count of the scaling report
+*       --verify            json or text    check every engine against a double-precision reference, exit 3 on failure
+*       --verify-max-error  8-bit levels    largest error --verify accepts (1.01 by default)
+*       --verify-min-psnr   dB              lowest PSNR --verify accepts (50 by default)
+*       --cuda              none            boolean flag for using cuda vs cpu (--engine cuda)
 *       --help, -h          none            display help for this program
 *
 *   Compiling the program:
@@ -21,31 +52,430 @@
 *
 *   Running the program:
 *       ./blur.exe --debug --input img/mountain.jpg --filtersize 2
+*       cat img/mountain.jpg | ./blur.exe -i - -o - --format png > mountain_blur.png
 */
 
 #define cimg_display 0
 
 #include "boost/program_options.hpp" 
 #include "utils.h"
-#include "cimg_utils.h"
+#include "image_io.h"
+#include "blur_stream.h"
+#include "raw_planar.h"
+#include "scaling_report.h"
+#include "verify_report.h"
+#include "libblur.h"
+#include "json_writer.h"
+#include "logging.h"
+#include "memory_usage.h"
+#include "perf_counters.h"
+#include "trace_events.h"
 #include "CImg.h"
 #include <iostream> 
 #include <string> 
 #include <chrono>
+#include <fstream>
+#include <iomanip>
+#include <memory>
+#include <cmath>
+#include <algorithm>
+#include <stdexcept>
+#include <vector>
  
 namespace 
 { 
     const size_t ERROR_IN_COMMAND_LINE = 1; 
     const size_t SUCCESS = 0; 
     const size_t ERROR_UNHANDLED_EXCEPTION = 2; 
+    const size_t ERROR_VERIFY_FAILED = 3;
 } // namespace 
 
 namespace cl=cimg_library;
+
+//  Stages of this run for --timings, in the order they ran; libblur reports its own the same way.
+//  With --trace they are spans of the main thread as well.
+typedef std::vector<blur_stage_time> StageTimes;
+
+static void addStage(StageTimes *stageTimes, const char *stage, std::chrono::steady_clock::time_point begin,
+                     std::chrono::steady_clock::time_point end)
+{
+    if ( tracing() )
+    {
+        traceComplete(stage, "main", begin, end);
+    }
+    if ( stageTimes )
+    {
+        stageTimes->push_back({ stage, -1, std::chrono::duration<double, std::micro>(end - begin).count() });
+    }
+}
+
+//  --timings json or text, on std::cout (stderr when the image goes to stdout)
+static void printStageTimes(const StageTimes& stageTimes, const std::string& format,
+                            std::chrono::steady_clock::time_point programBegin)
+{
+    const double total = std::chrono::duration<double, std::micro>(std::chrono::steady_clock::now() - programBegin).count();
+    if ( format == "json" )
+    {
+        JsonWriter json(std::cout);
+        json.beginObject()
+            .field("clock", "steady_clock")
+            .field("unit", "microseconds")
+            .key("stages").beginArray();
+        for (const blur_stage_time& time : stageTimes)
+        {
+            json.beginObject().field("stage", time.stage);
+            if ( time.channel >= 0 )
+            {
+                json.field("channel", time.channel);
+            }
+            json.field("microseconds", time.microseconds).endObject();
+        }
+        json.endArray().field("total_microseconds", total).endObject();
+        return;
+    }
+    std::cout << "=========\nStage times (microseconds):" << std::endl << std::fixed << std::setprecision(1);
+    for (const blur_stage_time& time : stageTimes)
+    {
+        std::string name = time.stage;
+        if ( time.channel >= 0 )
+        {
+            name += " [" + std::to_string( time.channel ) + "]";
+        }
+        std::cout << "  " << name << std::string(name.size() < 20 ? 20 - name.size() : 1, ' ') << time.microseconds << std::endl;
+    }
+    std::cout << "  total" << std::string(15, ' ') << total << std::endl;
+}
+
+//  What the run is asked to measure besides its times
+struct RunReport
+{
+    StageTimes *stageTimes = nullptr;       // --timings
+    std::string timingsFormat;
+    bool perfCounters = false;              // --perf-counters
+    MemoryStages *memoryStages = nullptr;   // --memory-report
+    std::string memoryFormat;
+    std::string tracePath;                  // --trace
+};
+
+//  Start a --memory-report stage, ending the one before
+static void memoryStage(const RunReport& report, const char *stage)
+{
+    if ( report.memoryStages )
+    {
+        report.memoryStages->begin(stage);
+    }
+}
+
+//  --memory-report json or text.  A stage's peak is its own where the high-water mark could be
+//  reset, the process's so far otherwise; heap changes are signed, pool bytes newly allocated.
+static void printMemoryStages(const MemoryStages& memoryStages, const std::string& format)
+{
+    uint64_t peak = 0;
+    bool stagePeaks = true;
+    for (const MemoryStage& stage : memoryStages.stages())
+    {
+        peak = std::max(peak, stage.after.peakRssBytes);
+        stagePeaks = stagePeaks && stage.stagePeak;
+    }
+    if ( format == "json" )
+    {
+        JsonWriter json(std::cout);
+        json.beginObject()
+            .field("peak_rss_bytes", peak)
+            .field("stage_peaks", stagePeaks)
+            .key("stages").beginArray();
+        for (const MemoryStage& stage : memoryStages.stages())
+        {
+            json.beginObject()
+                .field("stage", stage.stage)
+                .field("peak_rss_bytes", stage.after.peakRssBytes)
+                .field("rss_bytes", stage.after.rssBytes)
+                .field("rss_change_bytes", (int64_t)stage.after.rssBytes - (int64_t)stage.before.rssBytes)
+                .field("heap_change_bytes", (int64_t)stage.after.heapBytes - (int64_t)stage.before.heapBytes)
+                .field("pool_allocated_bytes", stage.after.poolBytes - stage.before.poolBytes)
+                .endObject();
+        }
+        json.endArray().endObject();
+        return;
+    }
+    std::cout << "=========\nMemory (MB): stage, peak resident" << ( stagePeaks ? "" : " (since start)" )
+              << ", resident change, heap change, pool allocated" << std::endl << std::fixed << std::setprecision(1);
+    for (const MemoryStage& stage : memoryStages.stages())
+    {
+        const std::string name = stage.stage;
+        std::cout << "  " << name << std::string(name.size() < 10 ? 10 - name.size() : 1, ' ')
+                  << stage.after.peakRssBytes / 1048576.0 << "  "
+                  << ((double)stage.after.rssBytes - stage.before.rssBytes) / 1048576.0 << "  "
+                  << ((double)stage.after.heapBytes - stage.before.heapBytes) / 1048576.0 << "  "
+                  << (stage.after.poolBytes - stage.before.poolBytes) / 1048576.0 << std::endl;
+    }
+    std::cout << "  peak resident: " << peak / 1048576.0 << " MB" << std::endl;
+    std::cout.unsetf(std::ios_base::floatfield);
+}
+
+//  --timings, --memory-report and --trace at the end of a run
+static void reportRun(const RunReport& report, std::chrono::steady_clock::time_point programBegin)
+{
+    if ( report.stageTimes )
+    {
+        printStageTimes(*report.stageTimes, report.timingsFormat, programBegin);
+    }
+    if ( report.memoryStages )
+    {
+        report.memoryStages->end();
+        printMemoryStages(*report.memoryStages, report.memoryFormat);
+    }
+    if ( !report.tracePath.empty() )
+    {
+        std::ofstream out(report.tracePath);
+        writeTrace(out);
+        if ( !out )
+        {
+            throw std::runtime_error("can't write trace " + report.tracePath);
+        }
+    }
+}
+
+//  --perf-counters report of one blur
+static void printPerfReading(const PerfReading& reading, const char *engine, double pixels)
+{
+    std::cout << "=========\nPerf counters (" << engine << "):";
+    for (int i = 0; i < PERF_EVENT_COUNT; i++)
+    {
+        std::cout << " " << perfEventName((PerfEvent)i) << " ";
+        if ( reading.valid[i] )
+        {
+            std::cout << (uint64_t)reading.value[i];
+        }
+        else
+        {
+            std::cout << "n/a";
+        }
+    }
+    std::cout << std::fixed << std::setprecision(2) << std::endl
+              << "IPC: " << reading.ipc() << ", cycles per pixel: " << reading.cyclesPer(pixels) << std::endl;
+    std::cout.unsetf(std::ios_base::floatfield);
+}
+
+//  Blur src into dst through libblur, timing only the blur itself; --engine auto tunes the params first.
+//  The tuning and libblur's own stages go to the report's stage times, the plan (kernel and tile
+//  scratch) and the blur are memory stages, and the blur can be wrapped in performance counters.
+static void blurImage(const blur_image& src, const blur_image& dst, blur_params params, bool autoEngine,
+                      const std::string& tuningProfile, const RunReport& report)
+{
+    StageTimes *stageTimes = report.stageTimes;
+    blur_status status;
+    if ( autoEngine )
+    {
+        std::chrono::steady_clock::time_point tuneBegin = std::chrono::steady_clock::now();
+        int measured = 0;
+        status = blur_tune(&params, src.width, src.height, src.channels, tuningProfile.empty() ? NULL : tuningProfile.c_str(), &measured);
+        if ( status != BLUR_OK )
+        {
+            throw std::runtime_error(std::string("blur_tune(): ") + blur_status_string(status) + ": " + blur_last_error());
+        }
+        LOG_DEBUG(( measured ? "Tuned" : "Tuning profile" ) << ": " << blur_engine_string(params.engine) << ", " <<
+            params.threads << " threads, tile size " << params.tile_size);
+        addStage(stageTimes, "tune", tuneBegin, std::chrono::steady_clock::now());
+    }
+
+    if ( stageTimes )
+    {
+        blur_timings_start();
+    }
+    memoryStage(report, "plan");
+    blur_plan *plan;
+    {
+        TraceSpan span("plan", "main");
+        status = blur_plan_create(&plan, src.width, src.height, src.channels, &params);
+    }
+    if ( status != BLUR_OK )
+    {
+        throw std::runtime_error(std::string("blur_plan_create(): ") + blur_status_string(status) + ": " + blur_last_error());
+    }
+    LOG_DEBUG("Engine: " << blur_engine_string(blur_plan_engine(plan)));
+
+    //  Opened before the clock starts: perf_event_open costs a few syscalls per counter
+    std::unique_ptr<PerfCounters> counters;
+    if ( report.perfCounters )
+    {
+        counters.reset(new PerfCounters());
+        if ( !counters->available() )
+        {
+            std::cout << "=========\nPerf counters unavailable: " << counters->unavailableReason() << std::endl;
+            counters.reset();
+        }
+    }
+    if ( counters )
+    {
+        counters->start();
+    }
+
+    memoryStage(report, "blur");
+    std::chrono::steady_clock::time_point blurBegin = std::chrono::steady_clock::now();
+    {
+        TraceSpan span("blur", "main");
+        status = blur_plan_execute(plan, &src, &dst);
+    }
+    std::chrono::steady_clock::time_point blurEnd = std::chrono::steady_clock::now();
+    if ( report.memoryStages )
+    {
+        report.memoryStages->end();
+    }
+    const PerfReading reading = counters ? counters->stop() : PerfReading();
+    const blur_engine engine = blur_plan_engine(plan);
+    blur_plan_destroy(plan);
+    if ( stageTimes )
+    {
+        //  kernel, then copy, convolution and border (or upload, convolution and copy back) per channel
+        StageTimes recorded(8 + 4 * (size_t)src.channels);
+        recorded.resize(std::min(recorded.size(), blur_timings_stop(recorded.data(), recorded.size())));
+        stageTimes->insert(stageTimes->end(), recorded.begin(), recorded.end());
+    }
+    if ( status != BLUR_OK )
+    {
+        throw std::runtime_error(std::string("blur_plan_execute(): ") + blur_status_string(status) + ": " + blur_last_error());
+    }
+    std::cout << "=========\nBlur time: " << durationAsString(blurBegin, blurEnd) << std::endl;
+    if ( counters )
+    {
+        printPerfReading(reading, blur_engine_string(engine), (double)src.width * src.height);
+    }
+
+    if ( logEnabled(LogLevel::Debug) )
+    {
+        blur_pool_counters pool;
+        blur_pool_stats(&pool);
+        LOG_DEBUG("Buffer pool: " << pool.heap_allocations << " heap allocations (" << pool.heap_bytes << " bytes), " <<
+            pool.reused_allocations << " reused (" << pool.reused_bytes << " bytes), " << pool.huge_page_bytes << " bytes on huge pages");
+    }
+}
+
+//  Phases of a run and what --predict-memory expects each to hold, in bytes; every phase includes
+//  the baseline (code, libraries and heap before any image is read) and whatever earlier phases
+//  leave behind.  Codec buffers are upper bounds, so the peak is safe to admit a job on.
+struct MemoryPrediction
+{
+    ImageInfo input = {}, decoded = {}, output = {};
+    uint64_t baseline = 0;
+    uint64_t plan = 0;                      // filter and tile scratch, kept by the buffer pool
+    uint64_t decode = 0, blur = 0, resize = 0, encode = 0;
+    uint64_t peak = 0;
+};
+
+enum class RunPath { Stream, MappedRaw, Decoded };
+
+//  Predict the run from the input's header.  Decoded runs hold the decoded image and the blurred
+//  one until the end (they are swapped, not copied); mapped raw files count as resident once touched.
+static MemoryPrediction predictMemory(RunPath path, const std::string& inputPath, ImageFormat inputFormat,
+                                      ImageFormat outputFormat, double outputScale, bool exactDecode,
+                                      blur_params params, const EncodeOptions& encodeOptions)
+{
+    MemoryPrediction prediction;
+    prediction.baseline = sampleMemory().rssBytes;
+
+    size_t inputBytes;
+    if ( inputFormat == ImageFormat::RawPlanar )
+    {
+        const RawPlanarHeader header = MappedImage::open(inputPath).header();
+        prediction.input = { (int)header.width, (int)header.height, (int)header.channels };
+        inputBytes = header.headerBytes + header.planeStride * header.channels;
+    }
+    else
+    {
+        const std::vector<unsigned char> buffer = readFile(inputPath);
+        if ( !probeImage(buffer, inputFormat, prediction.input) )
+        {
+            throw std::runtime_error("can't read the dimensions of " + inputPath);
+        }
+        inputBytes = buffer.size();
+    }
+    const ImageInfo& input = prediction.input;
+
+    //  JPEG decodes at reduced resolution when the run would
+    ReducedDecode reduced = { 1, params.sigma, params.filter_size };
+    if ( !exactDecode && inputFormat == ImageFormat::Jpeg && path == RunPath::Decoded )
+    {
+        reduced = planReducedDecode(outputScale, params.sigma, params.filter_size, params.border == BLUR_BORDER_KEEP);
+    }
+    prediction.decoded = { (input.width + reduced.denominator - 1) / reduced.denominator,
+                           (input.height + reduced.denominator - 1) / reduced.denominator, input.channels };
+    prediction.output = { std::max(1, (int)std::lround(input.width * outputScale)),
+                          std::max(1, (int)std::lround(input.height * outputScale)), input.channels };
+    const ImageInfo& decoded = prediction.decoded;
+    const uint64_t decodedBytes = (uint64_t)decoded.width * decoded.height * decoded.channels;
+    const uint64_t outputBytes = (uint64_t)prediction.output.width * prediction.output.height * prediction.output.channels;
+
+    if ( path == RunPath::Stream )
+    {
+        //  2 * filtersize + 1 rows in the ring, plus the interleaved rows in and out
+        prediction.blur = prediction.baseline + (uint64_t)(2 * params.filter_size + 3) * input.width * input.channels;
+        prediction.peak = prediction.blur;
+        return prediction;
+    }
+
+    params.filter_size = reduced.filterSize;
+    params.sigma = reduced.sigma;
+    size_t planBytes = 0;
+    blur_status status = blur_plan_memory(&planBytes, decoded.width, decoded.height, decoded.channels, &params);
+    if ( status != BLUR_OK )
+    {
+        throw std::runtime_error(std::string("blur_plan_memory(): ") + blur_status_string(status) + ": " + blur_last_error());
+    }
+    prediction.plan = planBytes;
+
+    if ( path == RunPath::MappedRaw )
+    {
+        const RawPlanarHeader output = makeRawPlanarHeader(input.width, input.height, input.channels, PixelType::UInt8);
+        prediction.blur = prediction.baseline + inputBytes + output.headerBytes + output.planeStride * output.channels + prediction.plan;
+        prediction.peak = prediction.blur;
+        return prediction;
+    }
+
+    prediction.decode = prediction.baseline + decodeMemory(inputBytes, decoded, inputFormat);
+    prediction.blur = prediction.baseline + 2 * decodedBytes + prediction.plan;
+    const bool resized = prediction.output.width != decoded.width || prediction.output.height != decoded.height;
+    if ( resized )
+    {
+        prediction.resize = prediction.blur + outputBytes;
+    }
+    prediction.encode = prediction.baseline + decodedBytes + ( resized ? outputBytes : decodedBytes ) + prediction.plan +
+        encodeMemory(prediction.output, outputFormat, encodeOptions);
+    prediction.peak = std::max(std::max(prediction.decode, prediction.blur), std::max(prediction.resize, prediction.encode));
+    return prediction;
+}
+
+static void printMemoryPrediction(const MemoryPrediction& prediction)
+{
+    JsonWriter json(std::cout);
+    json.beginObject()
+        .key("input").beginObject()
+            .field("width", prediction.input.width)
+            .field("height", prediction.input.height)
+            .field("channels", prediction.input.channels)
+        .endObject()
+        .key("decoded").beginObject()
+            .field("width", prediction.decoded.width)
+            .field("height", prediction.decoded.height)
+        .endObject()
+        .field("predicted_peak_bytes", prediction.peak)
+        .field("baseline_bytes", prediction.baseline)
+        .field("plan_bytes", prediction.plan)
+        .key("phases").beginObject()
+            .field("decode", prediction.decode)
+            .field("blur", prediction.blur)
+            .field("resize", prediction.resize)
+            .field("encode", prediction.encode)
+        .endObject()
+    .endObject();
+}
  
 int main(int argc, char** argv) 
 { 
     try 
     { 
+        std::chrono::steady_clock::time_point programBegin = std::chrono::steady_clock::now();
+
         /*
         *   Define program options 
         */ 
@@ -53,18 +483,81 @@ int main(int argc, char** argv)
         bool cudaFlag=false;
         std::string inputPath;
         std::string outputPath;
+        std::string codecName;
         int filterSize;
+        double sigma;
+        double outputScale;
+        bool exactDecodeFlag=false;
+        bool streamFlag=false;
+        bool tiledFlag=false;
+        std::string maxMemoryText;
+        std::string borderName;
+        std::string hugePagesName;
+        std::string engineChoice;
+        bool autoEngine=false;
+        std::string tuningProfile;
+        std::string timingsFormat;
+        std::string tracePath;
+        std::string memoryFormat;
+        bool predictMemoryFlag=false;
+        std::string scalingFormat;
+        std::string scalingEnginesText;
+        std::vector<blur_engine> scalingEngines;
+        int scalingRepetitions;
+        std::string verifyFormat;
+        VerifyTolerance verifyTolerance;
+        std::string logLevelName;
+        bool logAsyncFlag=false;
+        bool perfFlag=false;
+        blur_params blurParams;
+        blur_params_default(&blurParams);
+        std::string presetName;
+        std::string pngFilterName;
+        int threads;
+        EncodeOptions encodeOptions;
         namespace po = boost::program_options; 
         po::options_description desc("Options"); 
         desc.add_options() 
             ("help,h", "Print help messages") 
-            ("input,i", po::value(&inputPath), "Path of the image to blur (REQUIRED).")
-            ("output,o", po::value(&outputPath), "Path of the resulting output.")
+            ("input,i", po::value(&inputPath), "Path of the image to blur (REQUIRED). Use - for stdin.")
+            ("output,o", po::value(&outputPath), "Path of the resulting output. Use - for stdout.")
+            ("format", po::value(&codecName), "Codec for stdout: jpg, png, pnm, bmp or raw (raw planar). The input's codec otherwise. Stdin is always decoded by its magic bytes.")
             ("filtersize,f", po::value(&filterSize) -> default_value(1), "Filter size. 1 => 3x3, 2 => 5x5, 3 => 7x7, etc.")
-            ("cuda,c", po::bool_switch(&cudaFlag), "Perform blur operation on CUDA. Otherwise perform sequentially on single CPU.")
-            ("debug,d", po::bool_switch(&debugFlag), "Enable verbose debugging statements."); 
+            ("sigma,s", po::value(&sigma) -> default_value(1.0), "Standard deviation of the gaussian, in pixels.")
+            ("scale", po::value(&outputScale) -> default_value(1.0), "Resize the blurred output by this factor, e.g. 0.25.")
+            ("exact-decode", po::bool_switch(&exactDecodeFlag), "Always decode JPEG at full resolution, even when the output is downscaled or heavily blurred.")
+            ("encode-preset", po::value(&presetName) -> default_value("balanced"), "Output encoding: fast, balanced or small.")
+            ("jpeg-quality", po::value<int>(), "JPEG quality 1 to 100. Overrides the preset.")
+            ("jpeg-subsampling", po::value<int>(), "JPEG chroma subsampling: 444, 422 or 420. Overrides the preset.")
+            ("png-level", po::value<int>(), "PNG zlib level 0 to 9. Overrides the preset.")
+            ("png-filter", po::value(&pngFilterName), "PNG row filter: none, sub, up, average, paeth, or all to pick per row. Overrides the preset.")
+            ("threads,t", po::value(&threads) -> default_value(hardwareThreads()), "Worker threads for parallel stages (encoding, tiles).")
+            ("stream", po::bool_switch(&streamFlag), "Blur a binary PNM (P5/P6) row by row, holding only 2*filtersize+1 rows in memory.")
+            ("tiled", po::bool_switch(&tiledFlag), "Blur in tiles with halos, several at a time on --threads threads.")
+            ("max-memory", po::value(&maxMemoryText), "Budget for tile buffers in flight, e.g. 512M or 16G. Implies --tiled.")
+            ("tile-size", po::value(&blurParams.tile_size) -> default_value(0), "Tile edge in pixels. Picked from --max-memory otherwise.")
+            ("border", po::value(&borderName) -> default_value("keep"), "Pixels near the edge: keep (unblurred), clamp or mirror.")
+            ("huge-pages", po::value(&hugePagesName) -> default_value("off"), "Huge pages for image and tile buffers of 2MB and up: off, thp (transparent) or explicit (MAP_HUGETLB, thp if none are reserved).")
+            ("engine", po::value(&engineChoice), "Blur engine: sequential, tiled, cuda, or auto to measure the candidates once per host and image class and reuse the winner.")
+            ("tuning-profile", po::value(&tuningProfile), "Tuning profile for --engine auto. Defaults to ~/.cache/cuda-blur/tuning.profile.")
+            ("timings", po::value(&timingsFormat), "Print the time of every stage (option parsing, decode, kernel, convolution per channel, copy back, encode): json or text.")
+            ("perf-counters", po::bool_switch(&perfFlag), "Count cycles, instructions, L1d/LLC misses and branch misses of the blur with perf_event_open, and report IPC and cycles per pixel.")
+            ("trace", po::value(&tracePath), "Write a Chrome trace (chrome://tracing, Perfetto) of the stages, tiles, encode strips and worker waits to this path.")
+            ("memory-report", po::value(&memoryFormat), "Print the resident peak, resident and heap change and buffer pool allocations of every stage (decode, plan, output, blur, resize, encode): json or text.")
+            ("predict-memory", po::bool_switch(&predictMemoryFlag), "Print the memory this run would need, from the input's header, as JSON and exit without blurring.")
+            ("scaling-report", po::value(&scalingFormat), "Time the blur of the input at 1 .. --threads threads, on the image (strong scaling) and on the image stacked once per thread (weak scaling), print speedup, efficiency and Karp-Flatt serial fraction as json or text, and exit without writing an output.")
+            ("scaling-engines", po::value(&scalingEnginesText) -> default_value("tiled"), "Engines of --scaling-report: sequential, tiled, cuda, comma separated, or all in this build. Only tiled takes threads.")
+            ("scaling-repetitions", po::value(&scalingRepetitions) -> default_value(3), "Timed runs per thread count of --scaling-report; the median is reported.")
+            ("verify", po::value(&verifyFormat), "Blur the input and synthetic images with every engine, border mode, layout and thread count up to --threads, compare with a double-precision reference, print max error and PSNR as json or text, and exit with code 3 if any case breaches the tolerance or changes with the thread count.")
+            ("verify-max-error", po::value(&verifyTolerance.maxError) -> default_value(1.01), "Largest error --verify accepts, in 8-bit levels. Truncating to integers alone costs up to 1.")
+            ("verify-min-psnr", po::value(&verifyTolerance.minPsnr) -> default_value(50.0), "Lowest PSNR --verify accepts, in dB.")
+            ("cuda,c", po::bool_switch(&cudaFlag), "Perform blur operation on CUDA. Otherwise perform sequentially on single CPU. Same as --engine cuda.")
+            ("log-level", po::value(&logLevelName), "Print log messages of this level and up: trace, debug, info, warn, error or off. Defaults to info.")
+            ("log-async", po::bool_switch(&logAsyncFlag), "Hand log messages to a background thread instead of writing them on the thread that logs; they may then come out after the timings printed around them.")
+            ("debug,d", po::bool_switch(&debugFlag), "Enable verbose debugging statements. Same as --log-level debug."); 
  
         po::variables_map vm; 
+        ImageFormat format = ImageFormat::Unknown, outputCodec = ImageFormat::Unknown;
     try 
     { 
         /*
@@ -89,15 +582,168 @@ int main(int argc, char** argv)
             std::cerr << "ERROR: Input path for image is empty. Exit with code " << ERROR_IN_COMMAND_LINE << "." << std::endl;
             return ERROR_IN_COMMAND_LINE;
         }
-        else if ( !fileExists(inputPath) )
+        else if ( inputPath != STDIO_PATH && !fileExists(inputPath) )
         {
             std::cerr << "ERROR: Input path " << inputPath << " doesn't exist. Exit with code " << ERROR_IN_COMMAND_LINE << "." << std::endl;
             return ERROR_IN_COMMAND_LINE;
         }
-        debug("INPUT PATH: " + inputPath , debugFlag);
 
-        //  output image
-        if ( outputPath.empty() )
+        //  blur and scale
+        if ( filterSize < 1 || sigma <= 0.0 || outputScale <= 0.0 )
+        {
+            std::cerr << "ERROR: filtersize, sigma and scale must be positive. Exit with code " << ERROR_IN_COMMAND_LINE << "." << std::endl;
+            return ERROR_IN_COMMAND_LINE;
+        }
+
+        //  output encoding: the preset first, then any individual overrides
+        EncodePreset preset;
+        if ( !presetFromName(presetName, preset) )
+        {
+            std::cerr << "ERROR: Unknown encode preset " << presetName << ". Exit with code " << ERROR_IN_COMMAND_LINE << "." << std::endl;
+            return ERROR_IN_COMMAND_LINE;
+        }
+        encodeOptions = encodeOptionsForPreset(preset);
+        if ( vm.count("jpeg-quality") )
+        {
+            encodeOptions.jpegQuality = std::min(100, std::max(1, vm["jpeg-quality"].as<int>()));
+        }
+        if ( vm.count("jpeg-subsampling") )
+        {
+            encodeOptions.jpegSubsampling = vm["jpeg-subsampling"].as<int>();
+        }
+        if ( vm.count("png-level") )
+        {
+            encodeOptions.pngLevel = std::min(9, std::max(0, vm["png-level"].as<int>()));
+        }
+        if ( !pngFilterName.empty() )
+        {
+            encodeOptions.pngFilters = pngFiltersFromName(pngFilterName);
+        }
+        encodeOptions.threads = std::max(1, threads);
+        if ( encodeOptions.pngFilters == 0 || ( encodeOptions.jpegSubsampling != 444 &&
+             encodeOptions.jpegSubsampling != 422 && encodeOptions.jpegSubsampling != 420 ) )
+        {
+            std::cerr << "ERROR: Bad --png-filter or --jpeg-subsampling. Exit with code " << ERROR_IN_COMMAND_LINE << "." << std::endl;
+            return ERROR_IN_COMMAND_LINE;
+        }
+
+        //  engine: --cuda and --tiled are shorthands for --engine cuda and --engine tiled
+        autoEngine = engineChoice == "auto";
+        if ( ( !engineChoice.empty() && !autoEngine && engineChoice != "sequential" && engineChoice != "tiled" && engineChoice != "cuda" ) ||
+             ( cudaFlag && !engineChoice.empty() && engineChoice != "cuda" ) ||
+             ( tiledFlag && !engineChoice.empty() && engineChoice != "tiled" ) || ( autoEngine && streamFlag ) )
+        {
+            std::cerr << "ERROR: Unknown --engine " << engineChoice << ", or one that contradicts --cuda, --tiled or --stream. Exit with code " << ERROR_IN_COMMAND_LINE << "." << std::endl;
+            return ERROR_IN_COMMAND_LINE;
+        }
+        cudaFlag = cudaFlag || engineChoice == "cuda";
+        tiledFlag = tiledFlag || engineChoice == "tiled";
+        if ( cudaFlag && !blur_engine_available(BLUR_ENGINE_CUDA) )
+        {
+            std::cerr << "ERROR: This build has no CUDA engine (make USE_CUDA=1). Exit with code " << ERROR_IN_COMMAND_LINE << "." << std::endl;
+            return ERROR_IN_COMMAND_LINE;
+        }
+
+        //  tiling
+        if ( !maxMemoryText.empty() )
+        {
+            blurParams.max_memory = parseByteSize(maxMemoryText);
+            if ( blurParams.max_memory == 0 )
+            {
+                std::cerr << "ERROR: Bad --max-memory " << maxMemoryText << ". Exit with code " << ERROR_IN_COMMAND_LINE << "." << std::endl;
+                return ERROR_IN_COMMAND_LINE;
+            }
+            tiledFlag = true;
+        }
+        tiledFlag = tiledFlag || blurParams.tile_size > 0;
+        if ( tiledFlag && ( cudaFlag || streamFlag || blurParams.tile_size < 0 ) )
+        {
+            std::cerr << "ERROR: --tiled runs on the CPU and can't be combined with --cuda or --stream. Exit with code " << ERROR_IN_COMMAND_LINE << "." << std::endl;
+            return ERROR_IN_COMMAND_LINE;
+        }
+
+        blurParams.threads = std::max(1, threads);
+        blurParams.engine = cudaFlag ? BLUR_ENGINE_CUDA : ( tiledFlag ? BLUR_ENGINE_TILED : BLUR_ENGINE_SEQUENTIAL );
+
+        //  border
+        if ( borderName == "clamp" ) blurParams.border = BLUR_BORDER_CLAMP;
+        else if ( borderName == "mirror" ) blurParams.border = BLUR_BORDER_MIRROR;
+        if ( ( borderName != "keep" && blurParams.border == BLUR_BORDER_KEEP ) || ( streamFlag && borderName != "keep" ) )
+        {
+            std::cerr << "ERROR: Unknown --border " << borderName << ", or not keep with --stream. Exit with code " << ERROR_IN_COMMAND_LINE << "." << std::endl;
+            return ERROR_IN_COMMAND_LINE;
+        }
+
+        //  huge pages
+        if ( hugePagesName == "thp" ) blur_pool_set_huge_pages(BLUR_HUGE_PAGES_TRANSPARENT);
+        else if ( hugePagesName == "explicit" ) blur_pool_set_huge_pages(BLUR_HUGE_PAGES_EXPLICIT);
+        else if ( hugePagesName != "off" )
+        {
+            std::cerr << "ERROR: Unknown --huge-pages " << hugePagesName << ". Exit with code " << ERROR_IN_COMMAND_LINE << "." << std::endl;
+            return ERROR_IN_COMMAND_LINE;
+        }
+
+        //  stage timings
+        if ( !timingsFormat.empty() && timingsFormat != "json" && timingsFormat != "text" )
+        {
+            std::cerr << "ERROR: Unknown --timings " << timingsFormat << ". Exit with code " << ERROR_IN_COMMAND_LINE << "." << std::endl;
+            return ERROR_IN_COMMAND_LINE;
+        }
+
+        //  memory
+        if ( !memoryFormat.empty() && memoryFormat != "json" && memoryFormat != "text" )
+        {
+            std::cerr << "ERROR: Unknown --memory-report " << memoryFormat << ". Exit with code " << ERROR_IN_COMMAND_LINE << "." << std::endl;
+            return ERROR_IN_COMMAND_LINE;
+        }
+        if ( predictMemoryFlag && inputPath == STDIO_PATH )
+        {
+            std::cerr << "ERROR: --predict-memory reads the input's header, so it needs an input file. Exit with code " << ERROR_IN_COMMAND_LINE << "." << std::endl;
+            return ERROR_IN_COMMAND_LINE;
+        }
+
+        //  scaling report
+        if ( !scalingFormat.empty() && ( ( scalingFormat != "json" && scalingFormat != "text" ) ||
+             !scalingEnginesFromNames(scalingEnginesText, scalingEngines) || scalingRepetitions < 1 ) )
+        {
+            std::cerr << "ERROR: Bad --scaling-report, --scaling-engines or --scaling-repetitions. Exit with code " << ERROR_IN_COMMAND_LINE << "." << std::endl;
+            return ERROR_IN_COMMAND_LINE;
+        }
+        if ( !scalingFormat.empty() && ( streamFlag || autoEngine || predictMemoryFlag ) )
+        {
+            std::cerr << "ERROR: --scaling-report picks its own engines and threads and can't be combined with --stream, --engine auto or --predict-memory. Exit with code " << ERROR_IN_COMMAND_LINE << "." << std::endl;
+            return ERROR_IN_COMMAND_LINE;
+        }
+
+        //  verify
+        if ( !verifyFormat.empty() && ( ( verifyFormat != "json" && verifyFormat != "text" ) || verifyTolerance.maxError < 0.0 ) )
+        {
+            std::cerr << "ERROR: Bad --verify or --verify-max-error. Exit with code " << ERROR_IN_COMMAND_LINE << "." << std::endl;
+            return ERROR_IN_COMMAND_LINE;
+        }
+        if ( !verifyFormat.empty() && ( streamFlag || autoEngine || predictMemoryFlag || !scalingFormat.empty() ) )
+        {
+            std::cerr << "ERROR: --verify picks its own engines and threads and can't be combined with --stream, --engine auto, --predict-memory or --scaling-report. Exit with code " << ERROR_IN_COMMAND_LINE << "." << std::endl;
+            return ERROR_IN_COMMAND_LINE;
+        }
+
+        //  codec of stdout; the input's own is found from its extension or its first bytes
+        if ( !codecName.empty() )
+        {
+            outputCodec = formatFromName(codecName);
+            if ( outputCodec == ImageFormat::Unknown )
+            {
+                std::cerr << "ERROR: Unknown format " << codecName << ". Exit with code " << ERROR_IN_COMMAND_LINE << "." << std::endl;
+                return ERROR_IN_COMMAND_LINE;
+            }
+        }
+
+        //  output image; stdin goes to stdout unless told otherwise
+        if ( outputPath.empty() && inputPath == STDIO_PATH )
+        {
+            outputPath = STDIO_PATH;
+        }
+        else if ( outputPath.empty() )
         {
             std::vector<std::string> pathTokens = split(inputPath, '.');
             outputPath = "";
@@ -107,7 +753,32 @@ int main(int argc, char** argv)
             }
             outputPath += "_blur." + pathTokens.at(pathTokens.size() - 1);
         }
-        debug("OUTPUT PATH: " + outputPath , debugFlag);
+
+        //  streaming works on rows of binary PNM and can't resize or run on CUDA
+        if ( streamFlag && ( cudaFlag || outputScale != 1.0 ||
+             ( outputPath != STDIO_PATH && formatFromPath(outputPath) != ImageFormat::Pnm ) ) )
+        {
+            std::cerr << "ERROR: --stream needs PNM output and no --cuda or --scale. Exit with code " << ERROR_IN_COMMAND_LINE << "." << std::endl;
+            return ERROR_IN_COMMAND_LINE;
+        }
+
+        //  log level
+        LogLevel level = debugFlag ? LogLevel::Debug : LogLevel::Info;
+        if ( !logLevelName.empty() && !logLevelFromName(logLevelName, level) )
+        {
+            std::cerr << "ERROR: Log level " << logLevelName << " isn't trace, debug, info, warn, error or off. Exit with code " << ERROR_IN_COMMAND_LINE << "." << std::endl;
+            return ERROR_IN_COMMAND_LINE;
+        }
+
+        //  stdout carries the image, so everything printed with std::cout goes to stderr instead
+        if ( outputPath == STDIO_PATH )
+        {
+            std::cout.rdbuf(std::cerr.rdbuf());
+        }
+        setLogLevel(level);
+        setLogAsync(logAsyncFlag);
+        LOG_DEBUG("INPUT PATH: " << inputPath);
+        LOG_DEBUG("OUTPUT PATH: " << outputPath);
     } 
     catch(po::error& e) 
     { 
@@ -118,25 +789,203 @@ int main(int argc, char** argv)
  
     // application code here // 
     std::chrono::steady_clock::time_point begin = std::chrono::steady_clock::now();
+    StageTimes stageTimeList;
+    MemoryStages memoryStages;
+    RunReport report;
+    report.stageTimes = timingsFormat.empty() ? nullptr : &stageTimeList;
+    report.timingsFormat = timingsFormat;
+    report.perfCounters = perfFlag;
+    report.memoryStages = memoryFormat.empty() ? nullptr : &memoryStages;
+    report.memoryFormat = memoryFormat;
+    report.tracePath = tracePath;
+    StageTimes *stageTimes = report.stageTimes;
+    if ( !tracePath.empty() )
+    {
+        setTracing(true, programBegin);
+        setTraceThreadName("main");
+    }
+    addStage(stageTimes, "options", programBegin, begin);
+
+    LOG_DEBUG("Program start");
+    LOG_DEBUG("Using CUDA? " << cudaFlag);
+
+    //  Raw planar file to raw planar file is blurred between memory mappings
+    blurParams.filter_size = filterSize;
+    blurParams.sigma = sigma;
+    const ImageFormat inputFormat = formatFromPath(inputPath);
+    const bool mappedRaw = inputPath != STDIO_PATH && outputPath != STDIO_PATH && outputScale == 1.0 &&
+        inputFormat == ImageFormat::RawPlanar && formatFromPath(outputPath) == ImageFormat::RawPlanar;
+
+    if ( predictMemoryFlag )
+    {
+        const ImageFormat outputFormat = outputPath != STDIO_PATH && formatFromPath(outputPath) != ImageFormat::Unknown ?
+            formatFromPath(outputPath) : ( outputCodec != ImageFormat::Unknown ? outputCodec : inputFormat );
+        const RunPath path = streamFlag ? RunPath::Stream : ( mappedRaw ? RunPath::MappedRaw : RunPath::Decoded );
+        printMemoryPrediction(predictMemory(path, inputPath, inputFormat, outputFormat, outputScale, exactDecodeFlag,
+                                            blurParams, encodeOptions));
+        return SUCCESS;
+    }
+
+    //  Scaling report: the input at full resolution, timed at every thread count; nothing is written
+    if ( !scalingFormat.empty() )
+    {
+        memoryStage(report, "decode");
+        cl::CImg<unsigned char> image = loadImage(inputPath, format);
+        addStage(stageTimes, "decode", begin, std::chrono::steady_clock::now());
+        const blur_image src = blur_image_packed(image.data(), image.width(), image.height(), image.spectrum());
+        memoryStage(report, "scaling");
+        std::chrono::steady_clock::time_point scalingBegin = std::chrono::steady_clock::now();
+        const std::vector<ScalingSeries> series = measureScaling(src, blurParams, scalingEngines, blurParams.threads, scalingRepetitions);
+        addStage(stageTimes, "scaling", scalingBegin, std::chrono::steady_clock::now());
+        writeScalingReport(std::cout, series, src, blurParams, scalingRepetitions, scalingFormat);
+        reportRun(report, programBegin);
+        return SUCCESS;
+    }
+
+    //  Verify: the input, noise of its shape, and odd-sized noise whose tiles don't divide evenly
+    if ( !verifyFormat.empty() )
+    {
+        cl::CImg<unsigned char> image = loadImage(inputPath, format);
+        std::vector<unsigned char> noise = noiseImage(image.width(), image.height(), image.spectrum(), 12345);
+        std::vector<unsigned char> oddNoise = noiseImage(131, 77, 3, 54321);
+        std::vector<unsigned char> grayNoise = noiseImage(29, 5, 1, 999);
+        std::vector<int> threadCounts = { 1, 2, blurParams.threads };
+        std::sort(threadCounts.begin(), threadCounts.end());
+        threadCounts.erase(std::unique(threadCounts.begin(), threadCounts.end()), threadCounts.end());
+
+        std::vector<VerifyCase> cases;
+        verifyEngines("input", blur_image_packed(image.data(), image.width(), image.height(), image.spectrum()), blurParams,
+                      threadCounts, verifyTolerance, cases);
+        verifyEngines("noise", blur_image_packed(noise.data(), image.width(), image.height(), image.spectrum()), blurParams,
+                      threadCounts, verifyTolerance, cases);
+        verifyEngines("odd noise", blur_image_packed(oddNoise.data(), 131, 77, 3), blurParams, threadCounts, verifyTolerance, cases);
+        verifyEngines("thin noise", blur_image_packed(grayNoise.data(), 29, 5, 1), blurParams, threadCounts, verifyTolerance, cases);
+        std::vector<ReducedDecodeCase> reducedCases;
+        if ( format == ImageFormat::Jpeg && inputPath != STDIO_PATH )
+        {
+            verifyReducedDecode(inputPath, blurParams, verifyTolerance, reducedCases);
+        }
+        writeVerifyReport(std::cout, cases, reducedCases, blurParams, verifyTolerance, verifyFormat);
+        reportRun(report, programBegin);
+        const bool passed = std::all_of(cases.begin(), cases.end(), [](const VerifyCase& result) { return result.passed; }) &&
+            std::all_of(reducedCases.begin(), reducedCases.end(), [](const ReducedDecodeCase& result) { return result.passed; });
+        return passed ? SUCCESS : ERROR_VERIFY_FAILED;
+    }
+
+    //  Streaming: rows go from input to output as they're blurred, there is no whole image
+    if ( streamFlag )
+    {
+        memoryStage(report, "stream");
+        std::FILE *input = inputPath == STDIO_PATH ? stdin : std::fopen(inputPath.c_str(), "rb");
+        std::FILE *output = outputPath == STDIO_PATH ? stdout : std::fopen(outputPath.c_str(), "wb");
+        if ( !input || !output )
+        {
+            throw std::runtime_error("unable to open " + ( input ? outputPath : inputPath ));
+        }
+        long rows = blur_stream(input, output, filterSize, sigma);
+        if ( input != stdin ) std::fclose(input);
+        if ( output != stdout ) std::fclose(output);
+
+        std::chrono::steady_clock::time_point end = std::chrono::steady_clock::now();
+        std::cout << "=========\nStream time (read, blur and write): " << durationAsString(begin, end) << std::endl;
+        LOG_DEBUG("Rows streamed: " << rows);
+        //  Reading, blurring and writing are interleaved row by row, so they are one stage
+        addStage(stageTimes, "stream", begin, end);
+        reportRun(report, programBegin);
+        return SUCCESS;
+    }
+
+    //  Raw planar file to raw planar file: blur straight from one memory mapping into the other
+    if ( mappedRaw )
+    {
+        memoryStage(report, "map");
+        MappedImage input = MappedImage::open(inputPath);
+        const RawPlanarHeader& header = input.header();
+        if ( static_cast<PixelType>(header.pixelType) != PixelType::UInt8 )
+        {
+            throw std::runtime_error("only 8-bit raw planar images can be blurred");
+        }
+        MappedImage output = MappedImage::create(outputPath,
+            makeRawPlanarHeader(header.width, header.height, header.channels, PixelType::UInt8));
+        LOG_DEBUG("Mapped " << header.width << "x" << header.height << "x" << header.channels << " raw planar image");
+        addStage(stageTimes, "map", begin, std::chrono::steady_clock::now());
+
+        const RawPlanarHeader& outputHeader = output.header();
+        blur_image src = { input.pixels(), (int64_t)header.width, (int64_t)header.height, (int)header.channels, header.rowStride, header.planeStride };
+        blur_image dst = { output.pixels(), (int64_t)outputHeader.width, (int64_t)outputHeader.height, (int)outputHeader.channels,
+                           outputHeader.rowStride, outputHeader.planeStride };
+        blurImage(src, dst, blurParams, autoEngine, tuningProfile, report);
+        std::chrono::steady_clock::time_point end = std::chrono::steady_clock::now();
+        LOG_DEBUG("Program end \nRuntime: " << durationAsString(begin, end));
+        reportRun(report, programBegin);
+        return SUCCESS;
+    }
+
+    //  JPEG may be decoded at reduced resolution when the output is downscaled or heavily blurred
+    ReducedDecode reduced = { 1, sigma, filterSize };
+    if ( !exactDecodeFlag )
+    {
+        reduced = planReducedDecode(outputScale, sigma, filterSize, blurParams.border == BLUR_BORDER_KEEP);
+    }
+
+    ImageInfo fullSize;
+    memoryStage(report, "decode");
+    std::chrono::steady_clock::time_point decodeBegin = std::chrono::steady_clock::now();
+    cl::CImg<unsigned char> image = loadImage(inputPath, format, reduced.denominator, &fullSize);
+    std::chrono::steady_clock::time_point decodeEnd = std::chrono::steady_clock::now();
+    std::cout << "=========\nDecode time: " << durationAsString(decodeBegin, decodeEnd) << std::endl;
+    addStage(stageTimes, "decode", decodeBegin, decodeEnd);
+    LOG_DEBUG("Format: " << formatName(format));
+
+    //  Only JPEG honours the reduction; anything else was decoded at full size and keeps the full kernel
+    if ( image.width() == fullSize.width && image.height() == fullSize.height )
+    {
+        reduced = { 1, sigma, filterSize };
+    }
+    LOG_DEBUG("Decode scale: 1/" << reduced.denominator << ", sigma " << reduced.sigma << ", filter size " << reduced.filterSize);
+    LOG_DEBUG("CImg width: " << image.width());
+    LOG_DEBUG("CImg height: " << image.height());
+    LOG_DEBUG("CImg channels: " << image.spectrum());
 
-    debug("Program start", debugFlag);
-    debug("Using CUDA? "+std::to_string( cudaFlag ), debugFlag);
-    cl::CImg<unsigned char> image(inputPath.c_str());
-    debug("CImg width: " + std::to_string( image.width() ) , debugFlag );;
-    debug("CImg height: " + std::to_string( image.height() ) , debugFlag );;
-    debug("CImg channels: " + std::to_string( image.spectrum() ) , debugFlag );
 
+    //  Blur into a second image and swap it in: the decoded pixels are never copied
+    blurParams.filter_size = reduced.filterSize;
+    blurParams.sigma = reduced.sigma;
+    memoryStage(report, "output");
+    cl::CImg<unsigned char> blurred(image.width(), image.height(), 1, image.spectrum());
+    blur_advise_huge_pages(blurred.data(), blurred.size());
+    blurImage(blur_image_packed(image.data(), image.width(), image.height(), image.spectrum()),
+              blur_image_packed(blurred.data(), blurred.width(), blurred.height(), blurred.spectrum()), blurParams,
+              autoEngine, tuningProfile, report);
+    image.swap(blurred);
 
-    image = blur(image, filterSize, cudaFlag);
+    //  Resize to the requested output: moving average when shrinking, linear when growing
+    if ( std::lround(fullSize.width * outputScale) != image.width() || std::lround(fullSize.height * outputScale) != image.height() )
+    {
+        memoryStage(report, "resize");
+        std::chrono::steady_clock::time_point resizeBegin = std::chrono::steady_clock::now();
+        resizeToOutput(image, fullSize, outputScale);
+        addStage(stageTimes, "resize", resizeBegin, std::chrono::steady_clock::now());
+        LOG_DEBUG("Resized to " << image.width() << "x" << image.height());
+    }
 
     std::chrono::steady_clock::time_point end = std::chrono::steady_clock::now();
 
-    //  Save image
-    image.save(outputPath.c_str());
+    //  Save image; a file keeps the codec of its extension, stdout --format's or else the input's
+    ImageFormat outputFormat = outputCodec != ImageFormat::Unknown ? outputCodec : format;
+    if ( outputPath != STDIO_PATH && formatFromPath(outputPath) != ImageFormat::Unknown )
+    {
+        outputFormat = formatFromPath(outputPath);
+    }
+    memoryStage(report, "encode");
+    std::chrono::steady_clock::time_point encodeBegin = std::chrono::steady_clock::now();
+    saveImage(image, outputPath, outputFormat, encodeOptions);
+    std::chrono::steady_clock::time_point encodeEnd = std::chrono::steady_clock::now();
+    std::cout << "=========\nEncode time: " << durationAsString(encodeBegin, encodeEnd) << std::endl;
+    addStage(stageTimes, "encode", encodeBegin, encodeEnd);
 
-    debug("Program end \nRuntime: " 
-        + std::to_string( std::chrono::duration_cast<std::chrono::microseconds>(end - begin).count() ) + "[µs], or " +
-        std::to_string( std::chrono::duration_cast<std::chrono::nanoseconds>(end - begin).count() ) + "[ns]", debugFlag);
+    LOG_DEBUG("Program end \nRuntime: " << durationAsString(begin, end));
+    reportRun(report, programBegin);
   } 
   catch(std::exception& e) 
   { 
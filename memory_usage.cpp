@@ -0,0 +1,91 @@
+/*
+*   memory_usage.cpp
+*   part of image blur software using CUDA
+*   for CSC 630 with Dr. Zhang
+*
+*   This program implements memory sampling and per-stage memory accounting.
+*/
+
+#include "memory_usage.h"
+#include "buffer_pool.h"
+#include <cstdio>
+#include <cstring>
+#include <malloc.h>
+#include <sys/resource.h>
+
+//  VmRSS and VmHWM from /proc/self/status; the peak from getrusage() without /proc
+static void residentBytes(uint64_t& rss, uint64_t& peak)
+{
+    rss = peak = 0;
+    std::FILE *status = std::fopen("/proc/self/status", "r");
+    if ( !status )
+    {
+        struct rusage usage;
+        if ( getrusage(RUSAGE_SELF, &usage) == 0 )
+        {
+            peak = (uint64_t)usage.ru_maxrss * 1024;
+        }
+        return;
+    }
+    char line[256];
+    unsigned long long kilobytes;
+    while ( std::fgets(line, sizeof(line), status) )
+    {
+        if ( std::sscanf(line, "VmRSS: %llu kB", &kilobytes) == 1 )
+        {
+            rss = kilobytes * 1024;
+        }
+        else if ( std::sscanf(line, "VmHWM: %llu kB", &kilobytes) == 1 )
+        {
+            peak = kilobytes * 1024;
+        }
+    }
+    std::fclose(status);
+}
+
+MemorySample sampleMemory()
+{
+    MemorySample sample;
+    residentBytes(sample.rssBytes, sample.peakRssBytes);
+#ifdef __GLIBC__
+#if __GLIBC_PREREQ(2, 33)
+    //  Small blocks in use plus blocks malloc mapped on their own
+    struct mallinfo2 info = mallinfo2();
+    sample.heapBytes = info.uordblks + info.hblkhd;
+#endif
+#endif
+    sample.poolBytes = bufferPool().counters().heapBytes;
+    return sample;
+}
+
+bool resetPeakRss()
+{
+    //  Writing 5 resets VmHWM to the current resident set (Linux 4.0 and later)
+    std::FILE *clearRefs = std::fopen("/proc/self/clear_refs", "w");
+    if ( !clearRefs )
+    {
+        return false;
+    }
+    const bool written = std::fputs("5", clearRefs) >= 0;
+    return std::fclose(clearRefs) == 0 && written;
+}
+
+void MemoryStages::begin(const char *stage)
+{
+    end();
+    MemoryStage entry;
+    entry.stage = stage;
+    entry.stagePeak = resetPeakRss();
+    entry.before = sampleMemory();
+    _stages.push_back(entry);
+    _open = true;
+}
+
+void MemoryStages::end()
+{
+    if ( _open )
+    {
+        _stages.back().after = sampleMemory();
+        _open = false;
+    }
+}
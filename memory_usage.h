@@ -0,0 +1,53 @@
+/*
+*   memory_usage.h
+*   part of image blur software using CUDA
+*   for CSC 630 with Dr. Zhang
+*
+*   This header file contains the definitions for memory accounting of the blur stages.
+*   A sample holds the resident set (and its high-water mark) from /proc/self/status, the bytes
+*   malloc has handed out and not got back, and the bytes the buffer pool has allocated, whose
+*   large buffers are mapped outside malloc.  MemoryStages samples around each stage; where Linux
+*   lets the high-water mark be reset (/proc/self/clear_refs) every stage gets its own peak.
+*/
+
+#ifndef MEMORY_USAGE_H
+#define MEMORY_USAGE_H
+
+#include <cstdint>
+#include <vector>
+
+struct MemorySample
+{
+    uint64_t rssBytes = 0;          // resident now
+    uint64_t peakRssBytes = 0;      // resident high-water mark since the start or the last resetPeakRss()
+    uint64_t heapBytes = 0;         // malloc'd and not yet freed, 0 where malloc can't say
+    uint64_t poolBytes = 0;         // allocated by the buffer pool since the start
+};
+
+MemorySample sampleMemory();
+
+//  Restart the resident high-water mark; false where that isn't possible
+bool resetPeakRss();
+
+struct MemoryStage
+{
+    const char *stage;
+    MemorySample before, after;
+    bool stagePeak;                 // after.peakRssBytes is the stage's own peak, not the process's
+};
+
+class MemoryStages
+{
+public:
+    //  Stages don't nest: begin() ends the open one
+    void begin(const char *stage);
+    void end();
+
+    const std::vector<MemoryStage>& stages() const { return _stages; }
+
+private:
+    std::vector<MemoryStage> _stages;
+    bool _open = false;
+};
+
+#endif
@@ -0,0 +1,466 @@
+/*
+*   microbench.cpp
+*   part of image blur software using CUDA
+*   for CSC 630 with Dr. Zhang
+*
+*   This program benchmarks the innermost convolution routines in isolation and reports cycles
+*   per pixel, so a change to the hot loop shows up without decode, encode or thread scheduling
+*   noise around it.  Built with `make microbench`.
+*   The routines are the ones every CPU engine ends in: blur_plane, which convolves the interior
+*   of one channel plane, and blur_border, which convolves the filterSize-wide frame around it
+*   under clamp or mirror borders.  Each runs on one plane per size, so small sizes stay resident
+*   in L1 or L2 and large ones stream from DRAM; the report says where each working set fits.
+*   Samples are timed with the time-stamp counter (reference cycles) or with perf's core cycle
+*   counter, and summarised as min, median and p90, whose spread tells how far a 1% change can be
+*   trusted.
+*
+*   Command-line arguments:
+*         option            input           description
+*       --routines          routine list    interior, clamp, mirror (border routines), or all
+*       --sizes             edge list       square plane edges in pixels, e.g. 64,256,4096
+*       --radii             radius list     filter sizes (radius), e.g. 1,2,3
+*       --sigma             std deviation   gaussian standard deviation in pixels
+*       --repetitions, -r   count           samples per case
+*       --clock             tsc or perf     time-stamp counter, or perf_event_open core cycles
+*       --cpu               cpu index       pin the benchmark to this CPU
+*       --flush             none            evict the caches before every sample (cold runs)
+*       --output, -o        path            JSON results, - for stdout
+*       --help, -h          none            display help for this program
+*
+*   Running the program:
+*       ./microbench.exe --sizes 64,256,4096 --radii 1,3 --cpu 2 -o microbench.json
+*/
+
+#include "boost/program_options.hpp"
+#include "blur_tune.h"
+#include "buffer_pool.h"
+#include "cimg_utils.h"
+#include "json_writer.h"
+#include "perf_counters.h"
+#include "utils.h"
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <ctime>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <memory>
+#include <sched.h>
+#include <stdexcept>
+#include <string>
+#include <unistd.h>
+#include <vector>
+#if defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+#endif
+
+namespace
+{
+    const size_t ERROR_IN_COMMAND_LINE = 1;
+    const size_t SUCCESS = 0;
+    const size_t ERROR_UNHANDLED_EXCEPTION = 2;
+
+    //  A warm sample repeats the routine until it spans at least this many ticks
+    const double MIN_SAMPLE_TICKS = 2e6;
+} // namespace
+
+enum class Routine { Interior, Clamp, Mirror };
+
+static const char *routineName(Routine routine)
+{
+    switch (routine)
+    {
+        case Routine::Interior: return "interior";
+        case Routine::Clamp:    return "clamp";
+        case Routine::Mirror:   return "mirror";
+    }
+    return "unknown";
+}
+
+struct MicroCase
+{
+    Routine routine;
+    int edge;
+    int radius;
+};
+
+struct MicroResult
+{
+    MicroCase config;
+    const char *residence;              // L1, L2, L3 or DRAM: the smallest cache the src and dst planes fit in
+    int64_t pixels;                     // pixels the routine writes per call
+    int calls;                          // calls per sample
+    std::vector<double> ticksPerPixel;  // one per sample, sorted
+    double min = 0.0, median = 0.0, p90 = 0.0;
+};
+
+//  Time-stamp counter, perf core cycles, or nanoseconds where there is no TSC
+class TickClock
+{
+public:
+    explicit TickClock(bool perf) : _perf(perf)
+    {
+        if ( _perf )
+        {
+            _counters.reset(new PerfCounters());
+            if ( _counters->available() )
+            {
+                _counters->start();
+            }
+            if ( !_counters->available() || !_counters->stop().valid[PERF_CYCLES] )
+            {
+                throw std::runtime_error("perf cycle counter unavailable: " + _counters->unavailableReason());
+            }
+        }
+    }
+
+    const char *unit() const
+    {
+#if defined(__x86_64__) || defined(__i386__)
+        return _perf ? "cycles" : "reference cycles";
+#else
+        return _perf ? "cycles" : "nanoseconds";
+#endif
+    }
+
+    void start()
+    {
+        if ( _perf )
+        {
+            _counters->start();
+            return;
+        }
+        _begin = now();
+    }
+
+    double stop()
+    {
+        if ( _perf )
+        {
+            return _counters->stop().value[PERF_CYCLES];
+        }
+        return now() - _begin;
+    }
+
+private:
+    static double now()
+    {
+#if defined(__x86_64__) || defined(__i386__)
+        //  The fences keep the routine's loads from drifting across the read
+        _mm_lfence();
+        const uint64_t ticks = __rdtsc();
+        _mm_lfence();
+        return (double)ticks;
+#else
+        return std::chrono::duration<double, std::nano>(std::chrono::steady_clock::now().time_since_epoch()).count();
+#endif
+    }
+
+    bool _perf;
+    std::unique_ptr<PerfCounters> _counters;
+    double _begin = 0.0;
+};
+
+//  Nearest-rank percentile of sorted samples
+static double percentile(const std::vector<double>& sorted, double p)
+{
+    size_t rank = (size_t)std::ceil(p * sorted.size());
+    return sorted[std::min(sorted.size(), std::max<size_t>(rank, 1)) - 1];
+}
+
+//  Comma-separated integers; false if any isn't a positive number
+static bool parseList(const std::string& text, std::vector<int>& numbers)
+{
+    numbers.clear();
+    for (const std::string& token : split(text, ','))
+    {
+        int number = std::atoi(token.c_str());
+        if ( number <= 0 )
+        {
+            return false;
+        }
+        numbers.push_back(number);
+    }
+    return !numbers.empty();
+}
+
+static size_t cacheBytes(int name)
+{
+    long bytes = sysconf(name);
+    return bytes > 0 ? (size_t)bytes : 0;
+}
+
+//  Smallest cache level holding both planes; sizes the system doesn't report are skipped
+static const char *residence(size_t bytes)
+{
+    if ( bytes <= cacheBytes(_SC_LEVEL1_DCACHE_SIZE) ) return "L1";
+    if ( bytes <= cacheBytes(_SC_LEVEL2_CACHE_SIZE) ) return "L2";
+    if ( bytes <= cacheBytes(_SC_LEVEL3_CACHE_SIZE) ) return "L3";
+    return "DRAM";
+}
+
+//  Write over a buffer twice the last-level cache, pushing the planes out of every level
+static void flushCaches(std::vector<unsigned char>& sweep)
+{
+    for (size_t i = 0; i < sweep.size(); i += 64)
+    {
+        sweep[i]++;
+    }
+}
+
+static MicroResult runCase(const MicroCase& config, double sigma, int repetitions, bool flush, TickClock& clock,
+                           std::vector<unsigned char>& sweep)
+{
+    MicroResult result;
+    result.config = config;
+    const int64_t edge = config.edge;
+    const size_t planeBytes = (size_t)edge * edge;
+    result.residence = residence(2 * planeBytes);
+
+    PooledBuffer input = bufferPool().acquire(planeBytes), output = bufferPool().acquire(planeBytes);
+    std::vector<float> filter = getFilter(config.radius, sigma);
+    uint32_t noise = 12345;
+    for (size_t i = 0; i < planeBytes; i++)
+    {
+        noise = noise * 1103515245u + 12345u;
+        input.data()[i] = (unsigned char)(noise >> 24);
+        output.data()[i] = 0;
+    }
+    const int64_t interior = std::max<int64_t>(0, edge - 2 * config.radius);
+    result.pixels = config.routine == Routine::Interior ? interior * interior : edge * edge - interior * interior;
+    if ( result.pixels == 0 )
+    {
+        throw std::runtime_error("a " + std::to_string( edge ) + " pixel plane has no " + routineName(config.routine) +
+                                 " pixels at radius " + std::to_string( config.radius ));
+    }
+
+    const BorderMode border = config.routine == Routine::Mirror ? BorderMode::Mirror : BorderMode::Clamp;
+    auto call = [&]() {
+        if ( config.routine == Routine::Interior )
+        {
+            blur_plane(input.data(), edge, output.data(), edge, edge, edge, filter.data(), config.radius);
+        }
+        else
+        {
+            blur_border(input.data(), edge, output.data(), edge, edge, edge, filter.data(), config.radius, border);
+        }
+    };
+
+    //  Warm up, and size warm samples so the clock's own cost is noise
+    clock.start();
+    call();
+    const double once = std::max(1.0, clock.stop());
+    result.calls = flush ? 1 : std::max(1, (int)std::ceil(MIN_SAMPLE_TICKS / once));
+
+    for (int sample = 0; sample < repetitions; sample++)
+    {
+        if ( flush )
+        {
+            flushCaches(sweep);
+        }
+        clock.start();
+        for (int i = 0; i < result.calls; i++)
+        {
+            call();
+        }
+        result.ticksPerPixel.push_back(clock.stop() / ( (double)result.pixels * result.calls ));
+    }
+    std::sort(result.ticksPerPixel.begin(), result.ticksPerPixel.end());
+    result.min = result.ticksPerPixel.front();
+    result.median = percentile(result.ticksPerPixel, 0.5);
+    result.p90 = percentile(result.ticksPerPixel, 0.9);
+    return result;
+}
+
+static void writeResults(std::ostream& out, const std::vector<MicroResult>& results, double sigma, int repetitions,
+                         const TickClock& clock, int cpu, bool flush)
+{
+    char timestamp[32];
+    std::time_t now = std::time(nullptr);
+    std::strftime(timestamp, sizeof(timestamp), "%Y-%m-%dT%H:%M:%SZ", std::gmtime(&now));
+
+    JsonWriter json(out);
+    json.beginObject()
+        .field("schema", "cuda-blur-microbench/1")
+        .field("timestamp", timestamp)
+        .field("host", hostKey())
+        .key("build").beginObject()
+            .field("compiler", __VERSION__)
+        .endObject()
+        .key("caches").beginObject()
+            .field("l1d_bytes", (uint64_t)cacheBytes(_SC_LEVEL1_DCACHE_SIZE))
+            .field("l2_bytes", (uint64_t)cacheBytes(_SC_LEVEL2_CACHE_SIZE))
+            .field("l3_bytes", (uint64_t)cacheBytes(_SC_LEVEL3_CACHE_SIZE))
+        .endObject()
+        .key("settings").beginObject()
+            .field("sigma", sigma)
+            .field("repetitions", repetitions)
+            .field("unit", clock.unit())
+            .key("cpu");
+    if ( cpu >= 0 )
+    {
+        json.value(cpu);
+    }
+    else
+    {
+        json.null();
+    }
+    json.field("flush", flush)
+            .field("pixel_type", "uint8")
+        .endObject()
+        .key("results").beginArray();
+    for (const MicroResult& result : results)
+    {
+        const MicroCase& config = result.config;
+        json.beginObject()
+            .field("routine", routineName(config.routine))
+            .field("edge", config.edge)
+            .field("radius", config.radius)
+            .field("residence", result.residence)
+            .field("pixels", result.pixels)
+            .field("calls_per_sample", result.calls)
+            .field("min_per_pixel", result.min)
+            .field("median_per_pixel", result.median)
+            .field("p90_per_pixel", result.p90)
+            .key("samples_per_pixel").beginArray();
+        for (double ticks : result.ticksPerPixel)
+        {
+            json.value(ticks);
+        }
+        json.endArray().endObject();
+    }
+    json.endArray().endObject();
+}
+
+int main(int argc, char** argv)
+{
+    try
+    {
+        std::string routinesText, sizesText, radiiText, clockName, outputPath;
+        double sigma;
+        int repetitions, cpu;
+        bool flushFlag = false;
+        namespace po = boost::program_options;
+        po::options_description desc("Options");
+        desc.add_options()
+            ("help,h", "Print help messages")
+            ("routines", po::value(&routinesText) -> default_value("all"), "Routines, comma separated: interior (blur_plane), clamp and mirror (blur_border), or all.")
+            ("sizes", po::value(&sizesText) -> default_value("64,256,4096"), "Square plane edges in pixels, comma separated.")
+            ("radii", po::value(&radiiText) -> default_value("1,2,3"), "Filter sizes (radius), comma separated. 1 => 3x3, 3 => 7x7.")
+            ("sigma", po::value(&sigma) -> default_value(1.0), "Standard deviation of the gaussian, in pixels.")
+            ("repetitions,r", po::value(&repetitions) -> default_value(31), "Samples per case.")
+            ("clock", po::value(&clockName) -> default_value("tsc"), "tsc (time-stamp counter, reference cycles) or perf (core cycles from perf_event_open).")
+            ("cpu", po::value(&cpu) -> default_value(-1), "Pin the benchmark to this CPU.")
+            ("flush", po::bool_switch(&flushFlag), "Evict the caches before every sample, so each sample is one cold call.")
+            ("output,o", po::value(&outputPath) -> default_value("microbench.json"), "JSON results. Use - for stdout.");
+
+        po::variables_map vm;
+        try
+        {
+            po::store(po::parse_command_line(argc, argv, desc), vm);
+            if ( vm.count("help") )
+            {
+                std::cout << "Benchmark the innermost convolution routines in cycles per pixel." << std::endl << desc << std::endl;
+                return SUCCESS;
+            }
+            po::notify(vm);
+        }
+        catch(po::error& e)
+        {
+            std::cerr << "ERROR: " << e.what() << std::endl << std::endl << desc << std::endl;
+            return ERROR_IN_COMMAND_LINE;
+        }
+
+        std::vector<int> sizes, radii;
+        if ( !parseList(sizesText, sizes) || !parseList(radiiText, radii) || sigma <= 0.0 || repetitions < 1 ||
+             ( clockName != "tsc" && clockName != "perf" ) )
+        {
+            std::cerr << "ERROR: Bad --sizes, --radii, --sigma, --repetitions or --clock. Exit with code " << ERROR_IN_COMMAND_LINE << "." << std::endl;
+            return ERROR_IN_COMMAND_LINE;
+        }
+        std::vector<Routine> routines;
+        for (const std::string& name : split(routinesText, ','))
+        {
+            if ( name == "all" ) routines.insert(routines.end(), { Routine::Interior, Routine::Clamp, Routine::Mirror });
+            else if ( name == "interior" ) routines.push_back(Routine::Interior);
+            else if ( name == "clamp" ) routines.push_back(Routine::Clamp);
+            else if ( name == "mirror" ) routines.push_back(Routine::Mirror);
+            else
+            {
+                std::cerr << "ERROR: Unknown routine " << name << ". Exit with code " << ERROR_IN_COMMAND_LINE << "." << std::endl;
+                return ERROR_IN_COMMAND_LINE;
+            }
+        }
+        if ( cpu >= 0 )
+        {
+            cpu_set_t cpus;
+            CPU_ZERO(&cpus);
+            if ( cpu < CPU_SETSIZE )
+            {
+                CPU_SET(cpu, &cpus);
+            }
+            if ( cpu >= CPU_SETSIZE || sched_setaffinity(0, sizeof(cpus), &cpus) != 0 )
+            {
+                std::cerr << "ERROR: Can't pin to CPU " << cpu << ". Exit with code " << ERROR_IN_COMMAND_LINE << "." << std::endl;
+                return ERROR_IN_COMMAND_LINE;
+            }
+        }
+
+        //  Progress goes to stderr when the JSON goes to stdout
+        std::ostream& log = outputPath == "-" ? std::cerr : std::cout;
+        TickClock clock(clockName == "perf");
+        std::vector<unsigned char> sweep;
+        if ( flushFlag )
+        {
+            sweep.resize(std::max<size_t>(64 << 20, 2 * cacheBytes(_SC_LEVEL3_CACHE_SIZE)));
+        }
+
+        std::vector<MicroResult> results;
+        for (Routine routine : routines)
+        {
+            for (int size : sizes)
+            {
+                for (int radius : radii)
+                {
+                    MicroCase config = { routine, size, radius };
+                    log << std::setw(8) << routineName(routine) << std::setw(6) << size << "x" << size << " r" << radius << ": ";
+                    try
+                    {
+                        results.push_back(runCase(config, sigma, repetitions, flushFlag, clock, sweep));
+                    }
+                    catch (std::exception& e)
+                    {
+                        log << e.what() << std::endl;
+                        continue;
+                    }
+                    const MicroResult& result = results.back();
+                    log << std::fixed << std::setprecision(2) << result.median << " " << clock.unit() << "/pixel (min "
+                        << result.min << ", p90 " << result.p90 << ", spread " << 100.0 * ( result.p90 - result.min ) / result.min
+                        << "%), " << result.residence << std::endl;
+                }
+            }
+        }
+
+        if ( outputPath == "-" )
+        {
+            writeResults(std::cout, results, sigma, repetitions, clock, cpu, flushFlag);
+        }
+        else
+        {
+            std::ofstream out(outputPath);
+            writeResults(out, results, sigma, repetitions, clock, cpu, flushFlag);
+            if ( !out )
+            {
+                throw std::runtime_error("can't write " + outputPath);
+            }
+            log << "Results written to " << outputPath << std::endl;
+        }
+        return SUCCESS;
+    }
+    catch(std::exception& e)
+    {
+        std::cerr << "Unhandled Exception reached the top of main: " << e.what() << ", application will now exit" << std::endl;
+        return ERROR_UNHANDLED_EXCEPTION;
+    }
+}
@@ -0,0 +1,192 @@
+/*
+*   perf_counters.cpp
+*   part of image blur software using CUDA
+*   for CSC 630 with Dr. Zhang
+*
+*   This program implements hardware performance counters with Linux perf_event_open.
+*/
+
+#include "perf_counters.h"
+#include <cerrno>
+#include <cmath>
+#include <cstring>
+#include <limits>
+
+#ifdef __linux__
+#include <linux/perf_event.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#endif
+
+const char *perfEventName(PerfEvent event)
+{
+    switch (event)
+    {
+        case PERF_CYCLES:           return "cycles";
+        case PERF_INSTRUCTIONS:     return "instructions";
+        case PERF_L1D_MISSES:       return "l1d_misses";
+        case PERF_LLC_MISSES:       return "llc_misses";
+        case PERF_BRANCH_MISSES:    return "branch_misses";
+        default:                    return "unknown";
+    }
+}
+
+bool PerfReading::any() const
+{
+    for (int i = 0; i < PERF_EVENT_COUNT; i++)
+    {
+        if ( valid[i] )
+        {
+            return true;
+        }
+    }
+    return false;
+}
+
+double PerfReading::ipc() const
+{
+    if ( !valid[PERF_CYCLES] || !valid[PERF_INSTRUCTIONS] || value[PERF_CYCLES] <= 0.0 )
+    {
+        return std::numeric_limits<double>::quiet_NaN();
+    }
+    return value[PERF_INSTRUCTIONS] / value[PERF_CYCLES];
+}
+
+double PerfReading::cyclesPer(double pixels) const
+{
+    if ( !valid[PERF_CYCLES] || pixels <= 0.0 )
+    {
+        return std::numeric_limits<double>::quiet_NaN();
+    }
+    return value[PERF_CYCLES] / pixels;
+}
+
+PerfReading& PerfReading::operator+=(const PerfReading& other)
+{
+    for (int i = 0; i < PERF_EVENT_COUNT; i++)
+    {
+        valid[i] = valid[i] && other.valid[i];
+        value[i] += other.value[i];
+    }
+    return *this;
+}
+
+#ifdef __linux__
+
+//  Type and config of each PerfEvent
+static void eventConfig(int event, __u32& type, __u64& config)
+{
+    const __u64 l1dReadMiss = PERF_COUNT_HW_CACHE_L1D | (PERF_COUNT_HW_CACHE_OP_READ << 8) |
+                              (PERF_COUNT_HW_CACHE_RESULT_MISS << 16);
+    switch (event)
+    {
+        case PERF_CYCLES:           type = PERF_TYPE_HARDWARE; config = PERF_COUNT_HW_CPU_CYCLES; break;
+        case PERF_INSTRUCTIONS:     type = PERF_TYPE_HARDWARE; config = PERF_COUNT_HW_INSTRUCTIONS; break;
+        case PERF_L1D_MISSES:       type = PERF_TYPE_HW_CACHE; config = l1dReadMiss; break;
+        case PERF_LLC_MISSES:       type = PERF_TYPE_HARDWARE; config = PERF_COUNT_HW_CACHE_MISSES; break;
+        default:                    type = PERF_TYPE_HARDWARE; config = PERF_COUNT_HW_BRANCH_MISSES; break;
+    }
+}
+
+PerfCounters::PerfCounters()
+{
+    for (int i = 0; i < PERF_EVENT_COUNT; i++)
+    {
+        perf_event_attr attr;
+        std::memset(&attr, 0, sizeof(attr));
+        attr.size = sizeof(attr);
+        eventConfig(i, attr.type, attr.config);
+        attr.disabled = 1;
+        attr.inherit = 1;           // threads started while counting, e.g. tile workers
+        attr.exclude_kernel = 1;    // allowed at perf_event_paranoid 2
+        attr.exclude_hv = 1;
+        attr.read_format = PERF_FORMAT_TOTAL_TIME_ENABLED | PERF_FORMAT_TOTAL_TIME_RUNNING;
+
+        _fd[i] = (int)syscall(SYS_perf_event_open, &attr, 0, -1, -1, 0);
+        if ( _fd[i] < 0 && _reason.empty() )
+        {
+            _reason = std::string("perf_event_open(") + perfEventName((PerfEvent)i) + "): " + std::strerror(errno);
+        }
+    }
+    if ( available() )
+    {
+        _reason.clear();
+    }
+}
+
+PerfCounters::~PerfCounters()
+{
+    for (int fd : _fd)
+    {
+        if ( fd >= 0 )
+        {
+            close(fd);
+        }
+    }
+}
+
+bool PerfCounters::available() const
+{
+    for (int fd : _fd)
+    {
+        if ( fd >= 0 )
+        {
+            return true;
+        }
+    }
+    return false;
+}
+
+void PerfCounters::start()
+{
+    for (int fd : _fd)
+    {
+        if ( fd >= 0 )
+        {
+            ioctl(fd, PERF_EVENT_IOC_RESET, 0);
+            ioctl(fd, PERF_EVENT_IOC_ENABLE, 0);
+        }
+    }
+}
+
+PerfReading PerfCounters::stop()
+{
+    PerfReading reading;
+    for (int fd : _fd)
+    {
+        if ( fd >= 0 )
+        {
+            ioctl(fd, PERF_EVENT_IOC_DISABLE, 0);
+        }
+    }
+    for (int i = 0; i < PERF_EVENT_COUNT; i++)
+    {
+        //  value, time enabled, time running; a counter that never ran (no free PMU slot) isn't valid
+        uint64_t data[3];
+        if ( _fd[i] < 0 || read(_fd[i], data, sizeof(data)) != (ssize_t)sizeof(data) || data[2] == 0 )
+        {
+            continue;
+        }
+        reading.valid[i] = true;
+        reading.value[i] = data[2] < data[1] ? (double)data[0] * data[1] / data[2] : (double)data[0];
+    }
+    return reading;
+}
+
+#else
+
+PerfCounters::PerfCounters() : _reason("performance counters need Linux perf_event_open")
+{
+    for (int i = 0; i < PERF_EVENT_COUNT; i++)
+    {
+        _fd[i] = -1;
+    }
+}
+
+PerfCounters::~PerfCounters() {}
+bool PerfCounters::available() const { return false; }
+void PerfCounters::start() {}
+PerfReading PerfCounters::stop() { return PerfReading(); }
+
+#endif
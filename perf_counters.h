@@ -0,0 +1,75 @@
+/*
+*   perf_counters.h
+*   part of image blur software using CUDA
+*   for CSC 630 with Dr. Zhang
+*
+*   This header file contains the definitions for hardware performance counters around a blur.
+*   Wall time alone doesn't say why a convolution is slow; the counters give cycles, instructions
+*   (and so IPC), L1 data and last-level cache misses and branch misses of the calling thread and
+*   the threads it starts, e.g. the tiled engine's workers.  They come from Linux perf_event_open
+*   and count user space only.  Counters the kernel or CPU can't provide (containers, VMs,
+*   perf_event_paranoid, other platforms) are left out rather than failing the blur.
+*
+*   Usage:
+*       PerfCounters counters;
+*       counters.start();
+*       ... blur ...
+*       PerfReading reading = counters.stop();
+*/
+
+#ifndef PERF_COUNTERS_H
+#define PERF_COUNTERS_H
+
+#include <cstdint>
+#include <string>
+
+enum PerfEvent
+{
+    PERF_CYCLES = 0,
+    PERF_INSTRUCTIONS,
+    PERF_L1D_MISSES,
+    PERF_LLC_MISSES,
+    PERF_BRANCH_MISSES,
+    PERF_EVENT_COUNT
+};
+
+//  Name used in reports, e.g. "llc_misses"
+const char *perfEventName(PerfEvent event);
+
+struct PerfReading
+{
+    bool valid[PERF_EVENT_COUNT] = {};          // the counter was open and ran
+    double value[PERF_EVENT_COUNT] = {};        // scaled up when the kernel had to multiplex counters
+
+    bool any() const;
+    double ipc() const;                         // NaN without cycles and instructions
+    double cyclesPer(double pixels) const;      // NaN without cycles
+
+    //  Sum of readings, e.g. over repetitions; a counter is valid only if it was in both
+    PerfReading& operator+=(const PerfReading& other);
+};
+
+class PerfCounters
+{
+public:
+    //  Opens every counter it can, disabled
+    PerfCounters();
+    ~PerfCounters();
+
+    PerfCounters(const PerfCounters&) = delete;
+    PerfCounters& operator=(const PerfCounters&) = delete;
+
+    //  At least one counter is open; otherwise unavailableReason() says why not
+    bool available() const;
+    const std::string& unavailableReason() const { return _reason; }
+
+    //  Zero and enable the counters, then disable and read them
+    void start();
+    PerfReading stop();
+
+private:
+    int _fd[PERF_EVENT_COUNT];
+    std::string _reason;
+};
+
+#endif
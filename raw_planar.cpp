@@ -0,0 +1,193 @@
+/*
+*   raw_planar.cpp
+*   part of image blur software using CUDA
+*   for CSC 630 with Dr. Zhang
+*
+*   This program implements the raw planar image format and its memory mapping.
+*/
+
+#include "raw_planar.h"
+#include <cerrno>
+#include <cstring>
+#include <stdexcept>
+#include <string>
+#include <vector>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+//  Pixel data starts on a page boundary and rows are padded to cache lines, so mappings are aligned for vector loads
+static const uint32_t RAW_PLANAR_HEADER_BYTES = 4096;
+
+RawPlanarHeader makeRawPlanarHeader(uint64_t width, uint64_t height, uint64_t channels, PixelType type)
+{
+    RawPlanarHeader header;
+    std::memset(&header, 0, sizeof(header));
+    std::memcpy(header.magic, RAW_PLANAR_MAGIC, sizeof(header.magic));
+    header.headerBytes = RAW_PLANAR_HEADER_BYTES;
+    header.pixelType = static_cast<uint32_t>(type);
+    header.width = width;
+    header.height = height;
+    header.channels = channels;
+    header.rowStride = paddedRowStride(width * pixelTypeSize(type));
+    header.planeStride = header.rowStride * height;
+    return header;
+}
+
+void validateRawPlanarHeader(const RawPlanarHeader& header, size_t size)
+{
+    if ( std::memcmp(header.magic, RAW_PLANAR_MAGIC, sizeof(header.magic)) != 0 )
+    {
+        throw std::runtime_error("raw planar: bad magic");
+    }
+    const size_t sampleSize = pixelTypeSize(static_cast<PixelType>(header.pixelType));
+    if ( sampleSize == 0 || header.width == 0 || header.height == 0 || header.channels == 0 ||
+         header.headerBytes < sizeof(RawPlanarHeader) ||
+         header.rowStride < header.width * sampleSize ||
+         header.planeStride < header.rowStride * (header.height - 1) + header.width * sampleSize )
+    {
+        throw std::runtime_error("raw planar: inconsistent header");
+    }
+    const uint64_t needed = header.headerBytes + header.planeStride * (header.channels - 1) +
+        header.rowStride * (header.height - 1) + header.width * sampleSize;
+    if ( needed > size )
+    {
+        throw std::runtime_error("raw planar: file is shorter than its header says");
+    }
+}
+
+MappedImage::MappedImage() : _mapping(NULL), _size(0)
+{
+    std::memset(&_header, 0, sizeof(_header));
+}
+
+MappedImage::~MappedImage()
+{
+    if ( _mapping )
+    {
+        munmap(_mapping, _size);
+    }
+}
+
+MappedImage::MappedImage(MappedImage&& other) : _header(other._header), _mapping(other._mapping), _size(other._size)
+{
+    other._mapping = NULL;
+    other._size = 0;
+}
+
+MappedImage& MappedImage::operator=(MappedImage&& other)
+{
+    if ( this != &other )
+    {
+        if ( _mapping )
+        {
+            munmap(_mapping, _size);
+        }
+        _header = other._header;
+        _mapping = other._mapping;
+        _size = other._size;
+        other._mapping = NULL;
+        other._size = 0;
+    }
+    return *this;
+}
+
+MappedImage MappedImage::open(const std::string& path)
+{
+    int fd = ::open(path.c_str(), O_RDONLY);
+    struct stat status;
+    if ( fd < 0 || fstat(fd, &status) != 0 )
+    {
+        if ( fd >= 0 ) ::close(fd);
+        throw std::runtime_error("MappedImage::open(): " + path + ": " + std::strerror(errno));
+    }
+    if ( (size_t)status.st_size < sizeof(RawPlanarHeader) )
+    {
+        ::close(fd);
+        throw std::runtime_error("MappedImage::open(): " + path + " is too small");
+    }
+
+    MappedImage image;
+    image._size = status.st_size;
+    image._mapping = mmap(NULL, image._size, PROT_READ, MAP_SHARED, fd, 0);
+    ::close(fd);
+    if ( image._mapping == MAP_FAILED )
+    {
+        image._mapping = NULL;
+        throw std::runtime_error("MappedImage::open(): mmap " + path + ": " + std::strerror(errno));
+    }
+
+    std::memcpy(&image._header, image._mapping, sizeof(RawPlanarHeader));
+    validateRawPlanarHeader(image._header, image._size);
+    //  The blur walks planes top to bottom
+    madvise(image._mapping, image._size, MADV_SEQUENTIAL);
+    return image;
+}
+
+MappedImage MappedImage::create(const std::string& path, const RawPlanarHeader& header)
+{
+    const size_t size = header.headerBytes + header.planeStride * header.channels;
+    int fd = ::open(path.c_str(), O_RDWR | O_CREAT | O_TRUNC, 0644);
+    if ( fd < 0 || ftruncate(fd, size) != 0 )
+    {
+        if ( fd >= 0 ) ::close(fd);
+        throw std::runtime_error("MappedImage::create(): " + path + ": " + std::strerror(errno));
+    }
+
+    MappedImage image;
+    image._size = size;
+    image._mapping = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    ::close(fd);
+    if ( image._mapping == MAP_FAILED )
+    {
+        image._mapping = NULL;
+        throw std::runtime_error("MappedImage::create(): mmap " + path + ": " + std::strerror(errno));
+    }
+
+    image._header = header;
+    std::memcpy(image._mapping, &header, sizeof(RawPlanarHeader));
+    return image;
+}
+
+cl::CImg<unsigned char> decodeRawPlanar(const std::vector<unsigned char>& buffer)
+{
+    RawPlanarHeader header;
+    if ( buffer.size() < sizeof(header) )
+    {
+        throw std::runtime_error("decodeRawPlanar(): truncated header");
+    }
+    std::memcpy(&header, buffer.data(), sizeof(header));
+    validateRawPlanarHeader(header, buffer.size());
+    if ( static_cast<PixelType>(header.pixelType) != PixelType::UInt8 )
+    {
+        throw std::runtime_error("decodeRawPlanar(): only 8-bit pixels can be decoded to an image");
+    }
+
+    cl::CImg<unsigned char> image(header.width, header.height, 1, header.channels);
+    for (uint64_t c = 0; c < header.channels; c++)
+    {
+        for (uint64_t y = 0; y < header.height; y++)
+        {
+            std::memcpy(image.data(0, y, 0, c), buffer.data() + header.headerBytes + c*header.planeStride + y*header.rowStride,
+                        header.width);
+        }
+    }
+    return image;
+}
+
+std::vector<unsigned char> encodeRawPlanar(const cl::CImg<unsigned char>& image)
+{
+    RawPlanarHeader header = makeRawPlanarHeader(image.width(), image.height(), image.spectrum(), PixelType::UInt8);
+    std::vector<unsigned char> buffer(header.headerBytes + header.planeStride * header.channels, 0);
+    std::memcpy(buffer.data(), &header, sizeof(header));
+    for (uint64_t c = 0; c < header.channels; c++)
+    {
+        for (uint64_t y = 0; y < header.height; y++)
+        {
+            std::memcpy(buffer.data() + header.headerBytes + c*header.planeStride + y*header.rowStride, image.data(0, y, 0, c),
+                        header.width);
+        }
+    }
+    return buffer;
+}
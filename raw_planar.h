@@ -0,0 +1,88 @@
+/*
+*   raw_planar.h
+*   part of image blur software using CUDA
+*   for CSC 630 with Dr. Zhang
+*
+*   This header file contains the definitions for the raw planar image format.
+*   Pixels are stored exactly as CImg and the blur loops use them (R...G...B..., row after row),
+*   behind a small header, so a file can be memory-mapped and used as the pixel buffer itself.
+*   Pipeline stages hand images to each other through these files without decoding or encoding.
+*
+*   Layout (native byte order):
+*       offset 0                    RawPlanarHeader
+*       offset headerBytes          plane 0, row 0 ... row height-1, each rowStride bytes apart
+*       + planeStride               plane 1 ...
+*/
+
+#ifndef RAW_PLANAR_H
+#define RAW_PLANAR_H
+
+#define cimg_OS 1
+#define cimg_display 0
+#include "CImg.h"
+#include "image_view.h"
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+namespace cl=cimg_library;
+
+//  "BLURRAW1"
+const char RAW_PLANAR_MAGIC[8] = { 'B', 'L', 'U', 'R', 'R', 'A', 'W', '1' };
+
+struct RawPlanarHeader
+{
+    char magic[8];
+    uint32_t headerBytes;       // offset of the first pixel, a multiple of the page size
+    uint32_t pixelType;         // PixelType
+    uint64_t width;
+    uint64_t height;
+    uint64_t channels;
+    uint64_t rowStride;         // bytes from one row to the next
+    uint64_t planeStride;       // bytes from one channel plane to the next
+};
+
+//  Header for an image with rows padded to cache lines
+RawPlanarHeader makeRawPlanarHeader(uint64_t width, uint64_t height, uint64_t channels, PixelType type);
+
+//  Check magic, strides and that the pixels fit in `size` bytes; throws if not
+void validateRawPlanarHeader(const RawPlanarHeader& header, size_t size);
+
+/*
+*   A raw planar file mapped into memory.  open() maps read-only; create() sizes a new file and
+*   maps it read-write, so whatever is written to the pixels lands in the file.  Unmapped on destruction.
+*/
+class MappedImage
+{
+public:
+    MappedImage();
+    ~MappedImage();
+    MappedImage(MappedImage&& other);
+    MappedImage& operator=(MappedImage&& other);
+    MappedImage(const MappedImage&) = delete;
+    MappedImage& operator=(const MappedImage&) = delete;
+
+    static MappedImage open(const std::string& path);
+    static MappedImage create(const std::string& path, const RawPlanarHeader& header);
+
+    const RawPlanarHeader& header() const { return _header; }
+    unsigned char *pixels() const { return static_cast<unsigned char*>(_mapping) + _header.headerBytes; }
+
+    //  The mapped pixels, with the file's strides (8-bit images)
+    ImageView view() const
+    {
+        return ImageView(pixels(), _header.width, _header.height, (int)_header.channels, _header.rowStride, _header.planeStride);
+    }
+
+private:
+    RawPlanarHeader _header;
+    void *_mapping;
+    size_t _size;
+};
+
+//  Raw planar <-> CImg through memory buffers, for stdin/stdout and mixed-format runs (8-bit only)
+cl::CImg<unsigned char> decodeRawPlanar(const std::vector<unsigned char>& buffer);
+std::vector<unsigned char> encodeRawPlanar(const cl::CImg<unsigned char>& image);
+
+#endif
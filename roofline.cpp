@@ -0,0 +1,130 @@
+/*
+*   roofline.cpp
+*   part of image blur software using CUDA
+*   for CSC 630 with Dr. Zhang
+*
+*   This program implements the bandwidth and peak-flops measurements of the roofline model.
+*/
+
+#include "roofline.h"
+#include "utils.h"
+#include <algorithm>
+#include <chrono>
+#include <vector>
+
+namespace
+{
+    //  Doubles per STREAM array: 64MB each, well past any last-level cache
+    const int64_t STREAM_ELEMENTS = int64_t(1) << 23;
+    const int STREAM_RUNS = 5;
+
+    //  Multiply-add iterations per thread and per run of the peak measurement
+    const int64_t PEAK_ITERATIONS = int64_t(1) << 24;
+    const int PEAK_RUNS = 3;
+
+    //  Four floats: every x86-64 build has the 16-byte vectors, wider ones need -march
+    typedef float FloatVector __attribute__((vector_size(16)));
+    const int VECTOR_LANES = sizeof(FloatVector) / sizeof(float);
+    //  Independent chains, enough to cover the multiply-add latency on two pipes
+    const int CHAINS = 12;
+
+    volatile float sink;
+}
+
+//  Best triad bandwidth; each thread first touches the part of the arrays it later streams
+static double streamTriad(int threads)
+{
+    std::vector<double> a(STREAM_ELEMENTS, 0.0), b(STREAM_ELEMENTS, 0.0), c(STREAM_ELEMENTS, 0.0);
+    const int64_t chunk = ( STREAM_ELEMENTS + threads - 1 ) / threads;
+    parallelFor(threads, threads, [&](int64_t part) {
+        for (int64_t i = part * chunk; i < std::min(STREAM_ELEMENTS, ( part + 1 ) * chunk); i++)
+        {
+            b[i] = 1.0;
+            c[i] = 2.0;
+        }
+    });
+
+    const double scalar = 3.0;
+    double best = 0.0;
+    for (int run = 0; run < STREAM_RUNS; run++)
+    {
+        std::chrono::steady_clock::time_point begin = std::chrono::steady_clock::now();
+        parallelFor(threads, threads, [&](int64_t part) {
+            const int64_t end = std::min(STREAM_ELEMENTS, ( part + 1 ) * chunk);
+            for (int64_t i = part * chunk; i < end; i++)
+            {
+                a[i] = b[i] + scalar * c[i];
+            }
+        });
+        const double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - begin).count();
+        //  STREAM counts the two reads and the write, not the write-allocate read
+        best = std::max(best, 3.0 * sizeof(double) * STREAM_ELEMENTS / seconds);
+    }
+    sink = (float)a[STREAM_ELEMENTS / 2];
+    return best;
+}
+
+//  CHAINS independent x = x * m + a chains for PEAK_ITERATIONS; 2 flops per lane and iteration
+static void multiplyAdd(int64_t iterations)
+{
+    volatile float seed = 1.0f;
+    FloatVector x[CHAINS];
+    for (int i = 0; i < CHAINS; i++)
+    {
+        x[i] = FloatVector{} + seed * ( 1.0f + i * 1e-3f );
+    }
+    //  m * x + a with m just under 1 stays finite however long it runs
+    const FloatVector m = FloatVector{} + seed * 0.999999f, a = FloatVector{} + seed * 1e-6f;
+    for (int64_t n = 0; n < iterations; n++)
+    {
+        for (int i = 0; i < CHAINS; i++)
+        {
+            x[i] = x[i] * m + a;
+        }
+    }
+    FloatVector total = FloatVector{};
+    for (int i = 0; i < CHAINS; i++)
+    {
+        total += x[i];
+    }
+    sink = total[0];
+}
+
+static double peakFlops(int threads)
+{
+    double best = 0.0;
+    for (int run = 0; run < PEAK_RUNS; run++)
+    {
+        std::chrono::steady_clock::time_point begin = std::chrono::steady_clock::now();
+        parallelFor(threads, threads, [](int64_t) { multiplyAdd(PEAK_ITERATIONS); });
+        const double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - begin).count();
+        best = std::max(best, 2.0 * VECTOR_LANES * CHAINS * PEAK_ITERATIONS * threads / seconds);
+    }
+    return best;
+}
+
+MachineRoof measureMachineRoof(int threads)
+{
+    MachineRoof roof;
+    roof.threads = std::max(1, threads);
+    roof.bytesPerSecond = streamTriad(roof.threads);
+    roof.flopsPerSecond = peakFlops(roof.threads);
+    return roof;
+}
+
+RooflinePoint blurRooflinePoint(int64_t width, int64_t height, int channels, int radius, double seconds,
+                                const MachineRoof& roof)
+{
+    const int64_t filterWidth = 2 * radius + 1;
+    const double interior = (double)std::max<int64_t>(0, width - 2 * radius) * std::max<int64_t>(0, height - 2 * radius);
+    const double flops = 2.0 * filterWidth * filterWidth * interior * channels;
+    const double bytes = 2.0 * width * height * channels;
+
+    RooflinePoint point;
+    point.intensity = flops / bytes;
+    point.flopsPerSecond = flops / seconds;
+    point.bytesPerSecond = bytes / seconds;
+    point.memoryBound = point.intensity < roof.ridge();
+    point.attainable = std::min(roof.flopsPerSecond, point.intensity * roof.bytesPerSecond);
+    return point;
+}
@@ -0,0 +1,49 @@
+/*
+*   roofline.h
+*   part of image blur software using CUDA
+*   for CSC 630 with Dr. Zhang
+*
+*   This header file contains the definitions for the roofline model of the benchmark.
+*   The host's ceilings are measured rather than looked up: memory bandwidth with the STREAM triad
+*   a[i] = b[i] + s * c[i] over arrays much larger than the caches, and the floating-point peak with
+*   independent multiply-add chains on the vector width this build targets (FMA instructions when
+*   the compiler is allowed them).  A blur case with arithmetic intensity I (flops per byte of
+*   compulsory traffic) can reach at most min(peak, I * bandwidth); where it lands against that
+*   roof says whether speeding up its loop means cutting memory traffic or instructions.
+*/
+
+#ifndef ROOFLINE_H
+#define ROOFLINE_H
+
+#include <cstdint>
+
+struct MachineRoof
+{
+    int threads;
+    double bytesPerSecond;      // STREAM triad, best of the runs
+    double flopsPerSecond;      // single-precision multiply-add peak
+
+    //  Intensity where the roof turns from bandwidth to compute, flops per byte
+    double ridge() const { return flopsPerSecond / bytesPerSecond; }
+};
+
+//  Measure both ceilings on `threads` threads
+MachineRoof measureMachineRoof(int threads);
+
+struct RooflinePoint
+{
+    double intensity;           // flops per byte
+    double flopsPerSecond;      // achieved
+    double bytesPerSecond;      // achieved
+    double attainable;          // min(peak, intensity * bandwidth), flops per second
+    bool memoryBound;           // intensity below the ridge
+    double fraction() const { return flopsPerSecond / attainable; }
+};
+
+//  A blur of width x height x channels at filter radius `radius` that took `seconds`.  The interior
+//  pixels cost a multiply and an add per filter tap; the compulsory traffic is each 8-bit pixel read
+//  once and written once.
+RooflinePoint blurRooflinePoint(int64_t width, int64_t height, int channels, int radius, double seconds,
+                                const MachineRoof& roof);
+
+#endif
@@ -0,0 +1,223 @@
+/*
+*   scaling_report.cpp
+*   part of image blur software using CUDA
+*   for CSC 630 with Dr. Zhang
+*
+*   This program implements the strong and weak scaling report of blur.exe.
+*/
+
+#include "scaling_report.h"
+#include "json_writer.h"
+#include "utils.h"
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstring>
+#include <iomanip>
+#include <limits>
+#include <stdexcept>
+
+bool scalingEnginesFromNames(const std::string& names, std::vector<blur_engine>& engines)
+{
+    engines.clear();
+    for (const std::string& name : split(names, ','))
+    {
+        if ( name == "all" )
+        {
+            for (blur_engine engine : { BLUR_ENGINE_SEQUENTIAL, BLUR_ENGINE_TILED, BLUR_ENGINE_CUDA })
+            {
+                if ( blur_engine_available(engine) )
+                {
+                    engines.push_back(engine);
+                }
+            }
+        }
+        else if ( name == "sequential" ) engines.push_back(BLUR_ENGINE_SEQUENTIAL);
+        else if ( name == "tiled" ) engines.push_back(BLUR_ENGINE_TILED);
+        else if ( name == "cuda" ) engines.push_back(BLUR_ENGINE_CUDA);
+        else return false;
+    }
+    return !engines.empty();
+}
+
+//  Median of `repetitions` timed runs of one plan, after a warmup run
+static double timeBlur(const blur_image& src, const blur_image& dst, const blur_params& params, int repetitions)
+{
+    blur_plan *plan;
+    blur_status status = blur_plan_create(&plan, src.width, src.height, src.channels, &params);
+    if ( status != BLUR_OK )
+    {
+        throw std::runtime_error(std::string("blur_plan_create(): ") + blur_status_string(status) + ": " + blur_last_error());
+    }
+    std::vector<double> milliseconds;
+    for (int run = 0; run <= repetitions && status == BLUR_OK; run++)
+    {
+        std::chrono::steady_clock::time_point begin = std::chrono::steady_clock::now();
+        status = blur_plan_execute(plan, &src, &dst);
+        std::chrono::steady_clock::time_point end = std::chrono::steady_clock::now();
+        if ( run > 0 )
+        {
+            milliseconds.push_back(std::chrono::duration<double, std::milli>(end - begin).count());
+        }
+    }
+    blur_plan_destroy(plan);
+    if ( status != BLUR_OK )
+    {
+        throw std::runtime_error(std::string("blur_plan_execute(): ") + blur_status_string(status) + ": " + blur_last_error());
+    }
+    std::sort(milliseconds.begin(), milliseconds.end());
+    return milliseconds[milliseconds.size() / 2];
+}
+
+//  speedup is T(1) / T(p), scaled by p for weak scaling
+static ScalingPoint scalingPoint(int threads, double milliseconds, double baseline, bool weak)
+{
+    ScalingPoint point;
+    point.threads = threads;
+    point.milliseconds = milliseconds;
+    point.speedup = ( weak ? threads : 1 ) * baseline / milliseconds;
+    point.efficiency = point.speedup / threads;
+    point.serialFraction = threads > 1 ? ( 1.0 / point.speedup - 1.0 / threads ) / ( 1.0 - 1.0 / threads ) :
+                                         std::numeric_limits<double>::quiet_NaN();
+    return point;
+}
+
+std::vector<ScalingSeries> measureScaling(const blur_image& image, blur_params params,
+                                          const std::vector<blur_engine>& engines, int maxThreads, int repetitions)
+{
+    maxThreads = std::max(1, maxThreads);
+    const bool threaded = std::find(engines.begin(), engines.end(), BLUR_ENGINE_TILED) != engines.end();
+    const int stacks = threaded ? maxThreads : 1;
+
+    //  The image stacked `stacks` times in every plane; p threads blur the first p copies
+    const size_t rowBytes = image.width, planeBytes = rowBytes * image.height * stacks;
+    std::vector<unsigned char> stacked(planeBytes * image.channels), output(stacked.size());
+    for (int c = 0; c < image.channels; c++)
+    {
+        for (int64_t y = 0; y < image.height * stacks; y++)
+        {
+            std::memcpy(&stacked[c * planeBytes + y * rowBytes],
+                        image.data + c * image.plane_stride + ( y % image.height ) * image.row_stride, rowBytes);
+        }
+    }
+    const blur_image strongDst = { output.data(), image.width, image.height, image.channels, rowBytes, planeBytes };
+
+    std::vector<ScalingSeries> series;
+    for (blur_engine engine : engines)
+    {
+        ScalingSeries result;
+        result.engine = engine;
+        params.engine = engine;
+        const int threadCount = engine == BLUR_ENGINE_TILED ? maxThreads : 1;
+        try
+        {
+            double strongBaseline = 0.0, weakBaseline = 0.0;
+            for (int threads = 1; threads <= threadCount; threads++)
+            {
+                params.threads = threads;
+                const blur_image weakSrc = { stacked.data(), image.width, image.height * threads, image.channels, rowBytes, planeBytes };
+                const blur_image weakDst = { output.data(), image.width, image.height * threads, image.channels, rowBytes, planeBytes };
+                const double strong = timeBlur(image, strongDst, params, repetitions);
+                const double weak = timeBlur(weakSrc, weakDst, params, repetitions);
+                if ( threads == 1 )
+                {
+                    strongBaseline = strong;
+                    weakBaseline = weak;
+                }
+                result.strong.push_back(scalingPoint(threads, strong, strongBaseline, false));
+                result.weak.push_back(scalingPoint(threads, weak, weakBaseline, true));
+            }
+        }
+        catch (std::exception& e)
+        {
+            result.error = e.what();
+        }
+        series.push_back(result);
+    }
+    return series;
+}
+
+static void writeScalingPoints(JsonWriter& json, const std::vector<ScalingPoint>& points)
+{
+    json.beginArray();
+    for (const ScalingPoint& point : points)
+    {
+        json.beginObject()
+            .field("threads", point.threads)
+            .field("median_ms", point.milliseconds)
+            .field("speedup", point.speedup)
+            .field("efficiency", point.efficiency)
+            .field("karp_flatt", point.serialFraction)
+            .endObject();
+    }
+    json.endArray();
+}
+
+static void printScalingTable(std::ostream& out, const char *title, const std::vector<ScalingPoint>& points)
+{
+    out << "  " << title << std::endl
+        << "    threads   median ms    speedup  efficiency  Karp-Flatt" << std::endl;
+    for (const ScalingPoint& point : points)
+    {
+        out << std::setw(11) << point.threads << std::setw(12) << std::setprecision(2) << point.milliseconds
+            << std::setw(11) << std::setprecision(3) << point.speedup << std::setw(12) << point.efficiency;
+        if ( point.threads > 1 )
+        {
+            out << std::setw(12) << point.serialFraction;
+        }
+        else
+        {
+            out << std::setw(12) << "-";
+        }
+        out << std::endl;
+    }
+}
+
+void writeScalingReport(std::ostream& out, const std::vector<ScalingSeries>& series, const blur_image& image,
+                        const blur_params& params, int repetitions, const std::string& format)
+{
+    if ( format == "json" )
+    {
+        JsonWriter json(out);
+        json.beginObject()
+            .field("width", image.width)
+            .field("height", image.height)
+            .field("channels", image.channels)
+            .field("filter_size", params.filter_size)
+            .field("sigma", params.sigma)
+            .field("repetitions", repetitions)
+            .key("engines").beginArray();
+        for (const ScalingSeries& result : series)
+        {
+            json.beginObject().field("engine", blur_engine_string(result.engine));
+            if ( !result.error.empty() )
+            {
+                json.field("error", result.error).endObject();
+                continue;
+            }
+            json.key("strong");
+            writeScalingPoints(json, result.strong);
+            json.key("weak");
+            writeScalingPoints(json, result.weak);
+            json.endObject();
+        }
+        json.endArray().endObject();
+        return;
+    }
+    out << "=========\nScaling of " << image.width << "x" << image.height << "x" << image.channels << ", filter size "
+        << params.filter_size << " (median of " << repetitions << " runs)" << std::endl << std::fixed;
+    const std::streamsize precision = out.precision();
+    for (const ScalingSeries& result : series)
+    {
+        out << blur_engine_string(result.engine) << ":" << std::endl;
+        if ( !result.error.empty() )
+        {
+            out << "  " << result.error << std::endl;
+            continue;
+        }
+        printScalingTable(out, "strong (same image)", result.strong);
+        printScalingTable(out, "weak (image stacked once per thread)", result.weak);
+    }
+    out.unsetf(std::ios_base::floatfield);
+    out.precision(precision);
+}
@@ -0,0 +1,54 @@
+/*
+*   scaling_report.h
+*   part of image blur software using CUDA
+*   for CSC 630 with Dr. Zhang
+*
+*   This header file contains the definitions for the --scaling-report mode of blur.exe.
+*   The blur is timed at 1 .. N threads, on the image as given (strong scaling: the same work on
+*   more threads) and on the image stacked p times for p threads (weak scaling: the same work per
+*   thread).  For each thread count the report gives
+*       speedup      strong: T(1) / T(p), weak: p * T(1) / T(p) (scaled speedup)
+*       efficiency   speedup / p
+*       Karp-Flatt   experimentally determined serial fraction (1/speedup - 1/p) / (1 - 1/p)
+*   A serial fraction that grows with p points at overhead (synchronisation, memory bandwidth)
+*   rather than at a serial part of the program, which would keep it constant.
+*/
+
+#ifndef SCALING_REPORT_H
+#define SCALING_REPORT_H
+
+#include "libblur.h"
+#include <ostream>
+#include <string>
+#include <vector>
+
+struct ScalingPoint
+{
+    int threads;
+    double milliseconds;        // median of the repetitions
+    double speedup;
+    double efficiency;
+    double serialFraction;      // Karp-Flatt; NaN at 1 thread
+};
+
+struct ScalingSeries
+{
+    blur_engine engine;
+    std::vector<ScalingPoint> strong, weak;
+    std::string error;          // why the engine couldn't run, e.g. no GPU
+};
+
+//  "tiled", "sequential,tiled" or "all" for every engine in this build; false on an unknown name
+bool scalingEnginesFromNames(const std::string& names, std::vector<blur_engine>& engines);
+
+//  Time each engine at 1 .. maxThreads threads, median of `repetitions` runs after one warmup.
+//  Only the tiled engine takes threads; the others are timed at 1.  The weak-scaling runs need
+//  2 * maxThreads times the image's memory.
+std::vector<ScalingSeries> measureScaling(const blur_image& image, blur_params params,
+                                          const std::vector<blur_engine>& engines, int maxThreads, int repetitions);
+
+//  Tables as json or text
+void writeScalingReport(std::ostream& out, const std::vector<ScalingSeries>& series, const blur_image& image,
+                        const blur_params& params, int repetitions, const std::string& format);
+
+#endif
@@ -0,0 +1,21 @@
+/*
+*   stage_timings.cpp
+*   part of image blur software using CUDA
+*   for CSC 630 with Dr. Zhang
+*
+*   This program implements the per-thread stage timing collector.
+*/
+
+#include "stage_timings.h"
+
+static thread_local StageTimings *currentTimings = nullptr;
+
+StageTimings *threadStageTimings()
+{
+    return currentTimings;
+}
+
+void setThreadStageTimings(StageTimings *timings)
+{
+    currentTimings = timings;
+}
@@ -0,0 +1,84 @@
+/*
+*   stage_timings.h
+*   part of image blur software using CUDA
+*   for CSC 630 with Dr. Zhang
+*
+*   This header file contains the definitions for per-stage timing of blurs.
+*   The engines mark their stages (kernel generation, copies, convolution per channel, ...) with a
+*   StageTimer.  Nothing is measured unless the calling thread has installed a StageTimings
+*   collector, so untimed blurs pay one thread-local load per stage.  All times come from the
+*   monotonic steady_clock.  While tracing is on the stages are also trace spans.
+*/
+
+#ifndef STAGE_TIMINGS_H
+#define STAGE_TIMINGS_H
+
+#include "trace_events.h"
+#include <chrono>
+#include <vector>
+
+struct StageTiming
+{
+    const char *stage;          // string literal, e.g. "convolution"
+    int channel;                // -1 when the stage covers every channel
+    double microseconds;
+};
+
+class StageTimings
+{
+public:
+    void add(const char *stage, int channel, double microseconds) { _entries.push_back(StageTiming{ stage, channel, microseconds }); }
+    const std::vector<StageTiming>& entries() const { return _entries; }
+    void clear() { _entries.clear(); }
+
+private:
+    std::vector<StageTiming> _entries;
+};
+
+//  Collector of the calling thread, nullptr when it isn't recording
+StageTimings *threadStageTimings();
+
+//  Install (or with nullptr remove) the calling thread's collector
+void setThreadStageTimings(StageTimings *timings);
+
+//  Times its scope into the thread's collector, if there is one, and the trace
+class StageTimer
+{
+public:
+    explicit StageTimer(const char *stage, int channel = -1)
+        : _timings(threadStageTimings()), _traced(tracing()), _stage(stage), _channel(channel)
+    {
+        if ( _timings || _traced )
+        {
+            _begin = std::chrono::steady_clock::now();
+        }
+    }
+
+    ~StageTimer()
+    {
+        if ( _timings || _traced )
+        {
+            const std::chrono::steady_clock::time_point end = std::chrono::steady_clock::now();
+            if ( _timings )
+            {
+                _timings->add(_stage, _channel, std::chrono::duration<double, std::micro>(end - _begin).count());
+            }
+            if ( _traced )
+            {
+                traceComplete(_stage, "blur", _begin, end, _channel);
+            }
+        }
+    }
+
+    StageTimer(const StageTimer&) = delete;
+    StageTimer& operator=(const StageTimer&) = delete;
+
+private:
+    StageTimings *_timings;
+    bool _traced;
+    const char *_stage;
+    int _channel;
+    std::chrono::steady_clock::time_point _begin;
+};
+
+#endif
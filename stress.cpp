@@ -0,0 +1,352 @@
+/*
+*   stress.cpp
+*   part of image blur software using CUDA
+*   for CSC 630 with Dr. Zhang
+*
+*   This program checks that the blur entry points are reentrant.  Built and run with `make stress`,
+*   and under ThreadSanitizer with `make stress TSAN=1`.
+*   Random jobs (shape, channels, filter size, sigma, engine, border) are first blurred one at a
+*   time with the sequential engine as the reference.  Then many threads blur them again at once
+*   through every entry point: one-off blur_image_into() calls, plans each thread keeps and
+*   re-executes, and the C++ blur_sequential().  Each call takes its scratch from its thread's arena
+*   while the tiled engine runs tiles on workers of its own, other threads record stage timings, and one
+*   thread trims the shared buffer pool now and then.  Every output must equal its reference, and
+*   bad arguments must come back as a status with the message on the calling thread.
+*   Last, tiled plans on several threads are executed again and again: after the first execute
+*   neither the buffer pool nor operator new (counted here for every thread) may allocate.
+*
+*   Command-line arguments:
+*         option            input           description
+*       --jobs              count           random images
+*       --rounds            count           times each job is blurred concurrently
+*       --threads, -t       count           concurrent callers
+*       --seed              integer         seed of the random jobs
+*       --executes          count           repeated executes of each plan in the allocation check
+*       --help, -h          none            display help for this program
+*
+*   Running the program:
+*       ./stress.exe --jobs 400 --rounds 3 -t 16
+*/
+
+#include "boost/program_options.hpp"
+#include "libblur.h"
+#include "cimg_utils.h"
+#include <algorithm>
+#include <atomic>
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+#include <new>
+#include <random>
+#include <stdexcept>
+#include <string>
+#include <thread>
+#include <vector>
+
+namespace
+{
+    const size_t ERROR_IN_COMMAND_LINE = 1;
+    const size_t SUCCESS = 0;
+    const size_t ERROR_UNHANDLED_EXCEPTION = 2;
+    const size_t ERROR_MISMATCH = 3;
+
+    //  Workers of the tiled engine inside each call, and its tile edge: small and odd, so every
+    //  image is cut into several uneven tiles
+    const int TILED_THREADS = 3;
+    const int TILED_TILE_SIZE = 37;
+
+    //  operator new calls on any thread since the start
+    std::atomic<uint64_t> newCalls(0);
+} // namespace
+
+//  Counted global operator new, so the allocation check sees what the workers allocate too
+void *operator new(size_t bytes)
+{
+    newCalls++;
+    void *memory = std::malloc(bytes > 0 ? bytes : 1);
+    if ( !memory )
+    {
+        throw std::bad_alloc();
+    }
+    return memory;
+}
+
+void operator delete(void *memory) noexcept
+{
+    std::free(memory);
+}
+
+void operator delete(void *memory, size_t) noexcept
+{
+    std::free(memory);
+}
+
+struct StressJob
+{
+    int64_t width, height;
+    int channels;
+    int filterSize;
+    double sigma;
+    blur_engine engine;
+    blur_border_mode border;
+    std::vector<unsigned char> input, reference;
+};
+
+static blur_params jobParams(const StressJob& job)
+{
+    blur_params params;
+    blur_params_default(&params);
+    params.filter_size = job.filterSize;
+    params.sigma = job.sigma;
+    params.border = job.border;
+    params.engine = job.engine;
+    params.threads = job.engine == BLUR_ENGINE_TILED ? TILED_THREADS : 1;
+    params.tile_size = job.engine == BLUR_ENGINE_TILED ? TILED_TILE_SIZE : 0;
+    return params;
+}
+
+static std::vector<StressJob> makeJobs(int count, unsigned int seed)
+{
+    std::mt19937 random(seed);
+    std::vector<StressJob> jobs(count);
+    for (StressJob& job : jobs)
+    {
+        job.width = 1 + random() % 300;
+        job.height = 1 + random() % 200;
+        job.channels = 1 + random() % 4;
+        job.filterSize = 1 + random() % 4;
+        job.sigma = 0.5 + ( random() % 40 ) / 10.0;
+        job.engine = random() % 2 ? BLUR_ENGINE_TILED : BLUR_ENGINE_SEQUENTIAL;
+        job.border = (blur_border_mode)( random() % 3 );
+        job.input.resize((size_t)job.width * job.height * job.channels);
+        for (unsigned char& pixel : job.input)
+        {
+            pixel = (unsigned char)random();
+        }
+
+        job.reference.resize(job.input.size());
+        blur_params params = jobParams(job);
+        params.engine = BLUR_ENGINE_SEQUENTIAL;
+        params.threads = 1;
+        blur_image src = blur_image_packed(job.input.data(), job.width, job.height, job.channels);
+        blur_image dst = blur_image_packed(job.reference.data(), job.width, job.height, job.channels);
+        if ( blur_image_into(&src, &dst, &params) != BLUR_OK )
+        {
+            throw std::runtime_error(std::string("reference blur failed: ") + blur_last_error());
+        }
+    }
+    return jobs;
+}
+
+//  Blur job `index` of round `round` one of three ways; false when it failed or its output differs
+static bool blurJob(const StressJob& job, int round, std::vector<blur_plan*>& plans, size_t index)
+{
+    std::vector<unsigned char> output(job.input.size());
+    blur_image src = blur_image_packed(const_cast<unsigned char*>(job.input.data()), job.width, job.height, job.channels);
+    blur_image dst = blur_image_packed(output.data(), job.width, job.height, job.channels);
+    const blur_params params = jobParams(job);
+    switch (round % 3)
+    {
+        case 0:
+            if ( blur_image_into(&src, &dst, &params) != BLUR_OK )
+            {
+                return false;
+            }
+            break;
+        case 1:
+        {
+            //  A plan per job and thread, created on first use and executed again on later rounds
+            blur_plan*& plan = plans[index];
+            if ( !plan && blur_plan_create(&plan, job.width, job.height, job.channels, &params) != BLUR_OK )
+            {
+                return false;
+            }
+            if ( blur_plan_execute(plan, &src, &dst) != BLUR_OK )
+            {
+                return false;
+            }
+            break;
+        }
+        default:
+            if ( job.border != BLUR_BORDER_KEEP )
+            {
+                //  blur_sequential() only keeps the border; timings are recorded instead on these
+                blur_stage_time times[64];
+                blur_timings_start();
+                const blur_status status = blur_image_into(&src, &dst, &params);
+                blur_timings_stop(times, 64);
+                if ( status != BLUR_OK )
+                {
+                    return false;
+                }
+                break;
+            }
+            cl::CImg<unsigned char> image(job.input.data(), job.width, job.height, 1, job.channels);
+            cl::CImg<unsigned char> blurred = blur_sequential(image, job.filterSize, job.sigma);
+            std::memcpy(output.data(), blurred.data(), output.size());
+            break;
+    }
+    return output == job.reference;
+}
+
+//  Execute a tiled plan on TILED_THREADS workers `executes` times after a first execute; false if
+//  any of them allocated on the heap, through the pool or operator new, or gave a wrong output
+static bool checkRepeatedExecutes(const StressJob& job, int executes)
+{
+    blur_params params = jobParams(job);
+    params.engine = BLUR_ENGINE_TILED;
+    params.threads = TILED_THREADS;
+    params.tile_size = TILED_TILE_SIZE;
+    std::vector<unsigned char> output(job.input.size());
+    blur_image src = blur_image_packed(const_cast<unsigned char*>(job.input.data()), job.width, job.height, job.channels);
+    blur_image dst = blur_image_packed(output.data(), job.width, job.height, job.channels);
+    blur_plan *plan = NULL;
+    if ( blur_plan_create(&plan, job.width, job.height, job.channels, &params) != BLUR_OK ||
+         blur_plan_execute(plan, &src, &dst) != BLUR_OK )
+    {
+        blur_plan_destroy(plan);
+        return false;
+    }
+
+    blur_pool_counters before, after;
+    blur_pool_stats(&before);
+    const uint64_t newBefore = newCalls;
+    bool passed = true;
+    for (int i = 0; i < executes; i++)
+    {
+        passed = blur_plan_execute(plan, &src, &dst) == BLUR_OK && passed;
+    }
+    const uint64_t newAfter = newCalls;
+    blur_pool_stats(&after);
+    blur_plan_destroy(plan);
+
+    const uint64_t poolAllocations = after.heap_allocations - before.heap_allocations;
+    std::cout << "  " << job.width << "x" << job.height << "x" << job.channels << ", filter size " << job.filterSize
+              << ": " << newAfter - newBefore << " operator new and " << poolAllocations << " pool allocations" << std::endl;
+    return passed && newAfter == newBefore && poolAllocations == 0 && output == job.reference;
+}
+
+int main(int argc, char** argv)
+{
+    try
+    {
+        int jobCount, rounds, threads, executes;
+        unsigned int seed;
+        namespace po = boost::program_options;
+        po::options_description desc("Options");
+        desc.add_options()
+            ("help,h", "Print help messages")
+            ("jobs", po::value(&jobCount) -> default_value(400), "Random images to blur.")
+            ("rounds", po::value(&rounds) -> default_value(3), "Times each image is blurred concurrently; rounds cycle through one-off calls, plans and blur_sequential.")
+            ("threads,t", po::value(&threads) -> default_value(16), "Concurrent callers.")
+            ("seed", po::value(&seed) -> default_value(1), "Seed of the random images.")
+            ("executes", po::value(&executes) -> default_value(20), "Repeated executes of each plan in the allocation check.");
+
+        po::variables_map vm;
+        try
+        {
+            po::store(po::parse_command_line(argc, argv, desc), vm);
+            if ( vm.count("help") )
+            {
+                std::cout << "Blur random images from many threads at once and compare with serial references." << std::endl << desc << std::endl;
+                return SUCCESS;
+            }
+            po::notify(vm);
+        }
+        catch(po::error& e)
+        {
+            std::cerr << "ERROR: " << e.what() << std::endl << std::endl << desc << std::endl;
+            return ERROR_IN_COMMAND_LINE;
+        }
+        if ( jobCount < 1 || rounds < 1 || threads < 1 || executes < 1 )
+        {
+            std::cerr << "ERROR: --jobs, --rounds, --threads and --executes must be positive. Exit with code " << ERROR_IN_COMMAND_LINE << "." << std::endl;
+            return ERROR_IN_COMMAND_LINE;
+        }
+
+        const std::vector<StressJob> jobs = makeJobs(jobCount, seed);
+        std::atomic<int> next(0), mismatches(0), done(0);
+        std::vector<std::thread> callers;
+        for (int thread = 0; thread < threads; thread++)
+        {
+            callers.emplace_back([&, thread]()
+            {
+                std::vector<blur_plan*> plans(jobs.size(), nullptr);
+                for (int i; ( i = next++ ) < jobCount * rounds; )
+                {
+                    if ( !blurJob(jobs[i % jobCount], i / jobCount, plans, i % jobCount) )
+                    {
+                        mismatches++;
+                    }
+                    //  Buffers go back to the heap while the other threads are taking them from the pool
+                    if ( thread == 0 && i % 50 == 0 )
+                    {
+                        blur_pool_trim();
+                    }
+                    done++;
+                }
+                for (blur_plan *plan : plans)
+                {
+                    blur_plan_destroy(plan);
+                }
+            });
+        }
+        for (std::thread& caller : callers)
+        {
+            caller.join();
+        }
+        std::cout << done << " blurs on " << threads << " threads, " << mismatches << " mismatches" << std::endl;
+
+        //  Errors come back as a status, and each thread sees its own message: odd threads pass a
+        //  null image, even ones a negative filter size
+        std::atomic<int> wrongErrors(0);
+        std::vector<std::thread> failing;
+        for (int thread = 0; thread < threads; thread++)
+        {
+            failing.emplace_back([&, thread]()
+            {
+                const StressJob& job = jobs[thread % jobCount];
+                blur_params params = jobParams(job);
+                std::vector<unsigned char> output(job.input.size());
+                blur_image src = blur_image_packed(const_cast<unsigned char*>(job.input.data()), job.width, job.height, job.channels);
+                blur_image dst = blur_image_packed(output.data(), job.width, job.height, job.channels);
+                const bool nullImage = thread % 2 == 1;
+                if ( nullImage )
+                {
+                    src.data = NULL;
+                }
+                else
+                {
+                    params.filter_size = -1;
+                }
+                const blur_status status = blur_image_into(&src, &dst, &params);
+                const std::string message = blur_last_error();
+                if ( status != BLUR_ERROR_INVALID_ARGUMENT ||
+                     message.find(nullImage ? "null image" : "filter size") == std::string::npos )
+                {
+                    wrongErrors++;
+                }
+            });
+        }
+        for (std::thread& caller : failing)
+        {
+            caller.join();
+        }
+        std::cout << threads << " bad calls, " << wrongErrors << " without their own status and message" << std::endl;
+
+        //  Plans keep their workers, so executing one again starts no threads and allocates nothing
+        int allocating = 0;
+        std::cout << executes << " repeated executes of tiled plans on " << TILED_THREADS << " threads:" << std::endl;
+        for (int i = 0; i < std::min(jobCount, 4); i++)
+        {
+            allocating += !checkRepeatedExecutes(jobs[i], executes);
+        }
+        std::cout << allocating << " plans allocated or differed on repeated executes" << std::endl;
+        return mismatches == 0 && wrongErrors == 0 && allocating == 0 ? SUCCESS : ERROR_MISMATCH;
+    }
+    catch(std::exception& e)
+    {
+        std::cerr << "Unhandled Exception reached the top of main: " << e.what() << ", application will now exit" << std::endl;
+        return ERROR_UNHANDLED_EXCEPTION;
+    }
+}
@@ -0,0 +1,148 @@
+/*
+*   trace_events.cpp
+*   part of image blur software using CUDA
+*   for CSC 630 with Dr. Zhang
+*
+*   This program implements the lock-free per-thread trace-event recorder.
+*/
+
+#include "trace_events.h"
+#include "json_writer.h"
+
+std::atomic<bool> traceEnabled(false);
+
+namespace
+{
+    struct TraceEvent
+    {
+        const char *name;
+        const char *category;
+        int64_t begin;          // nanoseconds since time zero
+        int64_t duration;       // nanoseconds
+        int64_t arg;
+    };
+
+    //  One per thread that recorded anything, written only by that thread and never freed, so
+    //  writeTrace() can read the events of threads that have already exited
+    struct TraceBuffer
+    {
+        static const size_t CAPACITY = 16384;
+
+        TraceEvent events[CAPACITY];
+        std::atomic<size_t> count{0};               // events published to readers
+        std::atomic<uint64_t> dropped{0};
+        std::atomic<const char*> threadName{nullptr};
+        int tid = 0;
+        TraceBuffer *next = nullptr;
+    };
+
+    std::atomic<TraceBuffer*> traceBuffers(nullptr);
+    std::atomic<int> nextTid(1);
+    std::atomic<int64_t> epoch(0);                  // steady_clock nanoseconds of time zero
+    std::atomic<bool> epochSet(false);
+
+    thread_local TraceBuffer *threadBuffer = nullptr;
+    thread_local const char *threadName = nullptr;
+
+    int64_t nanoseconds(std::chrono::steady_clock::time_point time)
+    {
+        return std::chrono::duration_cast<std::chrono::nanoseconds>(time.time_since_epoch()).count();
+    }
+
+    //  The calling thread's buffer, pushed onto the list with a compare-and-swap the first time
+    TraceBuffer& buffer()
+    {
+        if ( !threadBuffer )
+        {
+            TraceBuffer *created = new TraceBuffer();
+            created->tid = nextTid++;
+            created->threadName.store(threadName, std::memory_order_relaxed);
+            created->next = traceBuffers.load(std::memory_order_relaxed);
+            while ( !traceBuffers.compare_exchange_weak(created->next, created, std::memory_order_release,
+                                                        std::memory_order_relaxed) )
+            {
+            }
+            threadBuffer = created;
+        }
+        return *threadBuffer;
+    }
+} // namespace
+
+void setTracing(bool enabled, std::chrono::steady_clock::time_point zero)
+{
+    bool expected = false;
+    if ( enabled && epochSet.compare_exchange_strong(expected, true) )
+    {
+        epoch = nanoseconds(zero);
+    }
+    traceEnabled.store(enabled, std::memory_order_relaxed);
+}
+
+void traceComplete(const char *name, const char *category, std::chrono::steady_clock::time_point begin,
+                   std::chrono::steady_clock::time_point end, int64_t arg)
+{
+    TraceBuffer& events = buffer();
+    const size_t index = events.count.load(std::memory_order_relaxed);
+    if ( index == TraceBuffer::CAPACITY )
+    {
+        events.dropped.fetch_add(1, std::memory_order_relaxed);
+        return;
+    }
+    const int64_t zero = epoch.load(std::memory_order_relaxed);
+    const int64_t duration = std::chrono::duration_cast<std::chrono::nanoseconds>(end - begin).count();
+    events.events[index] = TraceEvent{ name, category, nanoseconds(begin) - zero, duration, arg };
+    events.count.store(index + 1, std::memory_order_release);
+}
+
+void setTraceThreadName(const char *name)
+{
+    threadName = name;
+    if ( threadBuffer )
+    {
+        threadBuffer->threadName.store(name, std::memory_order_relaxed);
+    }
+}
+
+void writeTrace(std::ostream& out)
+{
+    const int pid = 1;
+    uint64_t dropped = 0;
+    JsonWriter json(out, false);
+    json.beginObject().key("traceEvents").beginArray();
+    for (TraceBuffer *events = traceBuffers.load(std::memory_order_acquire); events; events = events->next)
+    {
+        const char *name = events->threadName.load(std::memory_order_relaxed);
+        json.beginObject()
+            .field("name", "thread_name")
+            .field("ph", "M")
+            .field("pid", pid)
+            .field("tid", events->tid)
+            .key("args").beginObject().field("name", name ? name : "thread").endObject()
+            .endObject();
+
+        const size_t count = events->count.load(std::memory_order_acquire);
+        for (size_t i = 0; i < count; i++)
+        {
+            const TraceEvent& event = events->events[i];
+            json.beginObject()
+                .field("name", event.name)
+                .field("cat", event.category)
+                .field("ph", "X")
+                .field("ts", event.begin / 1e3)
+                .field("dur", event.duration / 1e3)
+                .field("pid", pid)
+                .field("tid", events->tid);
+            if ( event.arg >= 0 )
+            {
+                json.key("args").beginObject().field("index", event.arg).endObject();
+            }
+            json.endObject();
+        }
+        dropped += events->dropped.load(std::memory_order_relaxed);
+    }
+    json.endArray()
+        .field("displayTimeUnit", "ms")
+        .key("otherData").beginObject().field("dropped_events", dropped).endObject()
+        .endObject();
+    out << "\n";
+}
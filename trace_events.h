@@ -0,0 +1,84 @@
+/*
+*   trace_events.h
+*   part of image blur software using CUDA
+*   for CSC 630 with Dr. Zhang
+*
+*   This header file contains the definitions for a Chrome trace-event recorder.
+*   Spans (decode, blur stages, tiles, encode strips, waits for worker threads) are recorded into a
+*   buffer owned by the thread that ran them, so recording takes no lock: the owner fills the next
+*   slot and publishes it with one release store.  writeTrace() reads every thread's published
+*   events and writes the JSON that chrome://tracing and Perfetto open.  While tracing is off a
+*   span costs one relaxed atomic load, so it stays compiled in.
+*
+*   Usage:
+*       setTracing(true);
+*       {
+*           TraceSpan span("decode", "io");
+*           ...
+*       }
+*       writeTrace(out);
+*/
+
+#ifndef TRACE_EVENTS_H
+#define TRACE_EVENTS_H
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <ostream>
+
+extern std::atomic<bool> traceEnabled;
+
+inline bool tracing()
+{
+    return traceEnabled.load(std::memory_order_relaxed);
+}
+
+//  The first call that turns tracing on sets time zero of the trace, by default now
+void setTracing(bool enabled, std::chrono::steady_clock::time_point zero = std::chrono::steady_clock::now());
+
+//  Record a span on the calling thread; name and category must be string literals (or live as
+//  long as the trace).  arg is shown as the span's index when it isn't negative.
+void traceComplete(const char *name, const char *category, std::chrono::steady_clock::time_point begin,
+                   std::chrono::steady_clock::time_point end, int64_t arg = -1);
+
+//  Name of the calling thread in the trace, e.g. "main" or "worker"
+void setTraceThreadName(const char *name);
+
+//  Chrome trace JSON of every event recorded so far; spans past a thread's buffer are dropped
+//  and counted in otherData.dropped_events
+void writeTrace(std::ostream& out);
+
+//  Records its scope as a span when tracing is on
+class TraceSpan
+{
+public:
+    explicit TraceSpan(const char *name, const char *category, int64_t arg = -1)
+        : _name(name), _category(category), _arg(arg), _active(tracing())
+    {
+        if ( _active )
+        {
+            _begin = std::chrono::steady_clock::now();
+        }
+    }
+
+    ~TraceSpan()
+    {
+        if ( _active )
+        {
+            traceComplete(_name, _category, _begin, std::chrono::steady_clock::now(), _arg);
+        }
+    }
+
+    TraceSpan(const TraceSpan&) = delete;
+    TraceSpan& operator=(const TraceSpan&) = delete;
+
+private:
+    const char *_name;
+    const char *_category;
+    int64_t _arg;
+    bool _active;
+    std::chrono::steady_clock::time_point _begin;
+};
+
+#endif
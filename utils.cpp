@@ -8,25 +8,21 @@
 */
 
 #include "utils.h"
-#include <iostream> 
+#include "trace_events.h"
 #include <sstream> 
 #include <string> 
 #include <chrono>
 #include <vector>
+#include <algorithm>
+#include <atomic>
+#include <cctype>
+#include <exception>
+#include <cstdlib>
+#include <mutex>
+#include <new>
+#include <thread>
 #include <sys/stat.h>
  
-/*
-*   Print verbose logging through program runtime.
-*   Only prints if debugFlag is set, which can be done at command-line.
-*/
-void debug(std::string str, bool debugFlag)
-{
-    if (debugFlag)
-    {
-        std::cout << "DEBUG: " << str << std::endl;
-    }
-} 
-
 /*
 *   Returns a string representation of a chrono::time_point
 */
@@ -37,6 +33,15 @@ std::string timePointAsString(const std::chrono::system_clock::time_point& tp) {
     return ts;
 }
 
+/*
+*   Returns the time between two steady_clock readings in microseconds and nanoseconds
+*/
+std::string durationAsString(const std::chrono::steady_clock::time_point& begin, const std::chrono::steady_clock::time_point& end)
+{
+    return std::to_string( std::chrono::duration_cast<std::chrono::microseconds>(end - begin).count() ) + "[µs], or " +
+        std::to_string( std::chrono::duration_cast<std::chrono::nanoseconds>(end - begin).count() ) + "[ns]";
+}
+
 bool fileExists (const std::string& path) {
     struct stat buffer;   
     return (stat (path.c_str(), &buffer) == 0); 
@@ -74,3 +79,186 @@ std::vector<std::string> split(const std::string& s)
     }
     return tokens;
 }
+
+/*
+*   Parse a byte count with an optional K, M, G or T suffix (binary multiples), e.g. 16G
+*/
+size_t parseByteSize(const std::string& text)
+{
+    size_t end = 0;
+    double value;
+    try
+    {
+        value = std::stod(text, &end);
+    }
+    catch (std::exception&)
+    {
+        return 0;
+    }
+
+    std::string suffix = text.substr(end);
+    const std::string units = "KMGT";
+    if ( suffix.size() > 1 && ( suffix[1] == 'B' || suffix[1] == 'b' ) )
+    {
+        suffix.resize(1);
+    }
+    if ( suffix.size() == 1 && units.find(std::toupper(suffix[0])) != std::string::npos )
+    {
+        for (size_t i = 0; i <= units.find(std::toupper(suffix[0])); i++) value *= 1024;
+    }
+    else if ( !suffix.empty() )
+    {
+        return 0;
+    }
+    return value > 0 ? (size_t)value : 0;
+}
+
+//  Aligned heap bytes, released with std::free
+AlignedBytes alignedBytes(size_t bytes, size_t alignment)
+{
+    void *memory = NULL;
+    if ( posix_memalign(&memory, alignment, std::max<size_t>(bytes, 1)) != 0 )
+    {
+        throw std::bad_alloc();
+    }
+    return AlignedBytes(static_cast<unsigned char*>(memory), std::free);
+}
+
+int hardwareThreads()
+{
+    unsigned int threads = std::thread::hardware_concurrency();
+    return threads > 0 ? (int)threads : 1;
+}
+
+/*
+*   Work-sharing loop: every thread takes the next index until none are left.
+*   The calling thread takes part, so threads == 1 runs everything inline.
+*   The first exception thrown by body stops the remaining work and is rethrown here.
+*/
+void parallelFor(int64_t count, int threads, const std::function<void(int64_t)>& body)
+{
+    parallelForWorkers(count, threads, [&](int64_t index, int) { body(index); });
+}
+
+void parallelForWorkers(int64_t count, int threads, const std::function<void(int64_t, int)>& body)
+{
+    //  Threads for this loop only; callers that loop again keep a WorkerPool instead
+    WorkerPool pool((int)std::max<int64_t>(1, std::min<int64_t>(threads, count)));
+    pool.run(count, body);
+}
+
+WorkerPool::WorkerPool(int threads)
+    : next(0)
+{
+    try
+    {
+        for (int i = 1; i < threads; i++)
+        {
+            workers.emplace_back(&WorkerPool::workerMain, this, i);
+        }
+    }
+    catch (...)
+    {
+        //  Join the threads already started; the destructor won't run
+        stop();
+        throw;
+    }
+}
+
+WorkerPool::~WorkerPool()
+{
+    stop();
+}
+
+void WorkerPool::stop()
+{
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        stopping = true;
+    }
+    wake.notify_all();
+    for (auto& thread : workers)
+    {
+        thread.join();
+    }
+    workers.clear();
+}
+
+//  Take the next index until none are left; the first exception stops the others
+void WorkerPool::work(int workerIndex)
+{
+    int64_t index;
+    while ( (index = next++) < count )
+    {
+        try
+        {
+            (*body)(index, workerIndex);
+        }
+        catch (...)
+        {
+            std::lock_guard<std::mutex> lock(failureMutex);
+            if ( !failure )
+            {
+                failure = std::current_exception();
+            }
+            next = count;
+        }
+    }
+}
+
+void WorkerPool::workerMain(int workerIndex)
+{
+    setTraceThreadName("worker");
+    uint64_t seen = 0;
+    for (;;)
+    {
+        {
+            std::unique_lock<std::mutex> lock(mutex);
+            wake.wait(lock, [&]() { return stopping || generation != seen; });
+            if ( stopping )
+            {
+                return;
+            }
+            seen = generation;
+        }
+        work(workerIndex);
+        std::lock_guard<std::mutex> lock(mutex);
+        if ( --busy == 0 )
+        {
+            finished.notify_one();
+        }
+    }
+}
+
+void WorkerPool::run(int64_t count, const std::function<void(int64_t, int)>& body)
+{
+    this->body = &body;
+    this->count = count;
+    next = 0;
+    failure = nullptr;
+    if ( !workers.empty() )
+    {
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            busy = (int)workers.size();
+            generation++;
+        }
+        wake.notify_all();
+    }
+    work(0);
+
+    //  Time the calling thread spends on stragglers after running out of work itself
+    {
+        TraceSpan span("wait for workers", "wait");
+        std::unique_lock<std::mutex> lock(mutex);
+        finished.wait(lock, [&]() { return busy == 0; });
+    }
+    this->body = nullptr;
+
+    if ( failure )
+    {
+        std::exception_ptr rethrown = failure;
+        failure = nullptr;
+        std::rethrow_exception(rethrown);
+    }
+}
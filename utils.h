@@ -7,16 +7,27 @@
 *   This header file contains the definitions for utility functions used by the blur software.
 */
 
+#ifndef UTILS_H
+#define UTILS_H
+
+#include <atomic>
 #include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <exception>
+#include <functional>
+#include <memory>
+#include <mutex>
 #include <string>
+#include <thread>
 #include <vector>
 
-//  Print verbose messages during program runtime
-void debug(std::string str, bool debugFlag);
-
 //  Cast time to string to display program runtime
 std::string timePointAsString(const std::chrono::system_clock::time_point& tp);
 
+//  Elapsed time as "<us>[µs], or <ns>[ns]"
+std::string durationAsString(const std::chrono::steady_clock::time_point& begin, const std::chrono::steady_clock::time_point& end);
+
 //   Check to see if file exists
 bool fileExists (const std::string& path);
 
@@ -25,3 +36,60 @@ std::vector<std::string> split(const std::string& s, char delimiter);
 
 //  Split string into vector of strings space delimiter
 std::vector<std::string> split(const std::string& s);
+
+//  Byte count such as "512M" or "16G" (K, M, G, T are powers of 1024); 0 if malformed
+size_t parseByteSize(const std::string& text);
+
+//  Heap buffer aligned to `alignment` bytes (a power of two), e.g. scratch for vector loads
+typedef std::unique_ptr<unsigned char, void(*)(void*)> AlignedBytes;
+AlignedBytes alignedBytes(size_t bytes, size_t alignment = 64);
+
+//  Number of hardware threads, at least 1
+int hardwareThreads();
+
+//  Run body(0) .. body(count-1) on up to `threads` threads; exceptions are rethrown in the caller
+void parallelFor(int64_t count, int threads, const std::function<void(int64_t)>& body);
+
+//  Same, also telling body which worker (0 .. threads-1) runs it, for per-worker scratch
+void parallelForWorkers(int64_t count, int threads, const std::function<void(int64_t, int)>& body);
+
+/*
+*   Threads kept for repeated parallel loops, e.g. by a plan executed many times.  The threads
+*   are started once, wait between loops, and are joined by the destructor, so run() starts no
+*   threads and allocates nothing.  The calling thread is worker 0, so threads == 1 starts none.
+*   One loop at a time: run() must not be called from two threads at once.
+*/
+class WorkerPool
+{
+public:
+    explicit WorkerPool(int threads);
+    ~WorkerPool();
+    WorkerPool(const WorkerPool&) = delete;
+    WorkerPool& operator=(const WorkerPool&) = delete;
+
+    int threads() const { return (int)workers.size() + 1; }
+
+    //  parallelForWorkers() on these threads
+    void run(int64_t count, const std::function<void(int64_t, int)>& body);
+
+private:
+    void stop();
+    void work(int workerIndex);
+    void workerMain(int workerIndex);
+
+    std::vector<std::thread> workers;
+    std::mutex mutex;
+    std::condition_variable wake, finished;
+    uint64_t generation = 0;                    // loops started, so a worker sees each one once
+    int busy = 0;                               // workers still in the current loop
+    bool stopping = false;
+
+    //  The current loop
+    const std::function<void(int64_t, int)> *body = nullptr;
+    int64_t count = 0;
+    std::atomic<int64_t> next;
+    std::exception_ptr failure;
+    std::mutex failureMutex;
+};
+
+#endif
@@ -0,0 +1,456 @@
+/*
+*   verify_report.cpp
+*   part of image blur software using CUDA
+*   for CSC 630 with Dr. Zhang
+*
+*   This program implements the accuracy and engine-equivalence checks of blur.exe --verify.
+*/
+
+#include "verify_report.h"
+#include "image_io.h"
+#include "json_writer.h"
+#include "utils.h"
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <iomanip>
+#include <limits>
+#include <stdexcept>
+
+namespace
+{
+    //  Tile edge of the tiled engine when the command line doesn't set one, small enough that
+    //  every image is cut into several tiles and their seams are checked
+    const int VERIFY_TILE_SIZE = 64;
+}
+
+//  getFilter's gaussian, kept in double
+static std::vector<double> referenceFilter(int filterSize, double sigma)
+{
+    const int filterWidth = 2*filterSize + 1;
+    std::vector<double> filter((size_t)filterWidth * filterWidth);
+    const double s = 2.0 * sigma * sigma;
+    double sum = 0.0;
+    for (int row = -filterSize; row <= filterSize; row++)
+    {
+        for (int col = -filterSize; col <= filterSize; col++)
+        {
+            const double r = std::sqrt( row * row + col * col );
+            double& weight = filter[(row + filterSize)*filterWidth + col + filterSize];
+            weight = std::exp(-(r * r) / s) / (M_PI * s);
+            sum += weight;
+        }
+    }
+    for (double& weight : filter)
+    {
+        weight /= sum;
+    }
+    return filter;
+}
+
+//  Index i moved back inside 0 .. n-1, as the border modes define it
+static int64_t referenceIndex(int64_t i, int64_t n, blur_border_mode border)
+{
+    if ( border == BLUR_BORDER_CLAMP || n == 1 )
+    {
+        return std::min(std::max<int64_t>(i, 0), n - 1);
+    }
+    while ( i < 0 || i >= n )
+    {
+        i = i < 0 ? -i : 2*(n - 1) - i;
+    }
+    return i;
+}
+
+//  Unrounded blur of every pixel, packed planar; keep leaves the filterSize-wide frame as it was
+static std::vector<double> referenceBlur(const blur_image& image, const std::vector<double>& filter, int filterSize,
+                                         blur_border_mode border)
+{
+    const int filterWidth = 2*filterSize + 1;
+    const int64_t width = image.width, height = image.height;
+    std::vector<double> reference((size_t)width * height * image.channels);
+    for (int c = 0; c < image.channels; c++)
+    {
+        const unsigned char *plane = image.data + c * image.plane_stride;
+        for (int64_t row = 0; row < height; row++)
+        {
+            for (int64_t col = 0; col < width; col++)
+            {
+                double& value = reference[( c * height + row ) * width + col];
+                const bool frame = row < filterSize || row >= height - filterSize || col < filterSize || col >= width - filterSize;
+                if ( frame && border == BLUR_BORDER_KEEP )
+                {
+                    value = plane[row * image.row_stride + col];
+                    continue;
+                }
+                value = 0.0;
+                for (int vrow = 0; vrow < filterWidth; vrow++)
+                {
+                    const unsigned char *source = plane + referenceIndex(row - filterSize + vrow, height, border) * image.row_stride;
+                    for (int vcol = 0; vcol < filterWidth; vcol++)
+                    {
+                        value += source[referenceIndex(col - filterSize + vcol, width, border)] * filter[vrow*filterWidth + vcol];
+                    }
+                }
+            }
+        }
+    }
+    return reference;
+}
+
+//  Blur `image` with params in a packed or padded layout and return the output packed
+static std::vector<unsigned char> engineBlur(const blur_image& image, const blur_params& params, bool padded)
+{
+    const int64_t width = image.width, height = image.height;
+    const int channels = image.channels;
+    const size_t bytes = padded ? blur_image_padded_bytes(width, height, channels) : (size_t)width * height * channels;
+    AlignedBytes input = alignedBytes(bytes), output = alignedBytes(bytes);
+    std::memset(output.get(), 0, bytes);
+    const blur_image src = padded ? blur_image_padded(input.get(), width, height, channels) :
+                                    blur_image_packed(input.get(), width, height, channels);
+    const blur_image dst = padded ? blur_image_padded(output.get(), width, height, channels) :
+                                    blur_image_packed(output.get(), width, height, channels);
+    for (int c = 0; c < channels; c++)
+    {
+        for (int64_t row = 0; row < height; row++)
+        {
+            std::memcpy(src.data + c * src.plane_stride + row * src.row_stride,
+                        image.data + c * image.plane_stride + row * image.row_stride, width);
+        }
+    }
+
+    blur_plan *plan;
+    blur_status status = blur_plan_create(&plan, width, height, channels, &params);
+    if ( status == BLUR_OK )
+    {
+        status = blur_plan_execute(plan, &src, &dst);
+        blur_plan_destroy(plan);
+    }
+    if ( status != BLUR_OK )
+    {
+        throw std::runtime_error(std::string(blur_status_string(status)) + ": " + blur_last_error());
+    }
+
+    std::vector<unsigned char> packed((size_t)width * height * channels);
+    for (int c = 0; c < channels; c++)
+    {
+        for (int64_t row = 0; row < height; row++)
+        {
+            std::memcpy(&packed[( c * height + row ) * width], dst.data + c * dst.plane_stride + row * dst.row_stride, width);
+        }
+    }
+    return packed;
+}
+
+static int maxDifference(const std::vector<unsigned char>& a, const std::vector<unsigned char>& b)
+{
+    int difference = 0;
+    for (size_t i = 0; i < a.size(); i++)
+    {
+        difference = std::max(difference, std::abs((int)a[i] - (int)b[i]));
+    }
+    return difference;
+}
+
+std::vector<unsigned char> noiseImage(int64_t width, int64_t height, int channels, uint32_t seed)
+{
+    std::vector<unsigned char> pixels((size_t)width * height * channels);
+    for (unsigned char& pixel : pixels)
+    {
+        seed = seed * 1103515245u + 12345u;
+        pixel = (unsigned char)(seed >> 24);
+    }
+    return pixels;
+}
+
+void verifyEngines(const std::string& name, const blur_image& image, blur_params params,
+                   const std::vector<int>& threadCounts, const VerifyTolerance& tolerance,
+                   std::vector<VerifyCase>& cases)
+{
+    const int filterSize = params.filter_size > 0 ? params.filter_size : std::max(1, (int)std::ceil(3.0 * params.sigma));
+    const std::vector<double> filter = referenceFilter(filterSize, params.sigma);
+    if ( params.tile_size == 0 )
+    {
+        params.tile_size = VERIFY_TILE_SIZE;
+    }
+
+    for (blur_border_mode border : { BLUR_BORDER_KEEP, BLUR_BORDER_CLAMP, BLUR_BORDER_MIRROR })
+    {
+        params.border = border;
+        const std::vector<double> reference = referenceBlur(image, filter, filterSize, border);
+        for (bool padded : { false, true })
+        {
+            //  The sequential engine's output is what the others must match; the tiled engine's at
+            //  the first thread count is what its other thread counts must match
+            std::vector<unsigned char> sequential, firstTiled;
+            for (blur_engine engine : { BLUR_ENGINE_SEQUENTIAL, BLUR_ENGINE_TILED, BLUR_ENGINE_CUDA })
+            {
+                if ( !blur_engine_available(engine) )
+                {
+                    continue;
+                }
+                const std::vector<int> engineThreads = engine == BLUR_ENGINE_TILED ? threadCounts : std::vector<int>{ 1 };
+                for (int threads : engineThreads)
+                {
+                    VerifyCase result;
+                    result.image = name;
+                    result.width = image.width;
+                    result.height = image.height;
+                    result.channels = image.channels;
+                    result.engine = engine;
+                    result.border = border;
+                    result.threads = threads;
+                    result.padded = padded;
+                    params.engine = engine;
+                    params.threads = threads;
+                    try
+                    {
+                        const std::vector<unsigned char> output = engineBlur(image, params, padded);
+                        double squares = 0.0;
+                        for (size_t i = 0; i < output.size(); i++)
+                        {
+                            const double error = std::abs(output[i] - reference[i]);
+                            result.maxError = std::max(result.maxError, error);
+                            squares += error * error;
+                        }
+                        const double mse = squares / output.size();
+                        result.psnr = mse > 0.0 ? 10.0 * std::log10(255.0 * 255.0 / mse) : std::numeric_limits<double>::infinity();
+
+                        if ( engine == BLUR_ENGINE_SEQUENTIAL )
+                        {
+                            sequential = output;
+                        }
+                        else if ( !sequential.empty() )
+                        {
+                            result.engineDifference = maxDifference(output, sequential);
+                        }
+                        if ( engine == BLUR_ENGINE_TILED && firstTiled.empty() )
+                        {
+                            firstTiled = output;
+                        }
+                        else if ( engine == BLUR_ENGINE_TILED )
+                        {
+                            result.deterministic = output == firstTiled;
+                        }
+                        result.passed = result.maxError <= tolerance.maxError && result.psnr >= tolerance.minPsnr && result.deterministic;
+                    }
+                    catch (std::exception& e)
+                    {
+                        result.error = e.what();
+                    }
+                    cases.push_back(result);
+                }
+            }
+        }
+    }
+}
+
+static const char *borderName(blur_border_mode border)
+{
+    switch (border)
+    {
+        case BLUR_BORDER_KEEP:   return "keep";
+        case BLUR_BORDER_CLAMP:  return "clamp";
+        case BLUR_BORDER_MIRROR: return "mirror";
+    }
+    return "unknown";
+}
+
+//  Decode at 1/reduced.denominator, blur with the reduced kernel and scale to outputScale of the full image
+static cl::CImg<unsigned char> decodeBlurScale(const std::string& path, const ReducedDecode& reduced, blur_params params,
+                                               double outputScale)
+{
+    ImageFormat format = ImageFormat::Unknown;
+    ImageInfo fullSize;
+    cl::CImg<unsigned char> image = loadImage(path, format, reduced.denominator, &fullSize);
+    cl::CImg<unsigned char> blurred(image.width(), image.height(), 1, image.spectrum());
+    params.sigma = reduced.sigma;
+    params.filter_size = reduced.filterSize;
+    const blur_image src = blur_image_packed(image.data(), image.width(), image.height(), image.spectrum());
+    const blur_image dst = blur_image_packed(blurred.data(), blurred.width(), blurred.height(), blurred.spectrum());
+    const blur_status status = blur_image_into(&src, &dst, &params);
+    if ( status != BLUR_OK )
+    {
+        throw std::runtime_error(std::string(blur_status_string(status)) + ": " + blur_last_error());
+    }
+    resizeToOutput(blurred, fullSize, outputScale);
+    return blurred;
+}
+
+void verifyReducedDecode(const std::string& path, blur_params params, const VerifyTolerance& tolerance,
+                         std::vector<ReducedDecodeCase>& cases)
+{
+    const int filterSize = params.filter_size > 0 ? params.filter_size : std::max(1, (int)std::ceil(3.0 * params.sigma));
+    const ReducedDecodeCase settings[] = { { 0.25, params.sigma, filterSize, BLUR_BORDER_KEEP },
+                                           { 1.0, 8.0, 16, BLUR_BORDER_KEEP } };
+    for (const ReducedDecodeCase& setting : settings)
+    {
+        for (blur_border_mode border : { BLUR_BORDER_KEEP, BLUR_BORDER_CLAMP, BLUR_BORDER_MIRROR })
+        {
+            ReducedDecodeCase result = setting;
+            result.border = border;
+            params.border = border;
+            const ReducedDecode reduced = planReducedDecode(result.outputScale, result.sigma, result.filterSize,
+                                                            border == BLUR_BORDER_KEEP);
+            result.denominator = reduced.denominator;
+            if ( reduced.denominator == 1 )
+            {
+                result.psnr = std::numeric_limits<double>::infinity();
+                result.passed = true;
+                cases.push_back(result);
+                continue;
+            }
+            try
+            {
+                const cl::CImg<unsigned char> exact = decodeBlurScale(path, { 1, result.sigma, result.filterSize }, params,
+                                                                      result.outputScale);
+                const cl::CImg<unsigned char> approximate = decodeBlurScale(path, reduced, params, result.outputScale);
+                if ( exact.width() != approximate.width() || exact.height() != approximate.height() ||
+                     exact.spectrum() != approximate.spectrum() )
+                {
+                    throw std::runtime_error("reduced and full decodes scale to different sizes");
+                }
+                double squares = 0.0;
+                for (size_t i = 0; i < exact.size(); i++)
+                {
+                    const double error = std::abs((int)exact.data()[i] - (int)approximate.data()[i]);
+                    result.maxError = std::max(result.maxError, error);
+                    squares += error * error;
+                }
+                const double mse = squares / exact.size();
+                result.psnr = mse > 0.0 ? 10.0 * std::log10(255.0 * 255.0 / mse) : std::numeric_limits<double>::infinity();
+                result.passed = result.maxError <= tolerance.reducedMaxError && result.psnr >= tolerance.reducedMinPsnr;
+            }
+            catch (std::exception& e)
+            {
+                result.error = e.what();
+            }
+            cases.push_back(result);
+        }
+    }
+}
+
+void writeVerifyReport(std::ostream& out, const std::vector<VerifyCase>& cases,
+                       const std::vector<ReducedDecodeCase>& reducedCases, const blur_params& params,
+                       const VerifyTolerance& tolerance, const std::string& format)
+{
+    const size_t failed = std::count_if(cases.begin(), cases.end(), [](const VerifyCase& result) { return !result.passed; });
+    const size_t reducedFailed = std::count_if(reducedCases.begin(), reducedCases.end(),
+                                               [](const ReducedDecodeCase& result) { return !result.passed; });
+    if ( format == "json" )
+    {
+        JsonWriter json(out);
+        json.beginObject()
+            .field("filter_size", params.filter_size)
+            .field("sigma", params.sigma)
+            .field("max_error_tolerance", tolerance.maxError)
+            .field("min_psnr_db", tolerance.minPsnr)
+            .field("cases", (uint64_t)cases.size())
+            .field("failed", (uint64_t)failed)
+            .key("results").beginArray();
+        for (const VerifyCase& result : cases)
+        {
+            json.beginObject()
+                .field("image", result.image)
+                .field("width", result.width)
+                .field("height", result.height)
+                .field("channels", result.channels)
+                .field("engine", blur_engine_string(result.engine))
+                .field("border", borderName(result.border))
+                .field("threads", result.threads)
+                .field("layout", result.padded ? "padded" : "packed")
+                .field("pixel_type", "uint8");
+            if ( !result.error.empty() )
+            {
+                json.field("error", result.error);
+            }
+            else
+            {
+                json.field("max_abs_error", result.maxError)
+                    .field("psnr_db", result.psnr)
+                    .field("max_difference_from_sequential", result.engineDifference)
+                    .field("deterministic", result.deterministic);
+            }
+            json.field("passed", result.passed).endObject();
+        }
+        json.endArray()
+            .field("reduced_max_error_tolerance", tolerance.reducedMaxError)
+            .field("reduced_min_psnr_db", tolerance.reducedMinPsnr)
+            .field("reduced_decode_failed", (uint64_t)reducedFailed)
+            .key("reduced_decode").beginArray();
+        for (const ReducedDecodeCase& result : reducedCases)
+        {
+            json.beginObject()
+                .field("output_scale", result.outputScale)
+                .field("sigma", result.sigma)
+                .field("filter_size", result.filterSize)
+                .field("border", borderName(result.border))
+                .field("denominator", result.denominator);
+            if ( !result.error.empty() )
+            {
+                json.field("error", result.error);
+            }
+            else if ( result.denominator > 1 )
+            {
+                json.field("max_abs_error", result.maxError)
+                    .field("psnr_db", result.psnr);
+            }
+            json.field("passed", result.passed).endObject();
+        }
+        json.endArray().endObject();
+        return;
+    }
+    const std::streamsize precision = out.precision();
+    out << "=========\nVerify against the double-precision reference (max error " << tolerance.maxError
+        << ", PSNR " << tolerance.minPsnr << " dB):" << std::endl << std::fixed << std::setprecision(3);
+    for (const VerifyCase& result : cases)
+    {
+        out << ( result.passed ? "  pass  " : "  FAIL  " ) << result.image << " " << result.width << "x" << result.height
+            << "x" << result.channels << " " << blur_engine_string(result.engine) << " " << borderName(result.border) << " "
+            << result.threads << "t " << ( result.padded ? "padded" : "packed" ) << ": ";
+        if ( !result.error.empty() )
+        {
+            out << result.error << std::endl;
+            continue;
+        }
+        out << "max error " << result.maxError << ", PSNR ";
+        if ( std::isinf(result.psnr) )
+        {
+            out << "inf";
+        }
+        else
+        {
+            out << result.psnr << " dB";
+        }
+        out << ", vs sequential " << result.engineDifference << ( result.deterministic ? "" : ", CHANGES WITH THREAD COUNT" ) << std::endl;
+    }
+    out << "  " << cases.size() - failed << " of " << cases.size() << " cases passed" << std::endl;
+    if ( !reducedCases.empty() )
+    {
+        out << "Reduced JPEG decode against the full-resolution decode (max error " << tolerance.reducedMaxError
+            << ", PSNR " << tolerance.reducedMinPsnr << " dB):" << std::endl;
+    }
+    for (const ReducedDecodeCase& result : reducedCases)
+    {
+        out << ( result.passed ? "  pass  " : "  FAIL  " ) << "scale " << result.outputScale << " sigma " << result.sigma
+            << " f" << result.filterSize << " " << borderName(result.border) << ": ";
+        if ( !result.error.empty() )
+        {
+            out << result.error << std::endl;
+        }
+        else if ( result.denominator == 1 )
+        {
+            out << "not reduced" << std::endl;
+        }
+        else
+        {
+            out << "1/" << result.denominator << ", max error " << result.maxError << ", PSNR " << result.psnr << " dB" << std::endl;
+        }
+    }
+    if ( !reducedCases.empty() )
+    {
+        out << "  " << reducedCases.size() - reducedFailed << " of " << reducedCases.size() << " reduced decodes passed" << std::endl;
+    }
+    out.unsetf(std::ios_base::floatfield);
+    out.precision(precision);
+}
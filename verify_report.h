@@ -0,0 +1,82 @@
+/*
+*   verify_report.h
+*   part of image blur software using CUDA
+*   for CSC 630 with Dr. Zhang
+*
+*   This header file contains the definitions for the --verify mode of blur.exe.
+*   Every engine in the build blurs the same images under every border mode, at several thread
+*   counts and in packed and cache-line padded layouts, and each output is compared with a
+*   double-precision reference convolution that uses getFilter's gaussian without rounding the
+*   taps to float.  A case fails when its largest error or its PSNR breaches the tolerance, and
+*   the tiled engine fails when its output changes with the thread count.  JPEG input also checks
+*   the reduced decode against decoding at full resolution.
+*/
+
+#ifndef VERIFY_REPORT_H
+#define VERIFY_REPORT_H
+
+#include "libblur.h"
+#include <ostream>
+#include <string>
+#include <vector>
+
+struct VerifyTolerance
+{
+    double maxError = 1.01;     // 8-bit levels: the engines truncate to integers (up to 1) after summing float taps
+    double minPsnr = 50.0;      // dB against the unrounded reference
+    //  A reduced JPEG decode approximates the full-resolution blur-then-scale, so its limits are looser
+    double reducedMaxError = 64.0;
+    double reducedMinPsnr = 36.0;
+};
+
+struct VerifyCase
+{
+    std::string image;          // "input", or the synthetic image's name
+    int64_t width, height;
+    int channels;
+    blur_engine engine;
+    blur_border_mode border;
+    int threads;
+    bool padded;                // rows padded to cache lines
+    double maxError = 0.0;
+    double psnr = 0.0;          // infinite when the output is exact
+    double engineDifference = 0.0;  // largest difference from the sequential engine's output
+    bool deterministic = true;  // same bytes as the same engine at one thread
+    bool passed = false;
+    std::string error;          // why the engine couldn't run
+};
+
+struct ReducedDecodeCase
+{
+    double outputScale;
+    double sigma;
+    int filterSize;
+    blur_border_mode border;
+    int denominator = 1;        // 1 when planReducedDecode allows no reduction: nothing to compare
+    double maxError = 0.0;      // against the full-resolution decode, blur and scale
+    double psnr = 0.0;
+    bool passed = false;
+    std::string error;
+};
+
+//  Verify every engine on `image` (named `name`) and append the cases; threadCounts are the thread
+//  counts of the tiled engine
+void verifyEngines(const std::string& name, const blur_image& image, blur_params params,
+                   const std::vector<int>& threadCounts, const VerifyTolerance& tolerance,
+                   std::vector<VerifyCase>& cases);
+
+//  Decode the JPEG at `path` at reduced resolution, blur and scale it, and compare with the full
+//  resolution decode, blur and scale, under every border mode: once at a 1/4 output scale with the
+//  params' blur, and once at full scale with a blur wide enough (sigma 8) to reduce on its own
+void verifyReducedDecode(const std::string& path, blur_params params, const VerifyTolerance& tolerance,
+                         std::vector<ReducedDecodeCase>& cases);
+
+//  Noise of the given shape, for the synthetic images
+std::vector<unsigned char> noiseImage(int64_t width, int64_t height, int channels, uint32_t seed);
+
+//  Table as json or text
+void writeVerifyReport(std::ostream& out, const std::vector<VerifyCase>& cases,
+                       const std::vector<ReducedDecodeCase>& reducedCases, const blur_params& params,
+                       const VerifyTolerance& tolerance, const std::string& format);
+
+#endif